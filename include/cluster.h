@@ -0,0 +1,37 @@
+#ifndef CLUSTER_H
+#define CLUSTER_H
+
+#include <stdint.h>
+
+#include "compare.h"
+
+/*
+ * Clusters of files : the connected components of the graph whose edges are
+ * their matches scoring at least a threshold. A file without such a match is
+ * alone in its cluster.
+ */
+typedef struct {
+    uint64_t nb_files;
+    uint64_t nb_clusters;
+    uint64_t *cluster; /* Of each file */
+    uint64_t *first;   /* Of the files of each cluster, nb_clusters + 1 */
+    uint64_t *files;   /* Grouped by cluster, by increasing index */
+    uint64_t *medoids; /* File of each cluster closest to the others */
+} cluster_result_t;
+
+/*
+ * Cluster the files of a comparision with union-find over their matches
+ * scoring at least threshold : only the files and the matches are needed,
+ * not every pair. The clusters are numbered by decreasing size, then by
+ * increasing index of their first file. The medoid of a cluster is the file
+ * with the highest sum of scores with the others, the lowest index if equal.
+ * Return NULL if problems.
+ */
+cluster_result_t *cluster_new(const compare_result_t *result, float threshold);
+
+/* Number of files of the cluster c */
+uint64_t cluster_size(const cluster_result_t *clusters, uint64_t c);
+
+void cluster_free(cluster_result_t *clusters);
+
+#endif
@@ -0,0 +1,130 @@
+#ifndef COMPARE_H
+#define COMPARE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sig_db.h"
+
+/* Algorithms to compare the signatures with */
+/* clang-format off */
+typedef enum
+{
+  COMPARE_CTPH,
+  COMPARE_SIMHASH,
+  COMPARE_END
+} compare_algorithm_e;
+/* clang-format on */
+
+/* Options of the comparision */
+typedef struct {
+    uint64_t nb_jobs;
+    uint64_t top;    /* Best matches kept for each file, 0 for all */
+    float min_score; /* Lowest score kept, the pairs are abandoned below */
+    bool ctph_index; /* Only score the CTPH pairs sharing a substring */
+    int simhash_radius; /* Only the SimHash pairs within it, -1 for all */
+    bool cascade; /* Only score the CTPH pairs within simhash_radius */
+    uint64_t shard;     /* Only score the tiles t % nb_shards == shard */
+    uint64_t nb_shards; /* 0 or 1 to score all the tiles */
+} compare_options_t;
+
+/* Score of a file against another one */
+typedef struct {
+    uint64_t index; /* Of the other file in the database compared with */
+    float score;
+} compare_match_t;
+
+/* Matches of a file, by decreasing score then increasing index */
+typedef struct {
+    compare_match_t *matches;
+    uint64_t nb_matches;
+    uint64_t capacity;
+} compare_list_t;
+
+/* Matches of every file of a database, or of every query */
+typedef struct {
+    uint64_t nb_files;
+    compare_list_t *lists;
+} compare_result_t;
+
+/*
+ * Score each pair of files of the database once, a file is not compared with
+ * itself. Only the positive scores are kept, in the lists of both files.
+ * The pairs are scored by tiles in nb_jobs threads, the result is the same
+ * whatever their number. With CTPH, only the pairs of files whose block sizes
+ * are the same or double are scored and, with ctph_index, only the ones
+ * sharing a substring of CTPH_INDEX_GRAM_LENGTH characters. With a SimHash
+ * radius, the pairs are searched in a multi-index instead of being scored.
+ * With nb_shards > 1, only the tiles (or the groups of files with an index)
+ * of the shard are scored : their numbers only depend on the database and the
+ * options, the shards of a database hold each pair once.
+ * With cascade, the CTPH pairs are only scored if both files have SimHash
+ * values within simhash_radius bits, searched in a multi-index : the costly
+ * CTPH edit distances of the unrelated files are skipped.
+ * Return NULL if problems.
+ */
+compare_result_t *compare_all(const sig_db_t *db, compare_algorithm_e algo,
+                              const compare_options_t *options);
+
+/*
+ * Score each query against each file of the database, never the files of the
+ * database with each other. The matches of the query q are in the list q of
+ * the result, their index being the one of the file in the database. The
+ * options are applied as with compare_all(), the indexes being built on the
+ * database only.
+ * Return NULL if problems.
+ */
+compare_result_t *compare_query(const sig_db_t *queries, const sig_db_t *db,
+                                compare_algorithm_e algo,
+                                const compare_options_t *options);
+
+/*
+ * Signatures of a database parsed and indexed once for an algorithm and its
+ * options, to compare queries with it many times
+ * (forward declaration to hide the implementation)
+ */
+typedef struct _compare_index_t compare_index_t;
+
+/*
+ * Parse and index the database as compare_query() would. The database is not
+ * copied and must be kept.
+ * Return NULL if problems.
+ */
+compare_index_t *compare_index_new(const sig_db_t *db,
+                                   compare_algorithm_e algo,
+                                   const compare_options_t *options);
+
+/*
+ * Same as compare_query() with the database of the index. The index is only
+ * read : queries can be compared in several threads at once.
+ * Return NULL if problems.
+ */
+compare_result_t *compare_index_query(const compare_index_t *index,
+                                      const sig_db_t *queries);
+
+void compare_index_free(compare_index_t *index);
+
+/*
+ * SimHash score of the file i of db_1 and the file j of db_2, 0 if they can't
+ * be compared
+ */
+float compare_simhash_score(const sig_db_t *db_1, uint64_t i,
+                            const sig_db_t *db_2, uint64_t j);
+
+/* Result without matches for nb_files files, NULL if problems */
+compare_result_t *compare_result_new(uint64_t nb_files);
+
+/*
+ * Add a match to the list i of the result, keeping the top best ones if
+ * top > 0 : the lists must be sorted once all are added.
+ * Return false if problems.
+ */
+bool compare_result_add(compare_result_t *result, uint64_t i, uint64_t index,
+                        float score, uint64_t top);
+
+/* Sort the lists of the result : decreasing score, then increasing index */
+void compare_result_sort(compare_result_t *result);
+
+void compare_result_free(compare_result_t *result);
+
+#endif
\ No newline at end of file
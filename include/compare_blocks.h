@@ -0,0 +1,54 @@
+#ifndef COMPARE_BLOCKS_H
+#define COMPARE_BLOCKS_H
+
+#include <stdint.h>
+
+#include "compare.h"
+#include "sig_db.h"
+
+/* Smallest block of files */
+#define COMPARE_BLOCKS_MIN_SIZE 64
+
+/*
+ * Comparision of a database by blocks of files, within a memory budget : each
+ * block is compared with itself and with the next ones, only two blocks being
+ * in memory at once. The matches of each file are spilled to disk, then read
+ * back block by block.
+ * (forward declaration to hide the implementation)
+ */
+typedef struct _compare_blocks_t compare_blocks_t;
+
+/*
+ * Number of files of the blocks to compare nb_files files within mem_limit
+ * bytes, 0 if even COMPARE_BLOCKS_MIN_SIZE files don't fit or if options->top
+ * is 0 : the matches of a file read back are only bounded by the top
+ */
+uint64_t compare_blocks_size(uint64_t nb_files,
+                             const compare_options_t *options,
+                             uint64_t mem_limit);
+
+/*
+ * Score each pair of files of the database once, by blocks of block_size
+ * files. The database should be mapped : its signatures are then only read
+ * from the disk when compared.
+ * Return NULL if problems
+ */
+compare_blocks_t *compare_blocks_new(const sig_db_t *db,
+                                     compare_algorithm_e algo,
+                                     const compare_options_t *options,
+                                     uint64_t block_size);
+
+/* Number of blocks, of block_size files except the last one */
+uint64_t compare_blocks_count(const compare_blocks_t *blocks);
+
+/*
+ * Matches of the files of the block b, the same as compare_all() : the list
+ * k is the one of the file b * block_size + k, the indexes are the ones of
+ * the database.
+ * Return NULL if problems
+ */
+compare_result_t *compare_blocks_result(compare_blocks_t *blocks, uint64_t b);
+
+void compare_blocks_free(compare_blocks_t *blocks);
+
+#endif
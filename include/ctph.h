@@ -4,6 +4,27 @@
 #include "elf_manager.h"
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define CTPH_SIGN_LENGTH 64 /* Longest part of a signature */
+
+/*
+ * Prefix of the signatures, naming their rolling hash : the signatures of tbt
+ * 1.0, without prefix, have other trigger points and can't be compared
+ */
+#define CTPH_TAG "roll"
+
+/*
+ * Signature "roll:<block size>:<part 1>:<part 2>" parsed once for
+ * ctph_compare_digest(), the sequences of more than 3 identical characters
+ * being shortened
+ */
+typedef struct {
+    uint64_t block_size;
+    uint8_t length[2];
+    char part[2][CTPH_SIGN_LENGTH]; /* Not ending with '\0' */
+} ctph_digest_t;
 
 /* Return the hash of the ELF data in Base64 */
 char *ctph_hash(elf_data data);
@@ -11,4 +32,19 @@ char *ctph_hash(elf_data data);
 /* Return a score of matching between two strings */
 int ctph_compare(const char *str1, const char *str2);
 
+/* Same as ctph_compare(), 0 as soon as min_score can't be reached */
+int ctph_compare_min(const char *str1, const char *str2, int min_score);
+
+/* Parse the string of a signature, return false if malformed or untagged */
+bool ctph_digest_parse(const char *str, ctph_digest_t *digest);
+
+/* Fill the digest with the fields of a signature, return false if too long */
+bool ctph_digest_init(ctph_digest_t *digest, uint64_t block_size,
+                      const char *part_1, size_t len_1, const char *part_2,
+                      size_t len_2);
+
+/* Same as ctph_compare_min(), without any parsing nor allocation */
+int ctph_compare_digest(const ctph_digest_t *digest1,
+                        const ctph_digest_t *digest2, int min_score);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,49 @@
+#ifndef CTPH_INDEX_H
+#define CTPH_INDEX_H
+
+#include <stdint.h>
+
+#include "ctph.h"
+
+/* Length of the substrings indexed */
+#define CTPH_INDEX_GRAM_LENGTH 7
+
+/*
+ * Inverted index from the substrings of CTPH_INDEX_GRAM_LENGTH characters of
+ * digests, with the block size they are at, to the ids of the digests
+ * (forward declaration to hide the implementation)
+ */
+typedef struct _ctph_index_t ctph_index_t;
+
+/*
+ * Index the digests[ids[k]] for k < nb_ids, the ids being lower than
+ * nb_digests
+ * Return NULL if problems
+ */
+ctph_index_t *ctph_index_new(const ctph_digest_t digests[], uint64_t nb_digests,
+                             const uint64_t ids[], uint64_t nb_ids);
+
+void ctph_index_free(ctph_index_t *index);
+
+/*
+ * Write in candidates the indexed ids j > id sharing a substring with id at a
+ * block size they are compared at, each one once. A few more ids may be
+ * written, the substrings being hashed.
+ * seen holds nb_digests values, 0 at first, and is kept between the calls.
+ * Return the number of candidates.
+ */
+uint64_t ctph_index_candidates(const ctph_index_t *index, uint64_t id,
+                               uint64_t seen[], uint64_t candidates[]);
+
+/*
+ * Write in candidates the indexed ids sharing a substring with a digest which
+ * may not be indexed, each one once. seen is used as with
+ * ctph_index_candidates(), with stamp instead of id + 1 : stamp must be
+ * different for each digest and from the ids + 1 given there.
+ * Return the number of candidates.
+ */
+uint64_t ctph_index_lookup(const ctph_index_t *index,
+                           const ctph_digest_t *digest, uint64_t stamp,
+                           uint64_t seen[], uint64_t candidates[]);
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include <stdbool.h>
+
+#include "compare.h"
+#include "sig_store.h"
+
+/* Longest request, longer ones being answered by "ERR request too long" */
+#define DAEMON_MAX_REQUEST_LENGTH 4096
+/* Clients served at once, the next ones answered by "ERR too many clients" */
+#define DAEMON_MAX_CLIENTS 64
+
+/*
+ * Fuzzy hashes of the file path, the strings being freed by the caller, NULL
+ * if not computed.
+ * Return false if problems
+ */
+typedef bool (*daemon_hash_f)(char *path, char **name, char **ctph,
+                              char **simhash);
+
+/* What the daemon serves */
+typedef struct {
+    const char *socket_path;
+    sig_store_t *store;
+    bool algorithms[COMPARE_END]; /* Compared by the QUERY requests */
+    bool cascade;                 /* Only CTPH, with the SimHash score */
+    daemon_hash_f hash;
+} daemon_config_t;
+
+/*
+ * Answer the requests of the clients of the Unix domain socket, each one
+ * served by its own thread, until SIGINT or SIGTERM. Each request is a line,
+ * answered by lines ending with "OK" or "ERR message" :
+ *   HASH PATH      the hashes of the file, as written by tbt
+ *   INSERT PATH    add the file to the store, answered by "OK index"
+ *   QUERY PATH     the matches of the file with the store, as tbt -q
+ *   COUNT          the number of files of the store, answered by "OK count"
+ * Return false if problems
+ */
+bool daemon_run(const daemon_config_t *config);
+
+#endif
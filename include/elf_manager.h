@@ -32,6 +32,7 @@ extern char *SECTION_NAME[SECTION_END];
 
 bool elf_check_header(FILE *fd);
 elf_data elf_get_data(FILE *elf_fd);
+elf_data elf_map_data(FILE *elf_fd);
 void elf_free(elf_data data);
 void elf_print_section(section_data data, section_e section);
 void elf_print_data(elf_data data);
@@ -634,29 +634,40 @@ char *getstr(Fhdr *fp, uint32_t i)
 }
 
 /*
- * Read ELF Section Headers
+ * Find ELF Section Header (offset and size are left in fp)
  */
-uint8_t *readelfsect(FILE *f, char *name, Fhdr *fp)
+static int findelfsect(FILE *f, char *name, Fhdr *fp)
 {
     unsigned int i;
     char *n;
 
     if (fseek(f, fp->shoff, SEEK_SET) < 0)
-        return NULL;
+        return -1;
 
     for (i = 0; i < fp->shnum; i++) {
         if (fp->readelfshdr(f, fp) < 0)
-            return NULL;
+            return -1;
         n = getstr(fp, fp->name);
         if (n == NULL)
-            return NULL;
+            return -1;
         if (strcmp(n, name) == 0)
-            return newsection(f, fp->offset, fp->size);
+            return 0;
     }
 
     // fprintf(stderr, "section %s not found\n", name);
 
-    return NULL;
+    return -1;
+}
+
+/*
+ * Read ELF Section Headers
+ */
+uint8_t *readelfsect(FILE *f, char *name, Fhdr *fp)
+{
+    if (findelfsect(f, name, fp) < 0)
+        return NULL;
+
+    return newsection(f, fp->offset, fp->size);
 }
 
 /*
@@ -711,6 +722,90 @@ uint8_t *readelfsection(FILE *f, char *name, uint64_t *size, Fhdr *fp)
     return sect;
 }
 
+/*
+ * Unpack ELF Section Header (name, offset and size are left in fp)
+ */
+static int unpackelfshdr(uint8_t *buf, int len, Fhdr *fp)
+{
+    Elf32_Shdr sh32;
+    Elf64_Shdr sh64;
+
+    if (fp->class == ELFCLASS32) {
+        if (unpackelf32shdr(buf, len, &sh32, fp) < 0)
+            return -1;
+        fp->name = sh32.name;
+        fp->offset = sh32.offset;
+        fp->size = sh32.size;
+    } else {
+        if (unpackelf64shdr(buf, len, &sh64, fp) < 0)
+            return -1;
+        fp->name = sh64.name;
+        fp->offset = sh64.offset;
+        fp->size = sh64.size;
+    }
+
+    return 0;
+}
+
+/*
+ * Locate several ELF Sections without reading them.
+ * The identification, the header, the String Table and the Section Headers
+ * are read only once, and all the names are looked up in a single pass.
+ * Sections not found are left with a null size.
+ */
+int readelfsects(FILE *f, char **names, int n, Sect *sects, Fhdr *fp)
+{
+    uint8_t *shdrs, *p;
+    unsigned int i;
+    int j, found;
+    char *name;
+
+    memset(fp, 0, sizeof(*fp));
+
+    for (j = 0; j < n; j++) {
+        sects[j].offset = 0;
+        sects[j].size = 0;
+    }
+
+    if (readident(f, fp) < 0)
+        return -1;
+
+    if (fp->readelfehdr(f, fp) < 0)
+        return -1;
+
+    if (readelfstrndx(f, fp) < 0)
+        return -1;
+
+    if (fp->shnum == 0)
+        return 0;
+
+    shdrs = newsection(f, fp->shoff, (uint64_t) fp->shnum * fp->shentsize);
+    if (shdrs == NULL)
+        return -1;
+
+    found = 0;
+    for (i = 0, p = shdrs; i < fp->shnum && found < n;
+         i++, p += fp->shentsize) {
+        if (unpackelfshdr(p, fp->shentsize, fp) < 0)
+            break;
+        name = getstr(fp, fp->name);
+        if (name == NULL)
+            break;
+        for (j = 0; j < n; j++) {
+            if (sects[j].size != 0 || strcmp(name, names[j]) != 0)
+                continue;
+            sects[j].offset = fp->offset;
+            sects[j].size = fp->size;
+            found++;
+            break;
+        }
+    }
+
+    free(shdrs);
+
+    return 0;
+}
+
 void freeelf(Fhdr *fp)
 {
     if (fp->strndx != NULL)
@@ -1,4 +1,5 @@
 typedef struct Fhdr Fhdr;
+typedef struct Sect Sect;
 
 /*
  * Portable ELF file header
@@ -47,9 +48,18 @@ struct Fhdr {
 	uint8_t		*strndx;	/* Copy of String Table */
 };
 
+/*
+ * Location of an ELF section in the file
+ */
+struct Sect {
+	uint64_t	offset;
+	uint64_t	size;
+};
+
 /* Read */
 int readelf(FILE*, Fhdr*);
 uint8_t* readelfsection(FILE*, char*, uint64_t*, Fhdr*);
+int readelfsects(FILE*, char**, int, Sect*, Fhdr*);
 void freeelf(Fhdr*);
 
 /* Print */
@@ -0,0 +1,74 @@
+#ifndef SHARD_H
+#define SHARD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "compare.h"
+
+/*
+ * Text file holding the matches of a shard of a comparision, to merge the
+ * shards computed by several processes or machines:
+ * - a header "TBTSHARD <version> <shard> <nb_shards> <nb_files> <fingerprint>
+ *   <top> <min_score> <ctph_index> <simhash_radius> <cascade>", the fingerprint
+ *   of the database in hexadecimal and the options of the comparision
+ * - a section per algorithm "<name> <nb_matches>", followed by a line
+ *   "<file> <other file> <score>" per match
+ * The scores are written exactly, the merged result is the same as the
+ * comparision of the whole database with the same options.
+ */
+
+#define SHARD_MAGIC "TBTSHARD"
+#define SHARD_VERSION 2
+/* Longest name of a section */
+#define SHARD_NAME_LENGTH 15
+
+/* Header of a shard file */
+typedef struct {
+    uint64_t shard; /* Lower than nb_shards */
+    uint64_t nb_shards;
+    uint64_t nb_files;    /* Of the database compared */
+    uint64_t fingerprint; /* Of the database compared, see shard_fingerprint */
+
+    /* Options of the comparision, see compare_options_t */
+    uint64_t top;
+    float min_score;
+    bool ctph_index;
+    int simhash_radius;
+    bool cascade;
+} shard_header_t;
+
+/*
+ * Hash of the names and the signatures of the database : the same for its
+ * text and binary forms, another one as soon as a file or a signature changes
+ */
+uint64_t shard_fingerprint(const sig_db_t *db);
+
+/* Check if the comparisions of both shards had the same options */
+bool shard_same_options(const shard_header_t *header_1,
+                        const shard_header_t *header_2);
+
+/* Return false if problems */
+bool shard_write_header(FILE *out, const shard_header_t *header);
+
+/* Return false if problems, or if in doesn't start with a valid header */
+bool shard_read_header(FILE *in, shard_header_t *header);
+
+/*
+ * Write the matches of the lists of the result in a section name.
+ * Return false if problems.
+ */
+bool shard_write_matches(FILE *out, const char *name,
+                         const compare_result_t *result);
+
+/*
+ * Read the next section of in, which must be name, and add its matches
+ * scoring at least min_score to the lists of the result, keeping the top best
+ * ones if top > 0. The lists must be sorted once all the shards are read.
+ * Return false if problems, or if the section is invalid.
+ */
+bool shard_read_matches(FILE *in, const char *name, compare_result_t *result,
+                        float min_score, uint64_t top);
+
+#endif
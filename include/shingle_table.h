@@ -73,4 +73,12 @@ uint8_t shingle_table_insert(shingle_table_t *table, shingle_t shingle);
  */
 uint8_t shingle_table_remove_first(shingle_table_t *table, shingle_t *shingle);
 
+/*
+ * Get the next shingle of the table without removing it, from the position
+ * *index (0 for the first one), and move *index after it.
+ * Return false if there is no shingle left.
+ */
+bool shingle_table_next(shingle_table_t *table, uint64_t *index,
+                        shingle_t *shingle);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,137 @@
+#ifndef SIG_DB_H
+#define SIG_DB_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "ctph.h"
+#include "simhash.h"
+
+/*
+ * Binary signature database, in the byte order of the host:
+ * - a header, with its byte order mark
+ * - an entry per file
+ * - the SimHash value of each entry
+ * - the CTPH block size and signatures of each entry (if any)
+ * - the pool of the file names, ending with '\0'
+ * Each part starts on 8 bytes.
+ */
+
+#define SIG_DB_MAGIC "TBTSIGDB"
+#define SIG_DB_MAGIC_LENGTH 8
+#define SIG_DB_VERSION 2
+/* Read as SIG_DB_BYTE_ORDER_SWAPPED on a host of the other byte order */
+#define SIG_DB_BYTE_ORDER 0xfeff
+#define SIG_DB_BYTE_ORDER_SWAPPED 0xfffe
+
+/* Signatures present in an entry */
+#define SIG_DB_CTPH 1
+#define SIG_DB_SIMHASH 2
+
+/*
+ * Longest CTPH signature, and string "roll:<block size>:<sign 1>:<sign 2>", the
+ * tag being checked but not stored
+ */
+#define SIG_DB_CTPH_LENGTH 64
+#define SIG_DB_CTPH_MAX_LENGTH \
+    (sizeof(CTPH_TAG) + 10 + 2 * (SIG_DB_CTPH_LENGTH + 1))
+
+/* Header of the file */
+typedef struct {
+    char magic[SIG_DB_MAGIC_LENGTH];
+    uint16_t version;
+    uint16_t byte_order; /* SIG_DB_BYTE_ORDER in the byte order of the file */
+    uint32_t flags;      /* Signatures present in at least one entry */
+    uint64_t nb_entries;
+    uint64_t entries_offset;
+    uint64_t simhash_offset;
+    uint64_t ctph_offset; /* 0 if no entry has CTPH */
+    uint64_t names_offset;
+    uint64_t names_size;
+} sig_db_header_t;
+
+/* File of the database */
+typedef struct {
+    uint64_t name_offset; /* In the pool of names */
+    uint32_t name_length;
+    uint8_t flags;        /* Signatures present */
+    uint8_t shingle_hash; /* Of the SimHash */
+    uint16_t reserved;
+} sig_db_entry_t;
+
+/* CTPH signature split in its fields */
+typedef struct {
+    uint32_t block_size;
+    uint8_t length[2];
+    uint16_t reserved;
+    char signature[2][SIG_DB_CTPH_LENGTH]; /* Not ending with '\0' */
+} sig_db_ctph_t;
+
+/* Signatures being built, or mapped from a file (read only) */
+typedef struct {
+    uint32_t flags;
+    uint64_t nb_entries;
+    sig_db_entry_t *entries;
+    uint8_t (*simhash)[SIMHASH_SIZE];
+    sig_db_ctph_t *ctph; /* May be NULL if no entry has CTPH */
+    char *names;
+    uint64_t names_size;
+
+    /* Storage */
+    uint64_t capacity;       /* Of the entries when built */
+    uint64_t names_capacity; /* Of the pool of names */
+    void *map;               /* Mapping of the file, NULL if built */
+    uint64_t map_len;
+} sig_db_t;
+
+/* Create an empty database to fill with sig_db_add() */
+sig_db_t *sig_db_new(void);
+
+/*
+ * Add the signature strings of a file, NULL or "" if not computed
+ * Return false if problems, malformed signatures are not kept
+ */
+bool sig_db_add(sig_db_t *db, const char *name, const char *ctph,
+                const char *simhash);
+
+/*
+ * Add a copy of the entry i of another database, with its signatures
+ * Return false if problems
+ */
+bool sig_db_append(sig_db_t *db, const sig_db_t *other, uint64_t i);
+
+/*
+ * Set the CTPH or the SimHash string of the entry i of a database being built
+ * Return false if problems or malformed, the entry has then no such signature
+ */
+bool sig_db_set_ctph(sig_db_t *db, uint64_t i, const char *ctph);
+bool sig_db_set_simhash(sig_db_t *db, uint64_t i, const char *simhash);
+
+/* Write the database in out, return false if problems */
+bool sig_db_write(sig_db_t *db, FILE *out);
+
+/* Check if the file starts like a database */
+bool sig_db_is_file(const char *path);
+
+/* Map a database file in memory, NULL if problems or invalid */
+sig_db_t *sig_db_map(const char *path);
+
+void sig_db_free(sig_db_t *db);
+
+/*
+ * Make view the entries [first, end) of the database, without copying them.
+ * The view is read only, valid as long as db, and must not be freed.
+ * Return false if problems
+ */
+bool sig_db_view(const sig_db_t *db, uint64_t first, uint64_t end,
+                 sig_db_t *view);
+
+/* Return the name of the entry i */
+const char *sig_db_get_name(const sig_db_t *db, uint64_t i);
+
+/* Write the CTPH string of the entry i, return false if it has none */
+bool sig_db_get_ctph(const sig_db_t *db, uint64_t i,
+                     char ctph[SIG_DB_CTPH_MAX_LENGTH + 1]);
+
+#endif
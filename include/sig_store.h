@@ -0,0 +1,64 @@
+#ifndef SIG_STORE_H
+#define SIG_STORE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "compare.h"
+#include "sig_db.h"
+
+/* Files added before they are indexed together */
+#define SIG_STORE_SEGMENT_SIZE 1024
+
+/*
+ * Signatures kept in memory with their indexes, to compare queries with them
+ * while files are added. The files added go to a small segment compared
+ * without index, indexed once full. The segments of the same size are then
+ * merged : there are a few segments, whatever the number of files added.
+ * The files keep their index in the store, in the order they are added.
+ * Every function can be called by several threads at once : the segments are
+ * indexed and merged by a thread of the store, outside the lock, the files
+ * being added and the queries going on meanwhile.
+ * (forward declaration to hide the implementation)
+ */
+typedef struct _sig_store_t sig_store_t;
+
+/*
+ * Store the files of db, indexed for each algorithm with the options. The
+ * store takes db, freed by sig_store_free().
+ * Return NULL if problems
+ */
+sig_store_t *sig_store_new(sig_db_t *db, const compare_options_t *options);
+
+void sig_store_free(sig_store_t *store);
+
+/* Number of files of the store */
+uint64_t sig_store_count(sig_store_t *store);
+
+/*
+ * Add the signature strings of a file, NULL if not computed, as
+ * sig_db_add().
+ * Return the index of the file in the store, UINT64_MAX if problems
+ */
+uint64_t sig_store_add(sig_store_t *store, const char *name,
+                       const char *ctph, const char *simhash);
+
+/*
+ * Same as compare_query() with the files of the store, their indexes being
+ * the ones of the store.
+ * Return NULL if problems.
+ */
+compare_result_t *sig_store_query(sig_store_t *store, const sig_db_t *queries,
+                                  compare_algorithm_e algo);
+
+/* Copy of the name of the file i, to free. NULL if problems */
+char *sig_store_get_name(sig_store_t *store, uint64_t i);
+
+/*
+ * SimHash score of the query q with the file i of the store, as
+ * compare_simhash_score()
+ */
+float sig_store_simhash_score(sig_store_t *store, const sig_db_t *queries,
+                              uint64_t q, uint64_t i);
+
+#endif
@@ -6,13 +6,72 @@
 
 #include "elf_manager.h"
 
-/* Compute SimHash value of elf data */
-char *simhash_compute(elf_data data);
+/* Hash functions of the shingles */
+/* clang-format off */
+typedef enum
+{
+  SHINGLE_HASH_MD5,
+  SHINGLE_HASH_WY,
+  SHINGLE_HASH_END
+} shingle_hash_e;
+/* clang-format on */
+
+/* Names of the shingle hash functions, as written before the SimHash value */
+extern char *SHINGLE_HASH_NAME[SHINGLE_HASH_END];
+
+/* Size in bytes of a SimHash value */
+#define SIMHASH_SIZE 16
+
+/* Longest SimHash string : "<shingle hash name>:<32 hex digits>" */
+#define SIMHASH_MAX_LENGTH 40
+
+/* Return the shingle hash function named name, SHINGLE_HASH_END if none */
+shingle_hash_e simhash_get_shingle_hash(const char *name);
+
+/*
+ * Compute SimHash value of elf data, the shingles being hashed with
+ * shingle_hash
+ */
+char *simhash_compute(elf_data data, shingle_hash_e shingle_hash);
 
 /*
  * Return the percentage of similarity betwwen the two hash
  * Using hamming distance
+ * Hashes computed with different shingle hash functions are not comparable : 0
  */
 float simhash_compare(char *hash_1, char *hash_2);
 
+/*
+ * Read a SimHash string in its shingle hash function and its value
+ * Return false if the string is malformed
+ */
+bool simhash_decode(const char *hash, shingle_hash_e *shingle_hash,
+                    uint8_t value[SIMHASH_SIZE]);
+
+/* Same as simhash_compare() with values of the same shingle hash function */
+float simhash_compare_values(const uint8_t value_1[SIMHASH_SIZE],
+                             const uint8_t value_2[SIMHASH_SIZE]);
+
+/*
+ * Hamming distance between two values, counting stops once it is over
+ * max_distance
+ */
+uint32_t simhash_distance(const uint8_t value_1[SIMHASH_SIZE],
+                          const uint8_t value_2[SIMHASH_SIZE],
+                          uint32_t max_distance);
+
+/*
+ * Hamming distances between query and each of the nb_values values following
+ * each other, counted several at once (AVX-512 when available)
+ */
+void simhash_distances(const uint8_t query[SIMHASH_SIZE],
+                       const uint8_t values[][SIMHASH_SIZE], uint64_t nb_values,
+                       uint32_t distances[]);
+
+/* Percentage of similarity of a Hamming distance, as simhash_compare() */
+float simhash_distance_score(uint32_t distance);
+
+/* Largest Hamming distance scoring at least min_score */
+uint32_t simhash_max_distance(float min_score);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,44 @@
+#ifndef SIMHASH_INDEX_H
+#define SIMHASH_INDEX_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "simhash.h"
+
+/*
+ * Multi-index hashing of SimHash values : the values are split in radius + 1
+ * chunks, each chunk having its own table. Two values within radius bits have
+ * a chunk in common, only the values found so are compared. Large radiuses
+ * fall back to a scan of the values.
+ * (forward declaration to hide the implementation)
+ */
+typedef struct _simhash_index_t simhash_index_t;
+
+/*
+ * Index the values[ids[k]] for k < nb_ids, the ids being lower than
+ * nb_values, to search the ones within radius bits. The values are not
+ * copied and must be kept.
+ * Return NULL if problems
+ */
+simhash_index_t *simhash_index_new(const uint8_t values[][SIMHASH_SIZE],
+                                   uint64_t nb_values, const uint64_t ids[],
+                                   uint64_t nb_ids, uint32_t radius);
+
+void simhash_index_free(simhash_index_t *index);
+
+/* Check if the index only scans the values, the radius being too large */
+bool simhash_index_scans(const simhash_index_t *index);
+
+/*
+ * Write in neighbors the indexed ids j >= first_id whose value is within the
+ * radius of value, each one once, and their distances in distances.
+ * Both hold nb_ids values.
+ * Return the number of neighbors.
+ */
+uint64_t simhash_index_neighbors(const simhash_index_t *index,
+                                 const uint8_t value[SIMHASH_SIZE],
+                                 uint64_t first_id, uint64_t neighbors[],
+                                 uint32_t distances[]);
+
+#endif
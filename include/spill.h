@@ -0,0 +1,46 @@
+#ifndef SPILL_H
+#define SPILL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Records buffered in memory for each partition before being written */
+#define SPILL_CHUNK_SIZE 256
+
+/* Match of a file spilled to disk */
+typedef struct {
+    uint64_t file;
+    uint64_t index; /* Of the other file */
+    float score;
+} spill_record_t;
+
+/*
+ * Records spilled to a temporary file, by partition : each partition is
+ * written by chunks of SPILL_CHUNK_SIZE records, and read back chunk by chunk.
+ * Only one chunk per partition stays in memory.
+ * (forward declaration to hide the implementation)
+ */
+typedef struct _spill_t spill_t;
+
+/* Return NULL if problems */
+spill_t *spill_new(uint64_t nb_partitions);
+
+void spill_free(spill_t *spill);
+
+/* Memory used by a spill of nb_partitions, without its file */
+uint64_t spill_memory(uint64_t nb_partitions);
+
+/* Add a record to a partition, return false if problems */
+bool spill_add(spill_t *spill, uint64_t partition,
+               const spill_record_t *record);
+
+/*
+ * Write in records the chunk of the partition, the chunks being numbered from
+ * 0 in the order they were added.
+ * Return the number of records, 0 after the last chunk, UINT64_MAX if
+ * problems.
+ */
+uint64_t spill_read(spill_t *spill, uint64_t partition, uint64_t chunk,
+                    spill_record_t records[SPILL_CHUNK_SIZE]);
+
+#endif
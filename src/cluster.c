@@ -0,0 +1,168 @@
+#include "cluster.h"
+
+#include <stdlib.h>
+
+/* Component of the union-find, to number the clusters */
+typedef struct {
+    uint64_t root;
+    uint64_t size;
+    uint64_t first_file;
+} cluster_component_t;
+
+/* Static Functions */
+
+/* Root of the file i, halving the path to it */
+static uint64_t find_root(uint64_t parent[], uint64_t i)
+{
+    while (parent[i] != i) {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+/* Merge the components of the files i and j, the smaller one below */
+static void merge(uint64_t parent[], uint64_t size[], uint64_t i, uint64_t j)
+{
+    i = find_root(parent, i);
+    j = find_root(parent, j);
+    if (i == j)
+        return;
+
+    if (size[i] < size[j]) {
+        uint64_t tmp = i;
+        i = j;
+        j = tmp;
+    }
+    parent[j] = i;
+    size[i] += size[j];
+}
+
+/* Order of the clusters : decreasing size, then increasing first file */
+static int compare_component(const void *component_1, const void *component_2)
+{
+    const cluster_component_t *c1 = component_1, *c2 = component_2;
+    if (c1->size != c2->size)
+        return (c1->size > c2->size) ? -1 : 1;
+    if (c1->first_file != c2->first_file)
+        return (c1->first_file < c2->first_file) ? -1 : 1;
+    return 0;
+}
+
+/* External functions */
+
+cluster_result_t *cluster_new(const compare_result_t *result, float threshold)
+{
+    if (result == NULL)
+        return NULL;
+
+    uint64_t n = result->nb_files;
+    cluster_result_t *clusters = calloc(1, sizeof(cluster_result_t));
+    if (clusters == NULL)
+        return NULL;
+    clusters->nb_files = n;
+
+    uint64_t *parent = malloc(sizeof(uint64_t) * (n + 1));
+    uint64_t *size = malloc(sizeof(uint64_t) * (n + 1));
+    double *weights = calloc(n + 1, sizeof(double));
+    cluster_component_t *components =
+        malloc(sizeof(cluster_component_t) * (n + 1));
+    clusters->cluster = malloc(sizeof(uint64_t) * (n + 1));
+    clusters->files = malloc(sizeof(uint64_t) * (n + 1));
+    if (parent == NULL || size == NULL || weights == NULL ||
+        components == NULL || clusters->cluster == NULL ||
+        clusters->files == NULL)
+        goto err_clusters;
+
+    for (uint64_t i = 0; i < n; i++) {
+        parent[i] = i;
+        size[i] = 1;
+    }
+
+    for (uint64_t i = 0; i < n; i++) {
+        const compare_list_t *list = &result->lists[i];
+        for (uint64_t k = 0; k < list->nb_matches; k++) {
+            const compare_match_t *match = &list->matches[k];
+            if (match->score < threshold || match->index >= n)
+                continue;
+
+            merge(parent, size, i, match->index);
+            weights[i] += match->score;
+        }
+    }
+
+    /* Components in the order of their first file, then by size */
+    for (uint64_t i = 0; i < n; i++)
+        clusters->cluster[i] = UINT64_MAX;
+    for (uint64_t i = 0; i < n; i++) {
+        uint64_t root = find_root(parent, i);
+        if (clusters->cluster[root] != UINT64_MAX)
+            continue;
+
+        clusters->cluster[root] = clusters->nb_clusters;
+        components[clusters->nb_clusters++] = (cluster_component_t){
+            .root = root, .size = size[root], .first_file = i};
+    }
+    qsort(components, clusters->nb_clusters, sizeof(cluster_component_t),
+          compare_component);
+
+    clusters->first = calloc(clusters->nb_clusters + 2, sizeof(uint64_t));
+    clusters->medoids = malloc(sizeof(uint64_t) * (clusters->nb_clusters + 1));
+    if (clusters->first == NULL || clusters->medoids == NULL)
+        goto err_clusters;
+
+    /* size[root] is now the cluster of the component */
+    for (uint64_t c = 0; c < clusters->nb_clusters; c++) {
+        size[components[c].root] = c;
+        clusters->first[c + 1] = clusters->first[c] + components[c].size;
+        clusters->medoids[c] = components[c].first_file;
+    }
+
+    for (uint64_t i = 0; i < n; i++)
+        clusters->cluster[i] = size[find_root(parent, i)];
+
+    /* parent[c] is now the next position of the cluster c while filling */
+    for (uint64_t c = 0; c < clusters->nb_clusters; c++)
+        parent[c] = clusters->first[c];
+
+    for (uint64_t i = 0; i < n; i++) {
+        uint64_t c = clusters->cluster[i];
+        clusters->files[parent[c]++] = i;
+
+        if (weights[i] > weights[clusters->medoids[c]])
+            clusters->medoids[c] = i;
+    }
+
+    free(parent);
+    free(size);
+    free(weights);
+    free(components);
+    return clusters;
+
+err_clusters:
+    free(parent);
+    free(size);
+    free(weights);
+    free(components);
+    cluster_free(clusters);
+    return NULL;
+}
+
+uint64_t cluster_size(const cluster_result_t *clusters, uint64_t c)
+{
+    if (clusters == NULL || c >= clusters->nb_clusters)
+        return 0;
+    return clusters->first[c + 1] - clusters->first[c];
+}
+
+void cluster_free(cluster_result_t *clusters)
+{
+    if (clusters == NULL)
+        return;
+
+    free(clusters->cluster);
+    free(clusters->first);
+    free(clusters->files);
+    free(clusters->medoids);
+    free(clusters);
+}
@@ -0,0 +1,1204 @@
+#include "compare.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+#include <pthread.h>
+
+#include "ctph.h"
+#include "ctph_index.h"
+#include "simhash.h"
+#include "simhash_index.h"
+
+#define COMPARE_DEFAULT_CAPACITY 16
+/* Files per side of a tile : the signatures of a tile stay in the caches */
+#define COMPARE_TILE_SIZE 256
+/* Pairs kept by a worker before adding them to the lists */
+#define COMPARE_FLUSH_SIZE 65536
+
+#ifndef MIN
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#endif
+
+/* Pair of files scored by a worker */
+typedef struct {
+    uint64_t index_1;
+    uint64_t index_2;
+    float score;
+} compare_pair_t;
+
+/*
+ * Files at the positions [row_first, row_end) of the order of the work against
+ * the ones at [column_first, column_end), or against each other if both ranges
+ * are the same
+ */
+typedef struct {
+    uint64_t row_first;
+    uint64_t row_end;
+    uint64_t column_first;
+    uint64_t column_end;
+} compare_region_t;
+
+/* File with its CTPH block size, to sort the files */
+typedef struct {
+    uint64_t block_size;
+    uint64_t index;
+} compare_file_t;
+
+/* Work shared by the threads comparing a database, or queries with it */
+typedef struct {
+    const sig_db_t *db;
+    const sig_db_t *queries;       /* NULL to compare the database itself */
+    ctph_digest_t *query_digests;  /* CTPH of each query, parsed once */
+    uint64_t next_query;           /* Next query to compare */
+    compare_algorithm_e algo;
+    compare_options_t options;
+    ctph_digest_t *digests;        /* CTPH of each file, parsed once */
+    int ctph_min_score;            /* options.min_score for CTPH */
+    uint32_t simhash_max_distance; /* options.min_score for SimHash */
+    uint64_t *order;    /* Files to compare, NULL for all of them in order */
+    uint64_t nb_files;  /* In the order */
+    ctph_index_t *ctph_index;       /* Candidates of the files, if wanted */
+    simhash_index_t *simhash_index; /* Neighbors of the files, if wanted */
+    uint64_t next_file; /* Next file to take the candidates of */
+    compare_region_t *regions; /* Holding every pair to score */
+    uint64_t nb_regions;
+    uint64_t next_region; /* Next tile to score */
+    uint64_t next_row;
+    uint64_t next_column;
+    uint64_t next_tile; /* Number of the next tile, or group of files */
+    compare_result_t *result;
+    uint64_t next_list; /* Next list to sort */
+    pthread_mutex_t lock;
+} compare_work_t;
+
+/* Internal structure (hiden from outside) to represent the index */
+struct _compare_index_t {
+    compare_work_t work; /* Prepared once, copied by each comparision */
+};
+
+/* A thread comparing a database, with its own pairs */
+typedef struct {
+    compare_work_t *work;
+    compare_pair_t *pairs;
+    uint64_t nb_pairs;
+    uint64_t capacity;
+    bool error;
+} compare_worker_t;
+
+/* Static Functions */
+
+/* Check if the match m1 comes before m2 : higher score, then lower index */
+static bool is_before(const compare_match_t *m1, const compare_match_t *m2)
+{
+    if (m1->score != m2->score)
+        return m1->score > m2->score;
+    return m1->index < m2->index;
+}
+
+/* Order of the matches : decreasing score, then increasing index */
+static int compare_match(const void *match_1, const void *match_2)
+{
+    if (is_before(match_1, match_2))
+        return -1;
+    return is_before(match_2, match_1) ? 1 : 0;
+}
+
+/* Swap the matches k and l of the list */
+static void swap_matches(compare_list_t *list, uint64_t k, uint64_t l)
+{
+    compare_match_t tmp = list->matches[k];
+    list->matches[k] = list->matches[l];
+    list->matches[l] = tmp;
+}
+
+/*
+ * Add a match to the list. With top > 0, the list is a heap of the top best
+ * matches, the last one of them being first.
+ * Return false if problems.
+ */
+static bool keep_match(compare_list_t *list, uint64_t index, float score,
+                       uint64_t top)
+{
+    compare_match_t match = {.index = index, .score = score};
+
+    /* Heap full : replace the last match if the new one comes before */
+    if (top > 0 && list->nb_matches == top) {
+        if (!is_before(&match, &list->matches[0]))
+            return true;
+
+        list->matches[0] = match;
+        for (uint64_t k = 0;;) {
+            uint64_t last = k, child = 2 * k + 1;
+            for (; child <= 2 * k + 2 && child < top; child++)
+                if (is_before(&list->matches[last], &list->matches[child]))
+                    last = child;
+            if (last == k)
+                break;
+            swap_matches(list, k, last);
+            k = last;
+        }
+        return true;
+    }
+
+    if (list->nb_matches == list->capacity) {
+        uint64_t capacity =
+            list->capacity ? list->capacity * 2 : COMPARE_DEFAULT_CAPACITY;
+        if (top > 0 && capacity > top)
+            capacity = top;
+
+        compare_match_t *matches =
+            realloc(list->matches, sizeof(compare_match_t) * capacity);
+        if (matches == NULL)
+            return false;
+
+        list->matches = matches;
+        list->capacity = capacity;
+    }
+
+    uint64_t k = list->nb_matches++;
+    list->matches[k] = match;
+    while (top > 0 && k > 0 &&
+           is_before(&list->matches[(k - 1) / 2], &list->matches[k])) {
+        swap_matches(list, k, (k - 1) / 2);
+        k = (k - 1) / 2;
+    }
+
+    return true;
+}
+
+/*
+ * CTPH score of two files, the scores under the minimum of the options are 0
+ */
+static float score_ctph(const compare_work_t *work,
+                        const sig_db_entry_t *entry_1,
+                        const ctph_digest_t *digest_1,
+                        const sig_db_entry_t *entry_2,
+                        const ctph_digest_t *digest_2)
+{
+    if (!(entry_1->flags & entry_2->flags & SIG_DB_CTPH))
+        return 0.0;
+
+    return (float) ctph_compare_digest(digest_1, digest_2,
+                                       work->ctph_min_score);
+}
+
+/*
+ * Check if the CTPH of two files are to be scored : with the cascade, their
+ * SimHash values must be within the radius of the options
+ */
+static bool is_candidate(const compare_work_t *work,
+                         const sig_db_entry_t *entry_1,
+                         const uint8_t value_1[SIMHASH_SIZE],
+                         const sig_db_entry_t *entry_2,
+                         const uint8_t value_2[SIMHASH_SIZE])
+{
+    if (!work->options.cascade)
+        return true;
+
+    if (!(entry_1->flags & entry_2->flags & SIG_DB_SIMHASH) ||
+        entry_1->shingle_hash != entry_2->shingle_hash)
+        return false;
+
+    uint32_t radius = work->options.simhash_radius;
+    return work->options.simhash_radius < 0 ||
+           simhash_distance(value_1, value_2, radius) <= radius;
+}
+
+/* CTPH score of the files i and j of the database */
+static float score_pair(const compare_work_t *work, uint64_t i, uint64_t j)
+{
+    const sig_db_t *db = work->db;
+    if (!is_candidate(work, &db->entries[i], db->simhash[i], &db->entries[j],
+                      db->simhash[j]))
+        return 0.0;
+
+    return score_ctph(work, &db->entries[i], &work->digests[i],
+                      &db->entries[j], &work->digests[j]);
+}
+
+/* CTPH score of the query q and the file j of the database */
+static float score_query(const compare_work_t *work, uint64_t q, uint64_t j)
+{
+    const sig_db_t *queries = work->queries, *db = work->db;
+    if (!is_candidate(work, &queries->entries[q], queries->simhash[q],
+                      &db->entries[j], db->simhash[j]))
+        return 0.0;
+
+    return score_ctph(work, &queries->entries[q], &work->query_digests[q],
+                      &db->entries[j], &work->digests[j]);
+}
+
+/*
+ * SimHash score of two files dist bits apart, 0 if they can't be compared or
+ * are too far
+ */
+static float score_simhash(const compare_work_t *work,
+                           const sig_db_entry_t *entry_1,
+                           const sig_db_entry_t *entry_2, uint32_t dist)
+{
+    /* Mixed shingle hash functions can't be compared */
+    if (!(entry_1->flags & entry_2->flags & SIG_DB_SIMHASH) ||
+        entry_1->shingle_hash != entry_2->shingle_hash)
+        return 0.0;
+
+    if (dist > work->simhash_max_distance)
+        return 0.0;
+
+    return simhash_distance_score(dist);
+}
+
+/* Add the pairs of the worker to the lists of both of their files */
+static bool flush_pairs(compare_worker_t *worker)
+{
+    compare_work_t *work = worker->work;
+    uint64_t top = work->options.top;
+    bool ret = true;
+
+    pthread_mutex_lock(&work->lock);
+    for (uint64_t p = 0; p < worker->nb_pairs && ret; p++) {
+        compare_pair_t *pair = &worker->pairs[p];
+        ret = keep_match(&work->result->lists[pair->index_1], pair->index_2,
+                         pair->score, top) &&
+              keep_match(&work->result->lists[pair->index_2], pair->index_1,
+                         pair->score, top);
+    }
+    pthread_mutex_unlock(&work->lock);
+
+    worker->nb_pairs = 0;
+    return ret;
+}
+
+/* Add a pair to the ones of the worker, return false if problems */
+static bool add_pair(compare_worker_t *worker, uint64_t index_1,
+                     uint64_t index_2, float score)
+{
+    if (worker->nb_pairs == COMPARE_FLUSH_SIZE && !flush_pairs(worker))
+        return false;
+
+    if (worker->nb_pairs == worker->capacity) {
+        uint64_t capacity =
+            worker->capacity ? worker->capacity * 2 : COMPARE_DEFAULT_CAPACITY;
+        compare_pair_t *pairs =
+            realloc(worker->pairs, sizeof(compare_pair_t) * capacity);
+        if (pairs == NULL)
+            return false;
+
+        worker->pairs = pairs;
+        worker->capacity = capacity;
+    }
+
+    compare_pair_t *pair = &worker->pairs[worker->nb_pairs++];
+    pair->index_1 = index_1;
+    pair->index_2 = index_2;
+    pair->score = score;
+
+    return true;
+}
+
+/* Score the CTPH of the files i and j, and keep the pair if high enough */
+static bool keep_pair(compare_worker_t *worker, uint64_t i, uint64_t j)
+{
+    const compare_work_t *work = worker->work;
+
+    float score = score_pair(work, i, j);
+    if (score <= 0.0 || score < work->options.min_score)
+        return true;
+
+    return add_pair(worker, i, j, score);
+}
+
+/* Keep the SimHash pair of the files i and j, dist bits apart, if close */
+static bool keep_simhash_pair(compare_worker_t *worker, uint64_t i, uint64_t j,
+                              uint32_t dist)
+{
+    const compare_work_t *work = worker->work;
+
+    float score = score_simhash(work, &work->db->entries[i],
+                                &work->db->entries[j], dist);
+    if (score <= 0.0 || score < work->options.min_score)
+        return true;
+
+    return add_pair(worker, i, j, score);
+}
+
+/*
+ * Score the SimHash pairs of the file i with the files [j_first, j_end), their
+ * distances being counted at once
+ */
+static bool keep_simhash_pairs(compare_worker_t *worker, uint64_t i,
+                               uint64_t j_first, uint64_t j_end)
+{
+    const sig_db_t *db = worker->work->db;
+    uint32_t distances[COMPARE_TILE_SIZE];
+
+    if (!(db->entries[i].flags & SIG_DB_SIMHASH) || j_first >= j_end)
+        return true;
+
+    simhash_distances(db->simhash[i], (const void *) &db->simhash[j_first],
+                      j_end - j_first, distances);
+
+    for (uint64_t j = j_first; j < j_end; j++)
+        if (!keep_simhash_pair(worker, i, j, distances[j - j_first]))
+            return false;
+
+    return true;
+}
+
+/* Check if the tile, or the group of files, is in the shard of the options */
+static bool in_shard(const compare_work_t *work, uint64_t tile)
+{
+    return work->options.nb_shards <= 1 ||
+           tile % work->options.nb_shards == work->options.shard;
+}
+
+/* Number of tiles of the region on the side of its rows, or of its columns */
+static uint64_t nb_tiles(uint64_t first, uint64_t end)
+{
+    return (end - first + COMPARE_TILE_SIZE - 1) / COMPARE_TILE_SIZE;
+}
+
+/*
+ * Number of tiles to score in the region : the upper triangle when the files
+ * are compared with each other
+ */
+static uint64_t region_nb_tiles(const compare_region_t *region)
+{
+    uint64_t rows = nb_tiles(region->row_first, region->row_end);
+    if (region->row_first == region->column_first)
+        return rows * (rows + 1) / 2;
+    return rows * nb_tiles(region->column_first, region->column_end);
+}
+
+/* Score the pairs of the tile (row, column) of the region */
+static bool score_tile(compare_worker_t *worker,
+                       const compare_region_t *region, uint64_t row,
+                       uint64_t column)
+{
+    const compare_work_t *work = worker->work;
+    bool triangle = region->row_first == region->column_first;
+
+    uint64_t p = region->row_first + row * COMPARE_TILE_SIZE;
+    uint64_t p_end = MIN(p + COMPARE_TILE_SIZE, region->row_end);
+    uint64_t q_first = region->column_first + column * COMPARE_TILE_SIZE;
+    uint64_t q_end = MIN(q_first + COMPARE_TILE_SIZE, region->column_end);
+
+    for (; p < p_end; p++) {
+        uint64_t i = work->order ? work->order[p] : p;
+
+        uint64_t q = (triangle && row == column) ? p + 1 : q_first;
+
+        /* The SimHash files are in order : their values follow each other */
+        if (work->algo == COMPARE_SIMHASH) {
+            if (!keep_simhash_pairs(worker, i, q, q_end))
+                return false;
+            continue;
+        }
+
+        for (; q < q_end; q++)
+            if (!keep_pair(worker, i, work->order ? work->order[q] : q))
+                return false;
+    }
+
+    return true;
+}
+
+/* Score the tiles of the regions until there is none left */
+static void *compare_tiles(void *arg)
+{
+    compare_worker_t *worker = arg;
+    compare_work_t *work = worker->work;
+
+    pthread_mutex_lock(&work->lock);
+    while (work->next_region < work->nb_regions) {
+        const compare_region_t *region = &work->regions[work->next_region];
+        uint64_t row = work->next_row, column = work->next_column++;
+        uint64_t tile = work->next_tile++;
+
+        if (work->next_column ==
+            nb_tiles(region->column_first, region->column_end)) {
+            work->next_row++;
+            work->next_column =
+                (region->row_first == region->column_first) ? work->next_row
+                                                            : 0;
+        }
+        if (work->next_row == nb_tiles(region->row_first, region->row_end)) {
+            work->next_region++;
+            work->next_row = 0;
+            work->next_column = 0;
+        }
+        pthread_mutex_unlock(&work->lock);
+
+        if (in_shard(work, tile) && !worker->error &&
+            !score_tile(worker, region, row, column))
+            worker->error = true;
+
+        pthread_mutex_lock(&work->lock);
+    }
+    pthread_mutex_unlock(&work->lock);
+
+    if (!worker->error && !flush_pairs(worker))
+        worker->error = true;
+
+    return NULL;
+}
+
+/*
+ * Score the file i with its candidates from the index of the work, seen and
+ * candidates holding a value per file, distances too with SimHash
+ */
+static bool keep_candidates(compare_worker_t *worker, uint64_t i,
+                            uint64_t seen[], uint64_t candidates[],
+                            uint32_t distances[])
+{
+    const compare_work_t *work = worker->work;
+
+    if (work->ctph_index != NULL) {
+        uint64_t nb_candidates =
+            ctph_index_candidates(work->ctph_index, i, seen, candidates);
+
+        for (uint64_t k = 0; k < nb_candidates; k++)
+            if (!keep_pair(worker, i, candidates[k]))
+                return false;
+        return true;
+    }
+
+    /* The neighbors after i : each pair once */
+    uint64_t nb_neighbors =
+        simhash_index_neighbors(work->simhash_index, work->db->simhash[i],
+                                i + 1, candidates, distances);
+
+    /* With the cascade, the CTPH of the neighbors are scored */
+    for (uint64_t k = 0; k < nb_neighbors; k++)
+        if (!((work->algo == COMPARE_CTPH)
+                  ? keep_pair(worker, i, candidates[k])
+                  : keep_simhash_pair(worker, i, candidates[k],
+                                      distances[k])))
+            return false;
+    return true;
+}
+
+/* Score the files with their candidates until there is none left */
+static void *compare_candidates(void *arg)
+{
+    compare_worker_t *worker = arg;
+    compare_work_t *work = worker->work;
+    uint64_t nb_entries = work->db->nb_entries;
+
+    uint64_t *candidates = malloc(sizeof(uint64_t) * (nb_entries + 1));
+    uint64_t *seen = NULL;
+    uint32_t *distances = NULL;
+    if (work->ctph_index != NULL)
+        seen = calloc(nb_entries + 1, sizeof(uint64_t));
+    else
+        distances = malloc(sizeof(uint32_t) * (nb_entries + 1));
+    if ((seen == NULL && distances == NULL) || candidates == NULL)
+        worker->error = true;
+
+    pthread_mutex_lock(&work->lock);
+    while (work->next_file < work->nb_files) {
+        uint64_t p = work->next_file;
+        uint64_t p_end = MIN(p + COMPARE_TILE_SIZE, work->nb_files);
+        uint64_t group = work->next_tile++;
+        work->next_file = p_end;
+        pthread_mutex_unlock(&work->lock);
+
+        for (; p < p_end && in_shard(work, group) && !worker->error; p++)
+            if (!keep_candidates(worker, work->order[p], seen, candidates,
+                                 distances))
+                worker->error = true;
+
+        pthread_mutex_lock(&work->lock);
+    }
+    pthread_mutex_unlock(&work->lock);
+
+    free(seen);
+    free(candidates);
+    free(distances);
+
+    if (!worker->error && !flush_pairs(worker))
+        worker->error = true;
+
+    return NULL;
+}
+
+/* Keep the match of the query q with the file j if its score is high enough */
+static bool keep_query_match(compare_worker_t *worker, uint64_t q, uint64_t j,
+                             float score)
+{
+    const compare_work_t *work = worker->work;
+
+    if (score <= 0.0 || score < work->options.min_score)
+        return true;
+
+    /* Each query is compared by a single worker */
+    return keep_match(&work->result->lists[q], j, score, work->options.top);
+}
+
+/* Positions [*first, *end) in the order of the files of the block size */
+static void find_block_size(const compare_work_t *work, uint64_t block_size,
+                            uint64_t *first, uint64_t *end)
+{
+    uint64_t low = 0, high = work->nb_files;
+    while (low < high) {
+        uint64_t mid = low + (high - low) / 2;
+        if (work->digests[work->order[mid]].block_size < block_size)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    *first = low;
+    while (low < work->nb_files &&
+           work->digests[work->order[low]].block_size == block_size)
+        low++;
+    *end = low;
+}
+
+/*
+ * Score the CTPH of the query q with its candidates in an index, or with the
+ * files of a compatible block size
+ */
+static bool keep_ctph_query(compare_worker_t *worker, uint64_t q,
+                            uint64_t seen[], uint64_t candidates[],
+                            uint32_t distances[])
+{
+    const compare_work_t *work = worker->work;
+    const sig_db_entry_t *entry = &work->queries->entries[q];
+    const ctph_digest_t *digest = &work->query_digests[q];
+
+    if (!(entry->flags & SIG_DB_CTPH))
+        return true;
+
+    uint64_t nb_candidates = 0;
+    if (work->ctph_index != NULL)
+        nb_candidates = ctph_index_lookup(work->ctph_index, digest, q + 1,
+                                          seen, candidates);
+    else if (work->simhash_index != NULL && (entry->flags & SIG_DB_SIMHASH))
+        nb_candidates =
+            simhash_index_neighbors(work->simhash_index,
+                                    work->queries->simhash[q], 0, candidates,
+                                    distances);
+
+    if (work->ctph_index != NULL || work->simhash_index != NULL) {
+        for (uint64_t k = 0; k < nb_candidates; k++) {
+            uint64_t j = candidates[k];
+            if (!keep_query_match(worker, q, j, score_query(work, q, j)))
+                return false;
+        }
+        return true;
+    }
+
+    /* The same block size, its double and its half */
+    uint64_t block_size = digest->block_size;
+    uint64_t block_sizes[3] = {block_size, 0, 0};
+    uint8_t nb_block_sizes = 1;
+    if (block_size > 0 && block_size <= UINT64_MAX / 2)
+        block_sizes[nb_block_sizes++] = block_size * 2;
+    if (block_size > 0 && block_size % 2 == 0)
+        block_sizes[nb_block_sizes++] = block_size / 2;
+
+    for (uint8_t b = 0; b < nb_block_sizes; b++) {
+        uint64_t p, p_end;
+        find_block_size(work, block_sizes[b], &p, &p_end);
+
+        for (; p < p_end; p++) {
+            uint64_t j = work->order[p];
+            if (!keep_query_match(worker, q, j, score_query(work, q, j)))
+                return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Score the SimHash of the query q with its neighbors in the index, or with
+ * every file of the database, their distances being counted at once
+ */
+static bool keep_simhash_query(compare_worker_t *worker, uint64_t q,
+                               uint64_t candidates[], uint32_t distances[])
+{
+    const compare_work_t *work = worker->work;
+    const sig_db_t *db = work->db;
+    const sig_db_entry_t *entry = &work->queries->entries[q];
+
+    if (!(entry->flags & SIG_DB_SIMHASH))
+        return true;
+
+    if (work->simhash_index != NULL) {
+        uint64_t nb_neighbors =
+            simhash_index_neighbors(work->simhash_index,
+                                    work->queries->simhash[q], 0, candidates,
+                                    distances);
+
+        for (uint64_t k = 0; k < nb_neighbors; k++) {
+            uint64_t j = candidates[k];
+            float score =
+                score_simhash(work, entry, &db->entries[j], distances[k]);
+            if (!keep_query_match(worker, q, j, score))
+                return false;
+        }
+        return true;
+    }
+
+    simhash_distances(work->queries->simhash[q], (const void *) db->simhash,
+                      db->nb_entries, distances);
+
+    for (uint64_t j = 0; j < db->nb_entries; j++) {
+        float score = score_simhash(work, entry, &db->entries[j], distances[j]);
+        if (!keep_query_match(worker, q, j, score))
+            return false;
+    }
+
+    return true;
+}
+
+/* Compare the queries with the database until there is none left */
+static void *compare_queries(void *arg)
+{
+    compare_worker_t *worker = arg;
+    compare_work_t *work = worker->work;
+    uint64_t nb_entries = work->db->nb_entries;
+
+    uint64_t *candidates = malloc(sizeof(uint64_t) * (nb_entries + 1));
+    uint64_t *seen = calloc(nb_entries + 1, sizeof(uint64_t));
+    uint32_t *distances = malloc(sizeof(uint32_t) * (nb_entries + 1));
+    if (candidates == NULL || seen == NULL || distances == NULL)
+        worker->error = true;
+
+    pthread_mutex_lock(&work->lock);
+    while (work->next_query < work->queries->nb_entries) {
+        uint64_t q = work->next_query++;
+        pthread_mutex_unlock(&work->lock);
+
+        if (!worker->error) {
+            bool ret = (work->algo == COMPARE_CTPH)
+                           ? keep_ctph_query(worker, q, seen, candidates,
+                                             distances)
+                           : keep_simhash_query(worker, q, candidates,
+                                                distances);
+            if (!ret)
+                worker->error = true;
+        }
+
+        pthread_mutex_lock(&work->lock);
+    }
+    pthread_mutex_unlock(&work->lock);
+
+    free(seen);
+    free(candidates);
+    free(distances);
+
+    return NULL;
+}
+
+/* Sort the lists of matches until there is none left */
+static void *sort_lists(void *arg)
+{
+    compare_work_t *work = ((compare_worker_t *) arg)->work;
+
+    pthread_mutex_lock(&work->lock);
+    while (work->next_list < work->result->nb_files) {
+        compare_list_t *list = &work->result->lists[work->next_list++];
+        pthread_mutex_unlock(&work->lock);
+
+        qsort(list->matches, list->nb_matches, sizeof(compare_match_t),
+              compare_match);
+
+        pthread_mutex_lock(&work->lock);
+    }
+    pthread_mutex_unlock(&work->lock);
+
+    return NULL;
+}
+
+/*
+ * Run fn on every worker, in nb_workers - 1 threads and the calling one. The
+ * workers run one after the other if the threads can't be allocated.
+ */
+static void run_workers(void *(*fn)(void *), compare_worker_t workers[],
+                        uint64_t nb_workers)
+{
+    pthread_t *threads = malloc((nb_workers - 1) * sizeof(pthread_t));
+    uint64_t nb_started = 0;
+    for (; threads != NULL && nb_started + 1 < nb_workers; nb_started++)
+        if (pthread_create(&threads[nb_started], NULL, fn,
+                           &workers[nb_started + 1]) != 0)
+            break;
+
+    /* Workers without thread are run here */
+    fn(&workers[0]);
+    for (uint64_t k = nb_started + 1; k < nb_workers; k++)
+        fn(&workers[k]);
+
+    for (uint64_t k = 0; k < nb_started; k++)
+        pthread_join(threads[k], NULL);
+    free(threads);
+}
+
+/*
+ * Parse the CTPH signature of each file once, return NULL if problems.
+ * The files without CTPH have an empty digest.
+ */
+static ctph_digest_t *parse_digests(const sig_db_t *db)
+{
+    ctph_digest_t *digests = calloc(db->nb_entries + 1, sizeof(ctph_digest_t));
+    if (digests == NULL)
+        return NULL;
+
+    for (uint64_t i = 0; i < db->nb_entries; i++) {
+        if (!(db->entries[i].flags & SIG_DB_CTPH))
+            continue;
+
+        const sig_db_ctph_t *ctph = &db->ctph[i];
+        if (!ctph_digest_init(&digests[i], ctph->block_size,
+                              ctph->signature[0], ctph->length[0],
+                              ctph->signature[1], ctph->length[1])) {
+            free(digests);
+            return NULL;
+        }
+    }
+
+    return digests;
+}
+
+/* Order of the files : increasing block size, then increasing index */
+static int compare_file(const void *file_1, const void *file_2)
+{
+    const compare_file_t *f1 = file_1, *f2 = file_2;
+    if (f1->block_size != f2->block_size)
+        return (f1->block_size < f2->block_size) ? -1 : 1;
+    return (f1->index < f2->index) ? -1 : (f1->index > f2->index);
+}
+
+/*
+ * Order the files with CTPH by block size, and make the regions of the pairs
+ * of the same block size, or of a block size and its double : the other
+ * pairs can't be compared.
+ * Return false if problems.
+ */
+static bool make_ctph_regions(compare_work_t *work)
+{
+    const sig_db_t *db = work->db;
+    uint64_t n = 0;
+
+    compare_file_t *files =
+        malloc(sizeof(compare_file_t) * (db->nb_entries + 1));
+    work->order = malloc(sizeof(uint64_t) * (db->nb_entries + 1));
+    work->regions = malloc(sizeof(compare_region_t) * (2 * db->nb_entries + 1));
+    if (files == NULL || work->order == NULL || work->regions == NULL) {
+        free(files);
+        return false;
+    }
+
+    for (uint64_t i = 0; i < db->nb_entries; i++)
+        if (db->entries[i].flags & SIG_DB_CTPH)
+            files[n++] = (compare_file_t){
+                .block_size = work->digests[i].block_size, .index = i};
+    qsort(files, n, sizeof(compare_file_t), compare_file);
+
+    for (uint64_t p = 0; p < n; p++)
+        work->order[p] = files[p].index;
+    work->nb_files = n;
+
+    /* Buckets [first, end) of the same block size, the double being next */
+    uint64_t double_first = 0;
+    for (uint64_t first = 0, end; first < n; first = end) {
+        uint64_t block_size = files[first].block_size;
+        for (end = first + 1;
+             end < n && files[end].block_size == block_size; end++)
+            ;
+
+        work->regions[work->nb_regions++] =
+            (compare_region_t){first, end, first, end};
+
+        if (block_size == 0 || block_size > UINT64_MAX / 2)
+            continue;
+
+        if (double_first < end)
+            double_first = end;
+        while (double_first < n &&
+               files[double_first].block_size < block_size * 2)
+            double_first++;
+
+        uint64_t double_end = double_first;
+        while (double_end < n &&
+               files[double_end].block_size == block_size * 2)
+            double_end++;
+
+        if (double_end > double_first)
+            work->regions[work->nb_regions++] =
+                (compare_region_t){first, end, double_first, double_end};
+    }
+
+    free(files);
+    return true;
+}
+
+/* Order the files with SimHash, return false if problems */
+static bool make_simhash_order(compare_work_t *work)
+{
+    const sig_db_t *db = work->db;
+
+    work->order = malloc(sizeof(uint64_t) * (db->nb_entries + 1));
+    if (work->order == NULL)
+        return false;
+
+    for (uint64_t i = 0; i < db->nb_entries; i++)
+        if (db->entries[i].flags & SIG_DB_SIMHASH)
+            work->order[work->nb_files++] = i;
+
+    return true;
+}
+
+/*
+ * Index the SimHash of the files with CTPH for the cascade, unless scanning
+ * them : the files without SimHash are then left out of the order, and only
+ * the neighbors of the files are scored instead of the regions.
+ * Return false if problems.
+ */
+static bool make_cascade_index(compare_work_t *work)
+{
+    const sig_db_t *db = work->db;
+
+    uint64_t *order = malloc(sizeof(uint64_t) * (work->nb_files + 1));
+    if (order == NULL)
+        return false;
+
+    uint64_t nb_files = 0;
+    for (uint64_t p = 0; p < work->nb_files; p++)
+        if (db->entries[work->order[p]].flags & SIG_DB_SIMHASH)
+            order[nb_files++] = work->order[p];
+
+    work->simhash_index =
+        simhash_index_new((const void *) db->simhash, db->nb_entries, order,
+                          nb_files, work->options.simhash_radius);
+    if (work->simhash_index == NULL) {
+        free(order);
+        return false;
+    }
+
+    /* Scanning : the pairs of the regions are filtered while scored */
+    if (simhash_index_scans(work->simhash_index)) {
+        simhash_index_free(work->simhash_index);
+        work->simhash_index = NULL;
+        free(order);
+        return true;
+    }
+
+    free(work->order);
+    work->order = order;
+    work->nb_files = nb_files;
+    return true;
+}
+
+/*
+ * Parse the signatures of the work and build the indexes wanted by its
+ * options, return false if problems
+ */
+static bool prepare_work(compare_work_t *work)
+{
+    const sig_db_t *db = work->db;
+    const compare_options_t *options = &work->options;
+
+    if (work->algo == COMPARE_CTPH) {
+        work->digests = parse_digests(db);
+        if (work->digests == NULL || !make_ctph_regions(work))
+            return false;
+
+        if (options->ctph_index) {
+            work->ctph_index = ctph_index_new(work->digests, db->nb_entries,
+                                              work->order, work->nb_files);
+            if (work->ctph_index == NULL)
+                return false;
+        } else if (options->cascade && options->simhash_radius >= 0 &&
+                   !make_cascade_index(work))
+            return false;
+    } else if (options->simhash_radius >= 0) {
+        uint32_t radius = options->simhash_radius;
+        work->simhash_max_distance = MIN(work->simhash_max_distance, radius);
+        if (!make_simhash_order(work))
+            return false;
+
+        work->simhash_index =
+            simhash_index_new((const void *) db->simhash, db->nb_entries,
+                              work->order, work->nb_files, radius);
+        if (work->simhash_index == NULL)
+            return false;
+
+        /* Scanning : counting the distances at once is faster */
+        if (simhash_index_scans(work->simhash_index)) {
+            simhash_index_free(work->simhash_index);
+            work->simhash_index = NULL;
+            free(work->order);
+            work->order = NULL;
+            work->nb_files = 0;
+        }
+    }
+
+    return true;
+}
+
+/* Free what prepare_work() made */
+static void free_work(compare_work_t *work)
+{
+    free(work->digests);
+    free(work->order);
+    free(work->regions);
+    ctph_index_free(work->ctph_index);
+    simhash_index_free(work->simhash_index);
+}
+
+/* External functions */
+
+compare_result_t *compare_all(const sig_db_t *db, compare_algorithm_e algo,
+                              const compare_options_t *options)
+{
+    if (db == NULL || algo >= COMPARE_END || options == NULL)
+        return NULL;
+
+    compare_result_t *result = compare_result_new(db->nb_entries);
+    if (result == NULL)
+        return NULL;
+
+    compare_work_t work = {
+        .db = db,
+        .algo = algo,
+        .options = *options,
+        .ctph_min_score = ceilf(options->min_score),
+        .simhash_max_distance = simhash_max_distance(options->min_score),
+        .result = result};
+
+    /* Both scores of a pair are the same : only score the upper triangle */
+    compare_region_t all = {0, db->nb_entries, 0, db->nb_entries};
+    if (!prepare_work(&work)) {
+        free_work(&work);
+        compare_result_free(result);
+        return NULL;
+    }
+
+    /* Without index, the SimHash files are compared in tiles */
+    bool simhash_tiles = algo == COMPARE_SIMHASH &&
+                         work.simhash_index == NULL && db->nb_entries > 0;
+    if (simhash_tiles) {
+        work.regions = &all;
+        work.nb_regions = 1;
+    }
+    pthread_mutex_init(&work.lock, NULL);
+
+    uint64_t total_tiles = 0;
+    for (uint64_t k = 0; k < work.nb_regions; k++)
+        total_tiles += region_nb_tiles(&work.regions[k]);
+
+    /* With an index, the files are taken by groups of the size of a tile */
+    bool indexed = work.ctph_index != NULL || work.simhash_index != NULL;
+    if (indexed)
+        total_tiles =
+            (work.nb_files + COMPARE_TILE_SIZE - 1) / COMPARE_TILE_SIZE;
+
+    uint64_t nb_workers = MIN(options->nb_jobs, total_tiles);
+    if (nb_workers == 0)
+        nb_workers = 1;
+
+    /* On the heap : the number of jobs isn't bounded */
+    compare_worker_t *workers = calloc(nb_workers, sizeof(compare_worker_t));
+    bool ret = workers != NULL;
+    for (uint64_t k = 0; ret && k < nb_workers; k++)
+        workers[k].work = &work;
+
+    if (ret)
+        run_workers(indexed ? compare_candidates : compare_tiles, workers,
+                    nb_workers);
+
+    for (uint64_t k = 0; workers != NULL && k < nb_workers; k++) {
+        if (workers[k].error)
+            ret = false;
+        free(workers[k].pairs);
+    }
+
+    /* The lists are sorted : the order of the pairs doesn't matter */
+    if (ret)
+        run_workers(sort_lists, workers, nb_workers);
+
+    free(workers);
+    pthread_mutex_destroy(&work.lock);
+    if (simhash_tiles)
+        work.regions = NULL;
+    free_work(&work);
+
+    if (!ret) {
+        compare_result_free(result);
+        return NULL;
+    }
+
+    return result;
+}
+
+compare_result_t *compare_query(const sig_db_t *queries, const sig_db_t *db,
+                                compare_algorithm_e algo,
+                                const compare_options_t *options)
+{
+    if (queries == NULL)
+        return NULL;
+
+    compare_index_t *index = compare_index_new(db, algo, options);
+    if (index == NULL)
+        return NULL;
+
+    compare_result_t *result = compare_index_query(index, queries);
+    compare_index_free(index);
+    return result;
+}
+
+compare_index_t *compare_index_new(const sig_db_t *db,
+                                   compare_algorithm_e algo,
+                                   const compare_options_t *options)
+{
+    if (db == NULL || algo >= COMPARE_END || options == NULL)
+        return NULL;
+
+    compare_index_t *index = calloc(1, sizeof(compare_index_t));
+    if (index == NULL)
+        return NULL;
+
+    index->work = (compare_work_t){
+        .db = db,
+        .algo = algo,
+        .options = *options,
+        .ctph_min_score = ceilf(options->min_score),
+        .simhash_max_distance = simhash_max_distance(options->min_score)};
+
+    if (!prepare_work(&index->work)) {
+        compare_index_free(index);
+        return NULL;
+    }
+
+    return index;
+}
+
+compare_result_t *compare_index_query(const compare_index_t *index,
+                                      const sig_db_t *queries)
+{
+    if (index == NULL || queries == NULL)
+        return NULL;
+
+    compare_result_t *result = compare_result_new(queries->nb_entries);
+    if (result == NULL)
+        return NULL;
+
+    /* The work of the index is only read : each comparision has its copy */
+    compare_work_t work = index->work;
+    work.queries = queries;
+    work.result = result;
+
+    if (work.algo == COMPARE_CTPH) {
+        work.query_digests = parse_digests(queries);
+        if (work.query_digests == NULL) {
+            compare_result_free(result);
+            return NULL;
+        }
+    }
+    pthread_mutex_init(&work.lock, NULL);
+
+    uint64_t nb_workers = MIN(work.options.nb_jobs, queries->nb_entries);
+    if (nb_workers == 0)
+        nb_workers = 1;
+
+    compare_worker_t *workers = calloc(nb_workers, sizeof(compare_worker_t));
+    bool ret = workers != NULL;
+    for (uint64_t k = 0; ret && k < nb_workers; k++)
+        workers[k].work = &work;
+
+    if (ret)
+        run_workers(compare_queries, workers, nb_workers);
+
+    for (uint64_t k = 0; ret && k < nb_workers; k++)
+        if (workers[k].error)
+            ret = false;
+
+    if (ret)
+        run_workers(sort_lists, workers, nb_workers);
+
+    free(workers);
+    pthread_mutex_destroy(&work.lock);
+    free(work.query_digests);
+
+    if (!ret) {
+        compare_result_free(result);
+        return NULL;
+    }
+
+    return result;
+}
+
+void compare_index_free(compare_index_t *index)
+{
+    if (index == NULL)
+        return;
+
+    free_work(&index->work);
+    free(index);
+}
+
+float compare_simhash_score(const sig_db_t *db_1, uint64_t i,
+                            const sig_db_t *db_2, uint64_t j)
+{
+    if (db_1 == NULL || db_2 == NULL || i >= db_1->nb_entries ||
+        j >= db_2->nb_entries ||
+        !(db_1->entries[i].flags & db_2->entries[j].flags & SIG_DB_SIMHASH))
+        return 0.0;
+
+    const compare_work_t work = {.simhash_max_distance = SIMHASH_SIZE * 8};
+    uint32_t dist = simhash_distance(db_1->simhash[i], db_2->simhash[j],
+                                     SIMHASH_SIZE * 8);
+    return score_simhash(&work, &db_1->entries[i], &db_2->entries[j], dist);
+}
+
+void compare_result_free(compare_result_t *result)
+{
+    if (result == NULL)
+        return;
+
+    for (uint64_t i = 0; i < result->nb_files; i++)
+        free(result->lists[i].matches);
+    free(result->lists);
+    free(result);
+}
+
+compare_result_t *compare_result_new(uint64_t nb_files)
+{
+    compare_result_t *result = malloc(sizeof(compare_result_t));
+    if (result == NULL)
+        return NULL;
+
+    result->nb_files = nb_files;
+    result->lists = calloc(nb_files + 1, sizeof(compare_list_t));
+    if (result->lists == NULL) {
+        free(result);
+        return NULL;
+    }
+
+    return result;
+}
+
+bool compare_result_add(compare_result_t *result, uint64_t i, uint64_t index,
+                        float score, uint64_t top)
+{
+    if (result == NULL || i >= result->nb_files)
+        return false;
+
+    return keep_match(&result->lists[i], index, score, top);
+}
+
+void compare_result_sort(compare_result_t *result)
+{
+    if (result == NULL)
+        return;
+
+    for (uint64_t i = 0; i < result->nb_files; i++) {
+        compare_list_t *list = &result->lists[i];
+        qsort(list->matches, list->nb_matches, sizeof(compare_match_t),
+              compare_match);
+    }
+}
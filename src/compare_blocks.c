@@ -0,0 +1,302 @@
+#include "compare_blocks.h"
+
+#include <stdlib.h>
+
+#include "ctph.h"
+#include "spill.h"
+
+/*
+ * Memory used for each file of a block being compared : its signatures read
+ * from the disk, its parsed CTPH and the arrays of the comparision
+ */
+#define COMPARE_BLOCKS_FILE_COST 512
+/* And for each thread : the candidates and distances of a file */
+#define COMPARE_BLOCKS_JOB_COST (2 * sizeof(uint64_t) + sizeof(uint32_t))
+/* And for the substrings of its CTPH in the index */
+#define COMPARE_BLOCKS_INDEX_COST (2 * CTPH_SIGN_LENGTH * 2 * sizeof(uint64_t))
+/* Or for its SimHash in the multi-index, of at most 32 chunks */
+#define COMPARE_BLOCKS_SIMHASH_INDEX_COST (32 * 2 * sizeof(uint64_t))
+
+/* Internal structure (hiden from outside) to represent the comparision */
+struct _compare_blocks_t {
+    const sig_db_t *db;
+    compare_algorithm_e algo;
+    compare_options_t options;
+    uint64_t block_size;
+    uint64_t nb_blocks;
+    spill_t *spill; /* A partition per block, with the matches of its files */
+};
+
+/* Static Functions */
+
+static uint64_t get_nb_blocks(uint64_t nb_files, uint64_t block_size)
+{
+    return (nb_files + block_size - 1) / block_size;
+}
+
+/*
+ * Memory used to compare two blocks of size files at once, then to read back
+ * the top matches of the files of a block
+ */
+static double memory_cost(uint64_t nb_files, const compare_options_t *options,
+                          uint64_t size)
+{
+    double file_cost =
+        COMPARE_BLOCKS_FILE_COST + options->nb_jobs * COMPARE_BLOCKS_JOB_COST;
+    if (options->ctph_index)
+        file_cost += COMPARE_BLOCKS_INDEX_COST;
+    else if (options->simhash_radius >= 0)
+        file_cost += COMPARE_BLOCKS_SIMHASH_INDEX_COST;
+
+    /* Every pair of the blocks may match, the best ones are kept for both */
+    double kept =
+        (options->top > 0 && options->top < size) ? options->top : size;
+    double nb_matches = (double) size * size + 2.0 * size * kept;
+    double read_back = size * (sizeof(compare_list_t) +
+                               kept * sizeof(compare_match_t)) +
+                       SPILL_CHUNK_SIZE * sizeof(spill_record_t);
+
+    return 2.0 * size * file_cost + nb_matches * sizeof(compare_match_t) +
+           read_back + spill_memory(get_nb_blocks(nb_files, size));
+}
+
+/* Spill a match of the file with the other one, return false if problems */
+static bool spill_match(compare_blocks_t *blocks, uint64_t file, uint64_t index,
+                        float score)
+{
+    spill_record_t record = {.file = file, .index = index, .score = score};
+    return spill_add(blocks->spill, file / blocks->block_size, &record);
+}
+
+/*
+ * Spill the lists of a result : the list k is the one of the file first + k,
+ * the indexes are the ones of the files other_first + index
+ */
+static bool spill_lists(compare_blocks_t *blocks,
+                        const compare_result_t *result, uint64_t first,
+                        uint64_t other_first)
+{
+    for (uint64_t k = 0; k < result->nb_files; k++) {
+        const compare_list_t *list = &result->lists[k];
+        for (uint64_t m = 0; m < list->nb_matches; m++)
+            if (!spill_match(blocks, first + k,
+                             other_first + list->matches[m].index,
+                             list->matches[m].score))
+                return false;
+    }
+
+    return true;
+}
+
+/* Make view the block b of the database */
+static bool get_block(const compare_blocks_t *blocks, uint64_t b,
+                      sig_db_t *view)
+{
+    uint64_t first = b * blocks->block_size;
+    uint64_t end = first + blocks->block_size;
+    if (end > blocks->db->nb_entries)
+        end = blocks->db->nb_entries;
+
+    return sig_db_view(blocks->db, first, end, view);
+}
+
+/* Score the pairs of files of the block a, return false if problems */
+static bool compare_block(compare_blocks_t *blocks, uint64_t a)
+{
+    sig_db_t block;
+    if (!get_block(blocks, a, &block))
+        return false;
+
+    /* Both files of each pair are in the block : their lists are complete */
+    compare_result_t *result =
+        compare_all(&block, blocks->algo, &blocks->options);
+    if (result == NULL)
+        return false;
+
+    uint64_t first = a * blocks->block_size;
+    bool ret = spill_lists(blocks, result, first, first);
+
+    compare_result_free(result);
+    return ret;
+}
+
+/*
+ * Score the pairs of files of the blocks a and b, a < b, and keep the best
+ * matches of the files of both. Return false if problems.
+ */
+static bool compare_block_pair(compare_blocks_t *blocks, uint64_t a,
+                               uint64_t b)
+{
+    sig_db_t block_a, block_b;
+    if (!get_block(blocks, a, &block_a) || !get_block(blocks, b, &block_b))
+        return false;
+
+    /* The matches of the files of b are needed too : they are all kept */
+    compare_options_t options = blocks->options;
+    options.top = 0;
+
+    compare_result_t *result =
+        compare_query(&block_a, &block_b, blocks->algo, &options);
+    if (result == NULL)
+        return false;
+
+    uint64_t first_a = a * blocks->block_size;
+    uint64_t first_b = b * blocks->block_size;
+    uint64_t top = blocks->options.top;
+    bool ret = true;
+
+    if (top == 0) {
+        for (uint64_t k = 0; k < result->nb_files && ret; k++) {
+            const compare_list_t *list = &result->lists[k];
+            for (uint64_t m = 0; m < list->nb_matches && ret; m++) {
+                uint64_t j = first_b + list->matches[m].index;
+                float score = list->matches[m].score;
+                ret = spill_match(blocks, first_a + k, j, score) &&
+                      spill_match(blocks, j, first_a + k, score);
+            }
+        }
+
+        compare_result_free(result);
+        return ret;
+    }
+
+    /* Only the top best matches of each file with the other block */
+    compare_result_t *best_a = compare_result_new(block_a.nb_entries);
+    compare_result_t *best_b = compare_result_new(block_b.nb_entries);
+    ret = best_a != NULL && best_b != NULL;
+
+    for (uint64_t k = 0; k < result->nb_files && ret; k++) {
+        const compare_list_t *list = &result->lists[k];
+        for (uint64_t m = 0; m < list->nb_matches && ret; m++) {
+            uint64_t l = list->matches[m].index;
+            float score = list->matches[m].score;
+            ret = compare_result_add(best_a, k, first_b + l, score, top) &&
+                  compare_result_add(best_b, l, first_a + k, score, top);
+        }
+    }
+
+    ret = ret && spill_lists(blocks, best_a, first_a, 0) &&
+          spill_lists(blocks, best_b, first_b, 0);
+
+    compare_result_free(result);
+    compare_result_free(best_a);
+    compare_result_free(best_b);
+    return ret;
+}
+
+/* External functions */
+
+uint64_t compare_blocks_size(uint64_t nb_files,
+                             const compare_options_t *options,
+                             uint64_t mem_limit)
+{
+    /* Without top, the matches read back of a file aren't bounded */
+    if (options == NULL || options->top == 0 ||
+        memory_cost(nb_files, options, COMPARE_BLOCKS_MIN_SIZE) > mem_limit)
+        return 0;
+
+    /* Largest size fitting */
+    uint64_t low = COMPARE_BLOCKS_MIN_SIZE;
+    uint64_t high = (nb_files > low) ? nb_files : low;
+    while (low < high) {
+        uint64_t mid = low + (high - low + 1) / 2;
+        if (memory_cost(nb_files, options, mid) <= mem_limit)
+            low = mid;
+        else
+            high = mid - 1;
+    }
+
+    return low;
+}
+
+compare_blocks_t *compare_blocks_new(const sig_db_t *db,
+                                     compare_algorithm_e algo,
+                                     const compare_options_t *options,
+                                     uint64_t block_size)
+{
+    if (db == NULL || algo >= COMPARE_END || options == NULL ||
+        block_size == 0)
+        return NULL;
+
+    compare_blocks_t *blocks = calloc(1, sizeof(compare_blocks_t));
+    if (blocks == NULL)
+        return NULL;
+
+    blocks->db = db;
+    blocks->algo = algo;
+    blocks->options = *options;
+    blocks->options.nb_shards = 0;
+    blocks->block_size = block_size;
+    blocks->nb_blocks = get_nb_blocks(db->nb_entries, block_size);
+
+    blocks->spill = spill_new(blocks->nb_blocks);
+    if (blocks->spill == NULL)
+        goto err_blocks;
+
+    /* Block nested loop : each block with itself, then with the next ones */
+    for (uint64_t a = 0; a < blocks->nb_blocks; a++) {
+        if (!compare_block(blocks, a))
+            goto err_blocks;
+
+        for (uint64_t b = a + 1; b < blocks->nb_blocks; b++)
+            if (!compare_block_pair(blocks, a, b))
+                goto err_blocks;
+    }
+
+    return blocks;
+
+err_blocks:
+    compare_blocks_free(blocks);
+    return NULL;
+}
+
+uint64_t compare_blocks_count(const compare_blocks_t *blocks)
+{
+    return (blocks == NULL) ? 0 : blocks->nb_blocks;
+}
+
+compare_result_t *compare_blocks_result(compare_blocks_t *blocks, uint64_t b)
+{
+    if (blocks == NULL || b >= blocks->nb_blocks)
+        return NULL;
+
+    sig_db_t block;
+    if (!get_block(blocks, b, &block))
+        return NULL;
+
+    compare_result_t *result = compare_result_new(block.nb_entries);
+    if (result == NULL)
+        return NULL;
+
+    uint64_t first = b * blocks->block_size;
+    spill_record_t records[SPILL_CHUNK_SIZE];
+    uint64_t n;
+    for (uint64_t chunk = 0;
+         (n = spill_read(blocks->spill, b, chunk, records)) > 0; chunk++) {
+        if (n == UINT64_MAX)
+            goto err_result;
+
+        for (uint64_t r = 0; r < n; r++)
+            if (records[r].file < first ||
+                !compare_result_add(result, records[r].file - first,
+                                    records[r].index, records[r].score,
+                                    blocks->options.top))
+                goto err_result;
+    }
+
+    compare_result_sort(result);
+    return result;
+
+err_result:
+    compare_result_free(result);
+    return NULL;
+}
+
+void compare_blocks_free(compare_blocks_t *blocks)
+{
+    if (blocks == NULL)
+        return;
+
+    spill_free(blocks->spill);
+    free(blocks);
+}
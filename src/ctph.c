@@ -2,13 +2,20 @@
  * @file ctph.c
  * @author CPietJa
  * @brief Module which implements Context-Triggered Piecewise Hashing (CTPH)
- * @version 0.1
+ * @version 0.2
  * @date 2021-02-10
  *
- * To implement CTPH, we use a rolling hash (Adler-32) and a FNV Hash :
- * - Adler-32 : https://en.wikipedia.org/wiki/Adler-32#The_algorithm
+ * To implement CTPH, we use a rolling hash and a FNV Hash :
+ * - Rolling hash : sliding window of WINDOW_SIZE bytes combining the sums of
+ * Adler-32 with a shift-xor, as in ssdeep
+ * (https://en.wikipedia.org/wiki/Adler-32#The_algorithm)
  * - FNV-1 Hash :
  * https://en.wikipedia.org/wiki/Fowler%E2%80%93Noll%E2%80%93Vo_hash_function
+ *
+ * A byte is a trigger point for the block size B when its rolling hash modulo B
+ * is B - 1, so that runs of zeros are not trigger points. The rolling hash of
+ * a byte only depends on the WINDOW_SIZE last bytes, so the trigger points are
+ * searched for many bytes at once (AVX2 when available).
  */
 
 #include "ctph.h"
@@ -22,6 +29,10 @@
 #include <math.h>
 #include <string.h>
 
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
 #ifndef MIN
 #define MIN(a, b) ((a) < (b) ? (a) : (b))
 #endif
@@ -33,14 +44,16 @@
 #define WINDOW_SIZE 7    /* Bytes */
 #define MIN_BLOCK_SIZE 3 /* Bytes */
 #define SIGN_LENGTH 64   /* Desired signature length */
-#define MOD_ADLER 65521  /* Largest prime number smaller than 2^16 */
-#define SIZE_MAX_SIGN 150
+#define SCAN_WIDTH 32    /* Bytes searched at once for trigger points */
 
 /* clang-format off */
 typedef struct {
-    uint16_t a; /* 16-bit checksum : Sum of all bytes in the stream plus one */
-    uint16_t b; /* 16-bit checksum : Sum of the individual values of 'a' from each step */
-    uint32_t h; /* 32-bit checksum : Concatenation of B and A in this order */
+    uint32_t a; /* Sum of the bytes in the window */
+    uint32_t b; /* Sum of the individual values of 'a' from each step in the window */
+    uint32_t c; /* Shift-xor of the bytes in the window */
+    uint32_t h; /* 32-bit checksum : a + b + c */
+    uint8_t window[WINDOW_SIZE];
+    uint8_t oldest; /* Index of the oldest byte in window */
 } rh_state;
 /* clang-format on */
 
@@ -49,8 +62,27 @@ typedef struct {
 #define FNV_PRIME 0x100000001b3             /* Prime number */
 /* clang-format on */
 
-/* The FNV Hash is a 64-bit value */
-typedef uint64_t fnv_hash;
+/*
+ * Only the 6 low bits of the FNV Hash are used, and they only depend on the low
+ * bits of the previous value : a 8-bit value is enough.
+ */
+typedef uint8_t fnv_hash;
+
+/* Signature being computed for one block size */
+typedef struct {
+    fnv_hash hash;  /* FNV Hash since the last trigger */
+    bool pending;   /* Bytes added to hash since the last trigger */
+    uint16_t count; /* Number of Trigger */
+    char signature[SIGN_LENGTH + 1];
+} block_state;
+
+/* Signatures computed at the same time */
+typedef struct {
+    block_state *blocks;
+    uint64_t B;  /* Block size of blocks[0], blocks[k] is for B >> k */
+    uint8_t top; /* Number of signatures not full, from blocks[0] */
+    uint8_t end; /* Number of signatures needed, from blocks[0] */
+} engine_state;
 
 /**
  * @brief Initialize the rolling hash states.
@@ -64,15 +96,14 @@ static bool rh_init(rh_state *state)
     if (state == NULL)
         return false;
 
-    state->a = 1;
-    state->b = 0;
-    state->h = 0;
+    memset(state, 0, sizeof(rh_state));
 
     return true;
 }
 
 /**
- * @brief Update the rolling hash with one byte
+ * @brief Update the rolling hash with one byte, the oldest byte leaves the
+ * window.
  *
  * @param state rolling hash states
  * @param byte byte to add
@@ -84,14 +115,102 @@ static bool rh_add_byte(rh_state *state, uint8_t byte)
     if (state == NULL)
         return false;
 
-    state->a = (state->a + byte) % MOD_ADLER;
-    state->b = (state->b + state->a) % MOD_ADLER;
+    state->b += WINDOW_SIZE * byte - state->a;
+    state->a += byte - state->window[state->oldest];
+    state->c = (state->c << 5) ^ byte;
+
+    state->window[state->oldest] = byte;
+    if (++state->oldest == WINDOW_SIZE)
+        state->oldest = 0;
 
-    state->h = (state->b << 16) | state->a;
+    state->h = state->a + state->b + state->c;
 
     return true;
 }
 
+/**
+ * @brief Set the rolling hash states to a window of bytes
+ *
+ * @param state rolling hash states
+ * @param last the newest byte of the window, the WINDOW_SIZE - 1 bytes before
+ * it must be readable
+ * @return true if no problem
+ * @return false if state or last NULL
+ */
+static bool rh_load(rh_state *state, const uint8_t *last)
+{
+    if (state == NULL || last == NULL)
+        return false;
+
+    rh_init(state);
+    for (uint8_t i = 0; i < WINDOW_SIZE; i++)
+        rh_add_byte(state, last[i + 1 - WINDOW_SIZE]);
+
+    return true;
+}
+
+/**
+ * @brief Compute the rolling hash of a window of bytes without any state. It
+ * gives the same value as rh_add_byte().
+ *
+ * @param last the newest byte of the window, the WINDOW_SIZE - 1 bytes before
+ * it must be readable
+ * @return uint32_t the rolling hash
+ */
+static uint32_t rh_hash(const uint8_t *last)
+{
+    uint32_t sum = 0, weighted = 0, shifted = 0;
+
+    for (uint8_t i = 0; i < WINDOW_SIZE; i++) {
+        sum += last[-i];
+        weighted += sum;
+        shifted ^= (uint32_t) last[-i] << (5 * i);
+    }
+
+    return sum + weighted + shifted;
+}
+
+/**
+ * @brief Search the trigger points in SCAN_WIDTH bytes
+ *
+ * @param bytes the bytes, the WINDOW_SIZE - 1 bytes before must be readable
+ * @param mask trigger when (rolling hash & mask) == mask
+ * @return uint32_t bit i is set if bytes[i] is a trigger point
+ */
+static uint32_t rh_scan(const uint8_t *bytes, uint32_t mask)
+{
+    uint32_t triggers = 0;
+
+#ifdef __AVX2__
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i vmask = _mm256_set1_epi32(mask);
+
+    /* Same computation as rh_hash(), for 8 bytes at once */
+    for (uint8_t i = 0; i < SCAN_WIDTH; i += 8) {
+        __m256i sum = zero, weighted = zero, shifted = zero;
+
+        for (uint8_t j = 0; j < WINDOW_SIZE; j++) {
+            __m256i v = _mm256_cvtepu8_epi32(
+                _mm_loadl_epi64((const __m128i *) (bytes + i - j)));
+            sum = _mm256_add_epi32(sum, v);
+            weighted = _mm256_add_epi32(weighted, sum);
+            shifted = _mm256_xor_si256(shifted, _mm256_slli_epi32(v, 5 * j));
+        }
+
+        __m256i h = _mm256_add_epi32(_mm256_add_epi32(sum, weighted), shifted);
+        __m256i hit = _mm256_cmpeq_epi32(_mm256_and_si256(h, vmask), vmask);
+        triggers |= (uint32_t) _mm256_movemask_ps(_mm256_castsi256_ps(hit))
+                    << i;
+    }
+#else
+    for (uint8_t i = 0; i < SCAN_WIDTH; i++)
+        if ((rh_hash(&bytes[i]) & mask) == mask)
+            triggers |= (uint32_t) 1 << i;
+#endif
+
+    return triggers;
+}
+
 /**
  * @brief Update the FNV hash with one byte
  *
@@ -105,7 +224,7 @@ static bool fnv_add_byte(fnv_hash *hash, uint8_t byte)
     if (hash == NULL)
         return false;
 
-    (*hash) *= FNV_PRIME;
+    (*hash) *= (fnv_hash) FNV_PRIME;
     (*hash) ^= byte;
 
     return true;
@@ -116,74 +235,168 @@ static const char *b64 =
     "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
 
 /**
- * @brief Compute and return the hash of the ELF data in Base64
+ * @brief Update the FNV hashes of the signatures not full with some bytes
+ *
+ * @param engine the signatures
+ * @param bytes bytes to add
+ * @param nb_bytes number of bytes
+ */
+static void engine_add_bytes(engine_state *engine, const uint8_t *bytes,
+                             uint64_t nb_bytes)
+{
+    if (nb_bytes == 0)
+        return;
+
+    fnv_hash hashes[engine->top];
+    for (uint8_t k = 0; k < engine->top; k++)
+        hashes[k] = engine->blocks[k].hash;
+
+    for (uint64_t i = 0; i < nb_bytes; i++)
+        for (uint8_t k = 0; k < engine->top; k++)
+            fnv_add_byte(&hashes[k], bytes[i]);
+
+    for (uint8_t k = 0; k < engine->top; k++) {
+        engine->blocks[k].hash = hashes[k];
+        engine->blocks[k].pending = true;
+    }
+}
+
+/**
+ * @brief Update the signatures triggered by a rolling hash value, from the
+ * smallest block size.
+ * The signature of a block size is full before the ones of larger block sizes,
+ * as they have fewer trigger points.
+ *
+ * @param engine the signatures
+ * @param h the rolling hash value
+ */
+static void engine_trigger(engine_state *engine, uint32_t h)
+{
+    for (uint8_t k = engine->top; k-- > 0;) {
+        uint32_t mask = (engine->B >> k) - 1;
+        if ((h & mask) != mask)
+            break;
+
+        block_state *block = &engine->blocks[k];
+
+        /* We have trigger : Update Signature */
+        block->signature[block->count++] = b64[block->hash & 0x3F];
+
+        /* Reset FNV Hash */
+        block->hash = (fnv_hash) FNV_OFFSET_BASIS;
+        block->pending = false;
+
+        if (block->count == SIGN_LENGTH - 1)
+            engine->top = k;
+
+        /* Long enough : the smaller block sizes are not needed */
+        if (k > 0 && k + 1 < engine->end && block->count > 32) {
+            engine->end = k + 1;
+            engine->top = MIN(engine->top, engine->end);
+        }
+    }
+}
+
+/**
+ * @brief Compute in one pass the signatures of the ELF data for the block
+ * sizes B, B/2, ..., 1. blocks[k] gets the signature for the block size B >> k.
+ * As triggers for a block size are also triggers for all the smaller ones, a
+ * single rolling hash is shared by all the block sizes.
+ * The block sizes smaller than the first one, from the second, whose signature
+ * is long enough are dropped as soon as it is known.
  *
  * @param data the ELF Data
- * @param sign_length put the size of the hash in it
- * @param B Block size for the trigger.
- * @return char* the hash in Base64, NULL otherwise
+ * @param B the largest block size, a power of 2
+ * @param blocks the signatures to compute
+ * @param nb_blocks number of block sizes (log2(B) + 1)
+ * @return uint8_t the number of signatures computed, 0 if data or blocks NULL
  */
-static char *ctph_hash_engine(elf_data data, uint16_t *sign_length, uint64_t B)
+static uint8_t ctph_hash_engine(elf_data data, uint64_t B, block_state blocks[],
+                                uint8_t nb_blocks)
 {
-    if (data == NULL || sign_length == NULL || B == 0)
-        return NULL;
+    if (data == NULL || blocks == NULL || nb_blocks == 0)
+        return 0;
 
     rh_state state;
     rh_init(&state);
 
-    fnv_hash hash = FNV_OFFSET_BASIS;
+    for (uint8_t k = 0; k < nb_blocks; k++) {
+        blocks[k].hash = (fnv_hash) FNV_OFFSET_BASIS;
+        blocks[k].pending = false;
+        blocks[k].count = 0;
+    }
 
-    char signature[SIGN_LENGTH + 1];
+    engine_state engine = {
+        .blocks = blocks, .B = B, .top = nb_blocks, .end = nb_blocks};
 
     uint8_t window = 1;
-    uint16_t count = 0; /* Number of Trigger */
 
     /* Moving the window */
-    for (uint8_t i = 0; i < SECTION_END; i++) {
-        if (data[i].len) {
-            for (uint64_t byte = 0;
-                 byte < data[i].len && count < SIGN_LENGTH - 1; byte++) {
-                /* Update Rolling Hash Value */
-                rh_add_byte(&state, data[i].data[byte]);
-
-                /* Update FNV Hash */
-                fnv_add_byte(&hash, data[i].data[byte]);
-
-                /* Check Window Size */
-                if (window < WINDOW_SIZE)
-                    window++;
-                else {
-                    /* Check Trigger Point */
-                    if (state.h % B)
-                        continue;
-                    else { /* We have trigger */
-                        /* Update Signature */
-                        signature[count] = b64[hash & 0x3F];
-                        count++;
-
-                        /* Reset FNV Hash */
-                        hash = FNV_OFFSET_BASIS;
-                    }
+    for (uint8_t i = 0; i < SECTION_END && engine.top; i++) {
+        const uint8_t *bytes = data[i].data;
+        uint64_t len = data[i].len;
+        uint64_t byte = 0;
+        bool state_late = false; /* state is not at byte */
+
+        while (byte < len && engine.top) {
+            /* Smallest block size not full */
+            uint32_t mask = (B >> (engine.top - 1)) - 1;
+
+            if (window == WINDOW_SIZE && byte >= WINDOW_SIZE - 1 &&
+                len - byte >= SCAN_WIDTH) {
+                /* Whole windows in the section : search many bytes at once */
+                uint32_t triggers = rh_scan(&bytes[byte], mask);
+                uint64_t next = byte;
+
+                for (; triggers && engine.top; triggers &= triggers - 1) {
+                    uint64_t trigger = byte + __builtin_ctz(triggers);
+
+                    engine_add_bytes(&engine, &bytes[next], trigger + 1 - next);
+                    engine_trigger(&engine, rh_hash(&bytes[trigger]));
+                    next = trigger + 1;
                 }
+                if (engine.top)
+                    engine_add_bytes(&engine, &bytes[next],
+                                     byte + SCAN_WIDTH - next);
+
+                byte += SCAN_WIDTH;
+                state_late = true;
+                continue;
+            }
+
+            if (state_late) {
+                rh_load(&state, &bytes[byte - 1]);
+                state_late = false;
             }
+
+            /* Update Rolling Hash Value */
+            rh_add_byte(&state, bytes[byte]);
+
+            /* Update FNV Hashes */
+            engine_add_bytes(&engine, &bytes[byte], 1);
+
+            /* Check Window Size */
+            if (window < WINDOW_SIZE)
+                window++;
+            else if ((state.h & mask) == mask) /* Check Trigger Points */
+                engine_trigger(&engine, state.h);
+
+            byte++;
         }
-    }
-    /* Last hash between last trigger point and end of the data */
-    if (hash != FNV_OFFSET_BASIS) {
-        signature[count] = b64[hash & 0x3F];
-        count++;
-    }
 
-    (*sign_length) = count - 1;
-    signature[count] = '\0';
+        /* The window continues in the next section */
+        if (state_late)
+            rh_load(&state, &bytes[MIN(byte, len) - 1]);
+    }
 
-    /* Copy signature */
-    char *final_hash = malloc(sizeof(char) * (count + 1));
-    if (final_hash == NULL)
-        return NULL;
-    snprintf(final_hash, count + 1, "%s", signature);
+    for (uint8_t k = 0; k < engine.end; k++) {
+        /* Last hash between last trigger point and end of the data */
+        if (blocks[k].pending)
+            blocks[k].signature[blocks[k].count++] = b64[blocks[k].hash & 0x3F];
+        blocks[k].signature[blocks[k].count] = '\0';
+    }
 
-    return final_hash;
+    return engine.end;
 }
 
 /**
@@ -223,78 +436,53 @@ char *ctph_hash(elf_data data)
     if (!data)
         return NULL;
 
-    char *hash = NULL;
-    char *hash_prec = NULL;
-    uint16_t hash_length = 0;      /* Hash with blocksize B */
-    uint16_t hash_length_prec = 0; /* Hash with blocksize B*2 */
-    uint16_t coef = 1;
-
     uint64_t B =
         MIN_BLOCK_SIZE *
         pow(2, log2(elf_get_data_size(data) /
                     (SIGN_LENGTH - MIN_BLOCK_SIZE))); /* Trigger Value */
-    B = leftmost(B) << 1; /* TODO : Check if leftmost(B) == 2^63 before << 1 */
-    uint64_t true_B;
-
-    /* while hash length is inferior to 32 : Generate hash */
-    do {
-        true_B = B / coef; /* Adjust blocksize */
-        hash = ctph_hash_engine(data, &hash_length, true_B);
-        if (hash == NULL)
-            return NULL;
-        if (hash_length < 32) {
-            if (hash_prec != NULL)
-                free(hash_prec);
-            hash_length_prec = hash_length;
-            hash_prec = hash;
-            coef *= 2;
-        }
-        if (hash_length >= SIGN_LENGTH) {
-            free(hash);
-            coef /= 2;
-        }
-    } while (hash_length < 32);
-
-    if (hash_prec == NULL) {
-        if (coef < 1)
-            hash_prec = ctph_hash_engine(data, &hash_length_prec, true_B / 2);
-        else
-            hash_prec = ctph_hash_engine(data, &hash_length_prec, true_B * 2);
-    }
-    if (hash_prec == NULL) {
-        free(hash);
+    B = leftmost(B) << 1;
+    if (B == 0 || B > UINT64_MAX / 2)
         return NULL;
-    }
 
-    /* Concatenate <block size>:<hash>:<hash_prec> */
-    uint16_t size = hash_length + hash_length_prec + 20 + 1 + 2;
-    char *final_hash = malloc(sizeof(char) * (size));
-    if (final_hash == NULL)
-        return NULL;
+    /* Signatures for the block sizes B*2, B, B/2, ..., 1 */
+    uint8_t nb_blocks = __builtin_ctzll(B) + 2;
+    block_state blocks[nb_blocks];
+    nb_blocks = ctph_hash_engine(data, B << 1, blocks, nb_blocks);
+
+    /* Take the largest block size with a hash length of at least 32 */
+    for (uint8_t k = 1; k < nb_blocks; k++) {
+        uint16_t hash_length = blocks[k].count - 1;
+        if (hash_length < 32)
+            continue;
+
+        /* Concatenate roll:<block size>:<hash>:<hash with blocksize * 2> */
+        uint16_t size = sizeof(CTPH_TAG) + blocks[k].count +
+                        blocks[k - 1].count + 20 + 2;
+        char *final_hash = malloc(sizeof(char) * (size));
+        if (final_hash == NULL)
+            return NULL;
 
-    snprintf(final_hash, size, "%" PRIu64 ":%s:%s", true_B, hash, hash_prec);
+        snprintf(final_hash, size, CTPH_TAG ":%" PRIu64 ":%s:%s",
+                 (B << 1) >> k, blocks[k].signature, blocks[k - 1].signature);
 
-    free(hash);
-    free(hash_prec);
+        return final_hash;
+    }
 
-    return final_hash;
+    return NULL;
 }
 
 /**
- * @brief this is the low level string scoring algorithm. It takes two strings
- * and scores them on a scale of 0-100 where 0 is a terrible match and
- * 100 is a great match. The block_size is used to cope with very small
- * messages.
+ * @brief Turn the edit distance of two strings in a score
+ *
+ * @param score the edit distance
+ * @param s1len length of the first string
+ * @param s2len length of the second string
+ * @param block_size block size of the strings
+ * @return uint32_t the score, between 0 and 100
  */
-static uint32_t score_strings(const char *s1, size_t s1len, const char *s2,
-                              size_t s2len, unsigned long block_size)
+static uint32_t scale_distance(uint32_t score, size_t s1len, size_t s2len,
+                               unsigned long block_size)
 {
-    uint32_t score;
-
-    // compute the edit distance between the two strings. The edit distance
-    // gives us a pretty good idea of how closely related the two strings are
-    score = edit_distn(s1, s1len, s2, s2len);
-
     // scale the edit distance by the lengths of the two
     // strings. This changes the score to be a measure of the
     // proportion of the message that has changed rather than an
@@ -325,44 +513,121 @@ static uint32_t score_strings(const char *s1, size_t s1len, const char *s2,
     return 100 - score;
 }
 
+/**
+ * @brief this is the low level string scoring algorithm. It takes two strings
+ * and scores them on a scale of 0-100 where 0 is a terrible match and
+ * 100 is a great match. The block_size is used to cope with very small
+ * messages. Return 0 without computing the edit distance if min_score can't
+ * be reached.
+ */
+static uint32_t score_strings(const char *s1, size_t s1len, const char *s2,
+                              size_t s2len, unsigned long block_size,
+                              uint32_t min_score)
+{
+    // the edit distance is between |s1len - s2len| and s1len + s2len, and
+    // scale_distance() is monotonic : the best score is at one of them
+    if (min_score > 0) {
+        size_t dist_min = (s1len > s2len) ? s1len - s2len : s2len - s1len;
+        uint32_t score_max =
+            MAX(scale_distance(dist_min, s1len, s2len, block_size),
+                scale_distance(s1len + s2len, s1len, s2len, block_size));
+        if (score_max < min_score)
+            return 0;
+    }
+
+    // compute the edit distance between the two strings. The edit distance
+    // gives us a pretty good idea of how closely related the two strings are
+    uint32_t score = edit_distn(s1, s1len, s2, s2len);
+
+    return scale_distance(score, s1len, s2len, block_size);
+}
+
 /**
  * @brief sequences contain very little information so they tend to just bias
- * the result unfairly
+ * the result unfairly. Copy the len characters of in without the sequences of
+ * more than 3 identical characters, return false if out is too small.
  */
-static int copy_eliminate_sequences(char **out, size_t outsize, char **in,
-                                    char etoken)
+static bool copy_eliminate_sequences(char out[SIGN_LENGTH], uint8_t *outlen,
+                                     const char *in, size_t len)
 {
-    size_t seq = 0;
-    char prev = **in, curr;
-    if (!prev || prev == etoken)
-        return 1;
-    if (!outsize--)
-        return 0;
-    *(*out)++ = prev;
-    ++(*in);
-    while (1) {
-        curr = **in;
-        if (!curr || curr == etoken)
-            return 1;
-        ++(*in);
-        if (curr == prev) {
-            if (++seq >= 3) {
-                seq = 3;
+    size_t seq = 0, n = 0;
+    for (size_t k = 0; k < len; k++) {
+        if (k > 0 && in[k] == in[k - 1]) {
+            if (++seq >= 3)
                 continue;
-            }
-            if (!outsize--)
-                return 0;
-            *(*out)++ = curr;
         } else {
-            if (!outsize--)
-                return 0;
-            *(*out)++ = curr;
             seq = 0;
-            prev = curr;
         }
+
+        if (n == SIGN_LENGTH)
+            return false;
+        out[n++] = in[k];
+    }
+
+    *outlen = n;
+    return true;
+}
+
+/**
+ * @brief Fill a digest with the fields of a signature
+ *
+ * @return bool false if a part is too long
+ */
+bool ctph_digest_init(ctph_digest_t *digest, uint64_t block_size,
+                      const char *part_1, size_t len_1, const char *part_2,
+                      size_t len_2)
+{
+    if (NULL == digest || NULL == part_1 || NULL == part_2)
+        return false;
+
+    // there is very little information content is sequences of
+    // the same character like 'LLLLL'. Eliminate any sequences
+    // longer than 3 while reading two pieces.
+    // This is especially important when combined with the
+    // has_common_substring() test at score_strings().
+    digest->block_size = block_size;
+    return copy_eliminate_sequences(digest->part[0], &digest->length[0],
+                                    part_1, len_1) &&
+           copy_eliminate_sequences(digest->part[1], &digest->length[1],
+                                    part_2, len_2);
+}
+
+/**
+ * @brief Parse the string "<block size>:<part 1>:<part 2>" of a signature
+ *
+ * @return bool false if the signature is malformed
+ */
+bool ctph_digest_parse(const char *str, ctph_digest_t *digest)
+{
+    uint64_t block_size;
+
+    if (NULL == str)
+        return false;
+
+    // the signatures of another rolling hash can't be compared
+    if (strncmp(str, CTPH_TAG ":", sizeof(CTPH_TAG)) != 0)
+        return false;
+    str += sizeof(CTPH_TAG);
+
+    // each spamsum is prefixed by its block size
+    if (sscanf(str, "%" PRIu64 ":", &block_size) != 1)
+        return false;
+
+    // move past the prefix
+    const char *part_1 = strchr(str, ':');
+    if (!part_1)
+        return false;
+    part_1++;
+
+    const char *part_2 = strchr(part_1, ':');
+    if (!part_2) {
+        // a signature is malformed - it doesn't have 2 parts
+        return false;
     }
-    // unreachable
-    return 0;
+    part_2++;
+
+    return ctph_digest_init(digest, block_size, part_1, part_2 - 1 - part_1,
+                            part_2, strcspn(part_2, ","));
 }
 
 /**
@@ -371,21 +636,43 @@ static int copy_eliminate_sequences(char **out, size_t outsize, char **in,
  */
 int ctph_compare(const char *str1, const char *str2)
 {
-    uint64_t block_size1, block_size2;
-    uint32_t score = 0;
-    size_t s1b1len, s1b2len, s2b1len, s2b2len;
-    char s1b1[SIGN_LENGTH], s1b2[SIGN_LENGTH];
-    char s2b1[SIGN_LENGTH], s2b2[SIGN_LENGTH];
-    char *s1p, *s2p, *tmp;
+    return ctph_compare_min(str1, str2, 0);
+}
 
-    if (NULL == str1 || NULL == str2)
+/**
+ * @brief Same as ctph_compare(), but give up as soon as min_score can't be
+ * reached.
+ */
+int ctph_compare_min(const char *str1, const char *str2, int min_score)
+{
+    ctph_digest_t digest1, digest2;
+
+    if (!ctph_digest_parse(str1, &digest1) ||
+        !ctph_digest_parse(str2, &digest2))
         return -1;
 
-    // each spamsum is prefixed by its block size
-    if (sscanf(str1, "%" PRIu64 ":", &block_size1) != 1 ||
-        sscanf(str2, "%" PRIu64 ":", &block_size2) != 1) {
+    return ctph_compare_digest(&digest1, &digest2, min_score);
+}
+
+/**
+ * @brief Same as ctph_compare_min(), on signatures already parsed : no string
+ * handling nor allocation.
+ */
+int ctph_compare_digest(const ctph_digest_t *digest1,
+                        const ctph_digest_t *digest2, int min_score)
+{
+    uint32_t score = 0;
+    uint32_t min = (min_score > 0) ? min_score : 0;
+
+    if (NULL == digest1 || NULL == digest2)
         return -1;
-    }
+
+    uint64_t block_size1 = digest1->block_size;
+    uint64_t block_size2 = digest2->block_size;
+    const char *s1b1 = digest1->part[0], *s1b2 = digest1->part[1];
+    const char *s2b1 = digest2->part[0], *s2b2 = digest2->part[1];
+    size_t s1b1len = digest1->length[0], s1b2len = digest1->length[1];
+    size_t s2b1len = digest2->length[0], s2b2len = digest2->length[1];
 
     // if the blocksizes don't match then we are comparing
     // apples to oranges. This isn't an 'error' per se. We could
@@ -396,57 +683,11 @@ int ctph_compare(const char *str1, const char *str2)
         return 0;
     }
 
-    // move past the prefix
-    s1p = strchr(str1, ':');
-    s2p = strchr(str2, ':');
-
-    if (!s1p || !s2p) {
-        // badly formed ...
-        return -1;
-    }
-
-    // there is very little information content is sequences of
-    // the same character like 'LLLLL'. Eliminate any sequences
-    // longer than 3 while reading two pieces.
-    // This is especially important when combined with the
-    // has_common_substring() test at score_strings().
-
-    // read the first digest
-    ++s1p;
-    tmp = s1b1;
-    if (!copy_eliminate_sequences(&tmp, SIGN_LENGTH, &s1p, ':'))
-        return -1;
-    s1b1len = tmp - s1b1;
-    if (!*s1p++) {
-        // a signature is malformed - it doesn't have 2 parts
-        return -1;
-    }
-    tmp = s1b2;
-    if (!copy_eliminate_sequences(&tmp, SIGN_LENGTH, &s1p, ','))
-        return -1;
-    s1b2len = tmp - s1b2;
-
-    // read the second digest
-    ++s2p;
-    tmp = s2b1;
-    if (!copy_eliminate_sequences(&tmp, SIGN_LENGTH, &s2p, ':'))
-        return -1;
-    s2b1len = tmp - s2b1;
-    if (!*s2p++) {
-        // a signature is malformed - it doesn't have 2 parts
-        return -1;
-    }
-    tmp = s2b2;
-    if (!copy_eliminate_sequences(&tmp, SIGN_LENGTH, &s2p, ','))
-        return -1;
-    s2b2len = tmp - s2b2;
-
-    // Now that we know the strings are both well formed, are they
-    // identical? We could save ourselves some work here
+    // Are the signatures identical? We could save ourselves some work here
     if (block_size1 == block_size2 && s1b1len == s2b1len &&
         s1b2len == s2b2len) {
         if (!memcmp(s1b1, s2b1, s1b1len) && !memcmp(s1b2, s2b2, s1b2len)) {
-            return 100;
+            return (min <= 100) ? 100 : 0;
         }
     }
 
@@ -456,24 +697,32 @@ int ctph_compare(const char *str1, const char *str2)
     if (block_size1 <= ULONG_MAX / 2) {
         if (block_size1 == block_size2) {
             uint32_t score1, score2;
-            score1 = score_strings(s1b1, s1b1len, s2b1, s2b1len, block_size1);
-            score2 =
-                score_strings(s1b2, s1b2len, s2b2, s2b2len, block_size1 * 2);
+            score1 = score_strings(s1b1, s1b1len, s2b1, s2b1len, block_size1,
+                                   min);
+            score2 = score_strings(s1b2, s1b2len, s2b2, s2b2len,
+                                   block_size1 * 2, min);
             score = MAX(score1, score2);
         } else if (block_size1 * 2 == block_size2) {
-            score = score_strings(s2b1, s2b1len, s1b2, s1b2len, block_size2);
+            score = score_strings(s2b1, s2b1len, s1b2, s1b2len, block_size2,
+                                  min);
         } else {
-            score = score_strings(s1b1, s1b1len, s2b2, s2b2len, block_size1);
+            score = score_strings(s1b1, s1b1len, s2b2, s2b2len, block_size1,
+                                  min);
         }
     } else {
         if (block_size1 == block_size2) {
-            score = score_strings(s1b1, s1b1len, s2b1, s2b1len, block_size1);
+            score = score_strings(s1b1, s1b1len, s2b1, s2b1len, block_size1,
+                                  min);
         } else if (block_size1 % 2 == 0 && block_size1 / 2 == block_size2) {
-            score = score_strings(s1b1, s1b1len, s2b2, s2b2len, block_size1);
+            score = score_strings(s1b1, s1b1len, s2b2, s2b2len, block_size1,
+                                  min);
         } else {
             score = 0;
         }
     }
 
+    if (score < min)
+        return 0;
+
     return (int) score;
 }
@@ -0,0 +1,225 @@
+#include "ctph_index.h"
+
+#include <stdlib.h>
+
+/* Substring of a digest at a block size */
+typedef struct {
+    uint64_t key; /* Hash of the substring and the block size */
+    uint64_t id;
+} ctph_posting_t;
+
+/*
+ * Internal structure (hiden from outside) to represent the index.
+ * The postings are sorted by key then by id : the ids sharing a substring
+ * follow each other.
+ */
+struct _ctph_index_t {
+    uint64_t nb_digests;
+    uint64_t nb_postings;
+    ctph_posting_t *postings;
+    uint64_t *first;     /* Of the positions of each id, nb_digests + 1 */
+    uint64_t *positions; /* In the postings, grouped by id */
+};
+
+/* Static Functions */
+
+/* Mix the substring (its characters packed in 56 bits) with its block size */
+static uint64_t get_key(uint64_t gram, uint64_t block_size)
+{
+    uint64_t key = (gram ^ (block_size * 0x9E3779B97F4A7C15ULL)) *
+                   0xBF58476D1CE4E5B9ULL;
+    return key ^ (key >> 31);
+}
+
+/* Number of substrings of the part k of a digest, 0 if it isn't compared */
+static uint64_t get_nb_grams(const ctph_digest_t *digest, uint8_t k)
+{
+    /* The second part is at the double block size */
+    if (k == 1 && digest->block_size > UINT64_MAX / 2)
+        return 0;
+
+    if (digest->length[k] < CTPH_INDEX_GRAM_LENGTH)
+        return 0;
+    return digest->length[k] - CTPH_INDEX_GRAM_LENGTH + 1;
+}
+
+/*
+ * Write the keys of the substrings of both parts of a digest, return their
+ * number (at most 2 * CTPH_SIGN_LENGTH)
+ */
+static uint64_t get_keys(const ctph_digest_t *digest, uint64_t keys[])
+{
+    uint64_t nb_keys = 0;
+
+    for (uint8_t part = 0; part < 2; part++) {
+        uint64_t nb_grams = get_nb_grams(digest, part);
+        if (nb_grams == 0)
+            continue;
+
+        uint64_t block_size = digest->block_size << part;
+        uint64_t gram = 0;
+        for (uint8_t c = 0; c < CTPH_INDEX_GRAM_LENGTH - 1; c++)
+            gram = (gram << 8) | (uint8_t) digest->part[part][c];
+
+        for (uint64_t g = 0; g < nb_grams; g++) {
+            uint8_t c = digest->part[part][g + CTPH_INDEX_GRAM_LENGTH - 1];
+            gram = ((gram << 8) | c) & ((1ULL << 56) - 1);
+            keys[nb_keys++] = get_key(gram, block_size);
+        }
+    }
+
+    return nb_keys;
+}
+
+/* Order of the postings : increasing key, then increasing id */
+static int compare_posting(const void *posting_1, const void *posting_2)
+{
+    const ctph_posting_t *p1 = posting_1, *p2 = posting_2;
+    if (p1->key != p2->key)
+        return (p1->key < p2->key) ? -1 : 1;
+    return (p1->id < p2->id) ? -1 : (p1->id > p2->id);
+}
+
+/* External functions */
+
+ctph_index_t *ctph_index_new(const ctph_digest_t digests[], uint64_t nb_digests,
+                             const uint64_t ids[], uint64_t nb_ids)
+{
+    if (digests == NULL || (ids == NULL && nb_ids > 0))
+        return NULL;
+
+    ctph_index_t *index = calloc(1, sizeof(ctph_index_t));
+    if (index == NULL)
+        return NULL;
+    index->nb_digests = nb_digests;
+
+    uint64_t nb_postings = 0;
+    for (uint64_t k = 0; k < nb_ids; k++) {
+        if (ids[k] >= nb_digests)
+            goto err_index;
+        nb_postings += get_nb_grams(&digests[ids[k]], 0) +
+                       get_nb_grams(&digests[ids[k]], 1);
+    }
+
+    index->postings = malloc(sizeof(ctph_posting_t) * (nb_postings + 1));
+    index->first = calloc(nb_digests + 2, sizeof(uint64_t));
+    if (index->postings == NULL || index->first == NULL)
+        goto err_index;
+
+    /* Postings of every substring of both parts */
+    for (uint64_t k = 0; k < nb_ids; k++) {
+        uint64_t keys[2 * CTPH_SIGN_LENGTH];
+        uint64_t nb_keys = get_keys(&digests[ids[k]], keys);
+
+        for (uint64_t g = 0; g < nb_keys; g++)
+            index->postings[index->nb_postings++] =
+                (ctph_posting_t){.key = keys[g], .id = ids[k]};
+    }
+
+    /* Sort, and keep each substring of an id once */
+    qsort(index->postings, index->nb_postings, sizeof(ctph_posting_t),
+          compare_posting);
+
+    uint64_t n = 0;
+    for (uint64_t p = 0; p < index->nb_postings; p++) {
+        if (n > 0 && index->postings[n - 1].key == index->postings[p].key &&
+            index->postings[n - 1].id == index->postings[p].id)
+            continue;
+        index->postings[n++] = index->postings[p];
+    }
+    index->nb_postings = n;
+
+    /* Positions of the postings of each id */
+    index->positions = malloc(sizeof(uint64_t) * (n + 1));
+    if (index->positions == NULL)
+        goto err_index;
+
+    for (uint64_t p = 0; p < n; p++)
+        index->first[index->postings[p].id + 2]++;
+    for (uint64_t id = 2; id <= nb_digests + 1; id++)
+        index->first[id] += index->first[id - 1];
+
+    /* first[id + 1] is the next position of id while filling */
+    for (uint64_t p = 0; p < n; p++)
+        index->positions[index->first[index->postings[p].id + 1]++] = p;
+
+    return index;
+
+err_index:
+    ctph_index_free(index);
+    return NULL;
+}
+
+void ctph_index_free(ctph_index_t *index)
+{
+    if (index == NULL)
+        return;
+
+    free(index->postings);
+    free(index->first);
+    free(index->positions);
+    free(index);
+}
+
+uint64_t ctph_index_candidates(const ctph_index_t *index, uint64_t id,
+                               uint64_t seen[], uint64_t candidates[])
+{
+    if (index == NULL || id >= index->nb_digests || seen == NULL ||
+        candidates == NULL)
+        return 0;
+
+    uint64_t nb_candidates = 0;
+    for (uint64_t k = index->first[id]; k < index->first[id + 1]; k++) {
+        uint64_t p = index->positions[k];
+        uint64_t key = index->postings[p].key;
+
+        /* The ids after id sharing the substring */
+        for (uint64_t q = p + 1;
+             q < index->nb_postings && index->postings[q].key == key; q++) {
+            uint64_t j = index->postings[q].id;
+            if (seen[j] == id + 1)
+                continue;
+
+            seen[j] = id + 1;
+            candidates[nb_candidates++] = j;
+        }
+    }
+
+    return nb_candidates;
+}
+
+uint64_t ctph_index_lookup(const ctph_index_t *index,
+                           const ctph_digest_t *digest, uint64_t stamp,
+                           uint64_t seen[], uint64_t candidates[])
+{
+    if (index == NULL || digest == NULL || seen == NULL || candidates == NULL)
+        return 0;
+
+    uint64_t keys[2 * CTPH_SIGN_LENGTH];
+    uint64_t nb_keys = get_keys(digest, keys);
+
+    uint64_t nb_candidates = 0;
+    for (uint64_t g = 0; g < nb_keys; g++) {
+        /* First posting of the key */
+        uint64_t low = 0, high = index->nb_postings;
+        while (low < high) {
+            uint64_t mid = low + (high - low) / 2;
+            if (index->postings[mid].key < keys[g])
+                low = mid + 1;
+            else
+                high = mid;
+        }
+
+        for (; low < index->nb_postings && index->postings[low].key == keys[g];
+             low++) {
+            uint64_t j = index->postings[low].id;
+            if (seen[j] == stamp)
+                continue;
+
+            seen[j] = stamp;
+            candidates[nb_candidates++] = j;
+        }
+    }
+
+    return nb_candidates;
+}
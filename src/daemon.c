@@ -0,0 +1,421 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "daemon.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <pthread.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define DAEMON_BACKLOG 64
+
+/* Clients being served */
+typedef struct {
+    const daemon_config_t *config;
+    int fds[DAEMON_MAX_CLIENTS];
+    uint64_t nb_clients;
+    pthread_mutex_t lock;
+    pthread_cond_t done; /* Signaled when a client leaves */
+} daemon_t;
+
+/* A client and the daemon serving it */
+typedef struct {
+    daemon_t *daemon;
+    int fd;
+} daemon_client_t;
+
+/* Set by SIGINT or SIGTERM */
+static volatile sig_atomic_t stop_wanted = 0;
+
+/* Static Functions */
+
+static void stop_handler(int sig)
+{
+    (void) sig;
+    stop_wanted = 1;
+}
+
+/*
+ * Socket listening on path. A socket left by a daemon no longer running is
+ * replaced, not the other files. Return -1 if problems.
+ */
+static int listen_socket(const char *path)
+{
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(path) >= sizeof(addr.sun_path))
+        return -1;
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+
+    struct stat info;
+    if (lstat(path, &info) == 0) {
+        if (!S_ISSOCK(info.st_mode) ||
+            connect(fd, (struct sockaddr *) &addr, sizeof(addr)) == 0 ||
+            errno != ECONNREFUSED || unlink(path) != 0)
+            goto err_fd;
+
+        /* A socket which failed to connect can't be used again */
+        close(fd);
+        if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+            return -1;
+    }
+
+    if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0)
+        goto err_fd;
+    if (listen(fd, DAEMON_BACKLOG) != 0) {
+        unlink(path);
+        goto err_fd;
+    }
+
+    return fd;
+
+err_fd:
+    close(fd);
+    return -1;
+}
+
+/* Track the client, return false if DAEMON_MAX_CLIENTS are already served */
+static bool add_client(daemon_t *daemon, int fd)
+{
+    pthread_mutex_lock(&daemon->lock);
+    bool ret = daemon->nb_clients < DAEMON_MAX_CLIENTS;
+    if (ret)
+        daemon->fds[daemon->nb_clients++] = fd;
+    pthread_mutex_unlock(&daemon->lock);
+
+    return ret;
+}
+
+/* Stop tracking the client, before its socket is closed */
+static void remove_client(daemon_t *daemon, int fd)
+{
+    pthread_mutex_lock(&daemon->lock);
+    for (uint64_t k = 0; k < daemon->nb_clients; k++)
+        if (daemon->fds[k] == fd) {
+            daemon->fds[k] = daemon->fds[--daemon->nb_clients];
+            break;
+        }
+    pthread_cond_signal(&daemon->done);
+    pthread_mutex_unlock(&daemon->lock);
+}
+
+/* Write the whole buffer to the socket, return false if problems */
+static bool send_all(int fd, const char *buffer, size_t size)
+{
+    while (size > 0) {
+        ssize_t n = send(fd, buffer, size, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+
+        buffer += n;
+        size -= n;
+    }
+
+    return true;
+}
+
+/*
+ * Write the matches of the query with the store, as tbt -q.
+ * Return false if problems.
+ */
+static bool write_matches(const daemon_config_t *config, sig_db_t *query,
+                          compare_algorithm_e algo, FILE *out)
+{
+    compare_result_t *result = sig_store_query(config->store, query, algo);
+    if (result == NULL)
+        return false;
+
+    fprintf(out, "\n%s :\n", sig_db_get_name(query, 0));
+
+    bool ret = true;
+    compare_list_t *list = &result->lists[0];
+    for (uint64_t k = 0; k < list->nb_matches; k++) {
+        uint64_t index = list->matches[k].index;
+        char *name = sig_store_get_name(config->store, index);
+        if (name == NULL) {
+            ret = false;
+            break;
+        }
+
+        if (config->cascade)
+            fprintf(out, "[ %03.f %% | %06.02f %% ] %s\n",
+                    list->matches[k].score,
+                    sig_store_simhash_score(config->store, query, 0, index),
+                    name);
+        else if (algo == COMPARE_CTPH)
+            fprintf(out, "[ %03.f %% ] %s\n", list->matches[k].score, name);
+        else
+            fprintf(out, "[ %06.02f %% ] %s\n", list->matches[k].score,
+                    name);
+        free(name);
+    }
+
+    compare_result_free(result);
+    return ret;
+}
+
+/* Write the matches of the file with the store, return false if problems */
+static bool write_query(const daemon_config_t *config, const char *name,
+                        const char *ctph, const char *simhash, FILE *out)
+{
+    sig_db_t *query = sig_db_new();
+    if (query == NULL || !sig_db_add(query, name, ctph, simhash)) {
+        sig_db_free(query);
+        return false;
+    }
+
+    bool ret = true;
+    if (config->cascade) {
+        fprintf(out, "--- CASCADE ---\n");
+        ret = write_matches(config, query, COMPARE_CTPH, out);
+    } else {
+        if (config->algorithms[COMPARE_CTPH]) {
+            fprintf(out, "--- CTPH ---\n");
+            ret = write_matches(config, query, COMPARE_CTPH, out);
+            fprintf(out, "\n");
+        }
+        if (ret && config->algorithms[COMPARE_SIMHASH]) {
+            fprintf(out, "--- SIMHASH ---\n");
+            ret = write_matches(config, query, COMPARE_SIMHASH, out);
+        }
+    }
+
+    sig_db_free(query);
+    return ret;
+}
+
+/* Write the answer of the request to out, ended by "OK" or "ERR message" */
+static void answer(const daemon_config_t *config, char *request, FILE *out)
+{
+    char *path = strchr(request, ' ');
+    if (path != NULL)
+        *path++ = '\0';
+
+    if (strcmp(request, "COUNT") == 0 && path == NULL) {
+        fprintf(out, "OK %" PRIu64 "\n", sig_store_count(config->store));
+        return;
+    }
+
+    if ((strcmp(request, "HASH") != 0 && strcmp(request, "INSERT") != 0 &&
+         strcmp(request, "QUERY") != 0) ||
+        path == NULL || *path == '\0') {
+        fprintf(out, "ERR invalid request\n");
+        return;
+    }
+
+    char *name, *ctph, *simhash;
+    if (!config->hash(path, &name, &ctph, &simhash)) {
+        fprintf(out, "ERR can't hash '%s'\n", path);
+        return;
+    }
+
+    if (strcmp(request, "HASH") == 0) {
+        fprintf(out, "%s:\n", name);
+        if (ctph != NULL)
+            fprintf(out, "\t1:%s\n", ctph);
+        if (simhash != NULL)
+            fprintf(out, "\t2:%s\n", simhash);
+        fprintf(out, "OK\n");
+    } else if (strcmp(request, "INSERT") == 0) {
+        uint64_t index = sig_store_add(config->store, name, ctph, simhash);
+        if (index == UINT64_MAX)
+            fprintf(out, "ERR can't insert '%s'\n", path);
+        else
+            fprintf(out, "OK %" PRIu64 "\n", index);
+    } else if (write_query(config, name, ctph, simhash, out))
+        fprintf(out, "OK\n");
+    else
+        fprintf(out, "ERR comparision malloc!\n");
+
+    free(name);
+    free(ctph);
+    free(simhash);
+}
+
+/* Answer the requests of a client until it leaves */
+static void *serve_client(void *arg)
+{
+    daemon_client_t *client = arg;
+    daemon_t *daemon = client->daemon;
+    int fd = client->fd;
+    free(client);
+
+    /* The request, its end of line and the ending '\0' */
+    char line[DAEMON_MAX_REQUEST_LENGTH + 3];
+    FILE *in = fdopen(fd, "r");
+    while (in != NULL && fgets(line, sizeof(line), in) != NULL) {
+        size_t len = strlen(line);
+        bool complete = len > 0 && line[len - 1] == '\n';
+
+        /* Remove the end of line */
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+            line[--len] = '\0';
+
+        /* The rest of a line too long is skipped, not kept in memory */
+        bool too_long = len > DAEMON_MAX_REQUEST_LENGTH;
+        if (!complete && too_long) {
+            int c;
+            while ((c = getc(in)) != EOF && c != '\n')
+                ;
+        }
+
+        /* Answered at once */
+        char *response = NULL;
+        size_t size = 0;
+        FILE *out = open_memstream(&response, &size);
+        if (out == NULL)
+            break;
+        if (too_long)
+            fprintf(out, "ERR request too long\n");
+        else
+            answer(daemon->config, line, out);
+        fclose(out);
+
+        bool sent = send_all(fd, response, size);
+        free(response);
+        if (!sent)
+            break;
+    }
+
+    remove_client(daemon, fd);
+    if (in != NULL)
+        fclose(in);
+    else
+        close(fd);
+
+    return NULL;
+}
+
+/*
+ * Serve the client by a new thread, which inherits the signals stopping the
+ * daemon blocked. Return false if problems.
+ */
+static bool start_client(daemon_t *daemon, int fd)
+{
+    daemon_client_t *client = malloc(sizeof(daemon_client_t));
+    if (client == NULL)
+        return false;
+    client->daemon = daemon;
+    client->fd = fd;
+
+    if (!add_client(daemon, fd)) {
+        static const char refused[] = "ERR too many clients\n";
+        send_all(fd, refused, sizeof(refused) - 1);
+        free(client);
+        return false;
+    }
+
+    pthread_t thread;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    bool ret = pthread_create(&thread, &attr, serve_client, client) == 0;
+    pthread_attr_destroy(&attr);
+
+    if (!ret) {
+        remove_client(daemon, fd);
+        free(client);
+    }
+    return ret;
+}
+
+/* External functions */
+
+bool daemon_run(const daemon_config_t *config)
+{
+    if (config == NULL || config->socket_path == NULL ||
+        config->store == NULL || config->hash == NULL)
+        return false;
+
+    int fd = listen_socket(config->socket_path);
+    if (fd < 0)
+        return false;
+
+    /* accept() only follows pselect() : it mustn't wait for a client gone */
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    daemon_t daemon = {.config = config};
+    pthread_mutex_init(&daemon.lock, NULL);
+    pthread_cond_init(&daemon.done, NULL);
+
+    /*
+     * The signals are blocked but while pselect() waits : one coming between
+     * the check of stop_wanted and the wait interrupts the wait
+     */
+    sigset_t stop_signals, old_mask, wait_mask;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, &old_mask);
+    wait_mask = old_mask;
+    sigdelset(&wait_mask, SIGINT);
+    sigdelset(&wait_mask, SIGTERM);
+
+    struct sigaction action = {.sa_handler = stop_handler};
+    sigemptyset(&action.sa_mask);
+    struct sigaction old_int, old_term;
+    sigaction(SIGINT, &action, &old_int);
+    sigaction(SIGTERM, &action, &old_term);
+
+    bool ret = true;
+    stop_wanted = 0;
+    while (!stop_wanted) {
+        fd_set fds;
+        FD_ZERO(&fds);
+        FD_SET(fd, &fds);
+        if (pselect(fd + 1, &fds, NULL, NULL, NULL, &wait_mask) < 0) {
+            if (errno == EINTR)
+                continue;
+            ret = false;
+            break;
+        }
+
+        int client = accept(fd, NULL, NULL);
+        if (client < 0) {
+            if (errno == EINTR || errno == ECONNABORTED || errno == EAGAIN ||
+                errno == EWOULDBLOCK)
+                continue;
+            ret = false;
+            break;
+        }
+
+        /* The client is dropped if it can't be served, it reads blocking */
+        fcntl(client, F_SETFL, fcntl(client, F_GETFL) & ~O_NONBLOCK);
+        if (!start_client(&daemon, client))
+            close(client);
+    }
+
+    close(fd);
+    unlink(config->socket_path);
+
+    /* The clients stop at their next request */
+    pthread_mutex_lock(&daemon.lock);
+    for (uint64_t k = 0; k < daemon.nb_clients; k++)
+        shutdown(daemon.fds[k], SHUT_RDWR);
+    while (daemon.nb_clients > 0)
+        pthread_cond_wait(&daemon.done, &daemon.lock);
+    pthread_mutex_unlock(&daemon.lock);
+
+    /* A signal pending since the loop stopped still goes to stop_handler() */
+    pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+    sigaction(SIGINT, &old_int, NULL);
+    sigaction(SIGTERM, &old_term, NULL);
+    pthread_cond_destroy(&daemon.done);
+    pthread_mutex_destroy(&daemon.lock);
+    return ret;
+}
@@ -13,6 +13,8 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #define EDIT_DISTN_MAXLEN 64 /* MAX_SPAMSUM */
 #define EDIT_DISTN_INSERT_COST 1
@@ -21,15 +23,23 @@
 
 #define MIN(x, y) ((x) < (y) ? (x) : (y))
 
-int edit_distn(const char *s1, size_t s1len, const char *s2, size_t s2len)
+/*
+ * Dynamic programming over two rows of s2len + 1 costs. Without memory for
+ * them, the strings are taken as having nothing in common.
+ */
+static int edit_distn_dp(const char *s1, size_t s1len, const char *s2,
+                         size_t s2len)
 {
-    int t[2][EDIT_DISTN_MAXLEN + 1];
-    int *t1 = t[0];
-    int *t2 = t[1];
+    int *t = malloc(sizeof(int) * 2 * (s2len + 1));
+    if (t == NULL)
+        return s1len * EDIT_DISTN_INSERT_COST + s2len * EDIT_DISTN_REMOVE_COST;
+
+    int *t1 = t;
+    int *t2 = t + s2len + 1;
     int *t3;
     size_t i1, i2;
     for (i2 = 0; i2 <= s2len; i2++)
-        t[0][i2] = i2 * EDIT_DISTN_REMOVE_COST;
+        t1[i2] = i2 * EDIT_DISTN_REMOVE_COST;
     for (i1 = 0; i1 < s1len; i1++) {
         t2[0] = (i1 + 1) * EDIT_DISTN_INSERT_COST;
         for (i2 = 0; i2 < s2len; i2++) {
@@ -43,5 +53,48 @@ int edit_distn(const char *s1, size_t s1len, const char *s2, size_t s2len)
         t1 = t2;
         t2 = t3;
     }
-    return t1[s2len];
+
+    int distance = t1[s2len];
+    free(t);
+    return distance;
+}
+
+/*
+ * Length of the longest common subsequence, with the bit-vector algorithm of
+ * Allison-Dix / Hyyro : a whole row of the table is kept in one word.
+ * s1len must not exceed EDIT_DISTN_MAXLEN
+ */
+static int lcs_bitvector(const char *s1, size_t s1len, const char *s2,
+                         size_t s2len)
+{
+    uint64_t match[256]; /* Positions of each character in s1 */
+    uint64_t row = ~(uint64_t) 0;
+    size_t i;
+
+    memset(match, 0, sizeof(match));
+    for (i = 0; i < s1len; i++)
+        match[(uint8_t) s1[i]] |= (uint64_t) 1 << i;
+
+    for (i = 0; i < s2len; i++) {
+        uint64_t u = row & match[(uint8_t) s2[i]];
+        row = (row + u) | (row - u);
+    }
+
+    if (s1len < EDIT_DISTN_MAXLEN)
+        row |= ~(uint64_t) 0 << s1len;
+    return __builtin_popcountll(~row);
+}
+
+int edit_distn(const char *s1, size_t s1len, const char *s2, size_t s2len)
+{
+    /*
+     * Replacing costs as much as removing then inserting, so the distance is
+     * the number of characters outside of the longest common subsequence
+     */
+    if (s1len <= EDIT_DISTN_MAXLEN)
+        return s1len + s2len - 2 * lcs_bitvector(s1, s1len, s2, s2len);
+    if (s2len <= EDIT_DISTN_MAXLEN)
+        return s1len + s2len - 2 * lcs_bitvector(s2, s2len, s1, s1len);
+
+    return edit_distn_dp(s1, s1len, s2, s2len);
 }
@@ -1,11 +1,16 @@
 
+#define _POSIX_C_SOURCE 200809L
+
 #include "elf_manager.h"
 
+#include <stddef.h>
 #include <stdlib.h>
 
 #include <libelf/elf.h>
 
 #include <ctype.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 /* clang-format off */
 char* SECTION_NAME[SECTION_END] =
@@ -20,6 +25,20 @@ char* SECTION_NAME[SECTION_END] =
 };
 /* clang-format on */
 
+/* Backing storage of an elf_data, hidden in front of the sections */
+typedef struct {
+    uint8_t *map;     /* Mapping of the file, NULL if sections are copies */
+    uint64_t map_len; /* Length of the mapping */
+    section_data sections[SECTION_END];
+} elf_storage;
+
+/* Return the storage which holds the sections of data */
+static elf_storage *get_storage(elf_data data)
+{
+    return (elf_storage *) ((uint8_t *) data -
+                            offsetof(elf_storage, sections));
+}
+
 /* Check if the file is an ELF file */
 bool elf_check_header(FILE *fd)
 {
@@ -31,32 +50,113 @@ bool elf_check_header(FILE *fd)
     return true;
 }
 
+/*
+ * Locate all the sections of SECTION_NAME in the ELF file, parsing its headers
+ * only once. Return false if the file is not a valid ELF file.
+ */
+static bool locate_sections(FILE *elf_fd, Sect sects[SECTION_END])
+{
+    Fhdr fhdr;
+    int ret = readelfsects(elf_fd, SECTION_NAME, SECTION_END, sects, &fhdr);
+    freeelf(&fhdr);
+
+    return ret == 0;
+}
+
+/* Read size bytes at offset in the file, NULL if any problems */
+static uint8_t *read_section(FILE *elf_fd, uint64_t offset, uint64_t size)
+{
+    uint8_t *buf = malloc(size);
+    if (buf == NULL)
+        return NULL;
+
+    if (fseek(elf_fd, offset, SEEK_SET) < 0 ||
+        fread(buf, size, 1, elf_fd) != 1) {
+        free(buf);
+        return NULL;
+    }
+
+    return buf;
+}
+
 /* Get all the section data of an ELF file */
 elf_data elf_get_data(FILE *elf_fd)
 {
     if (elf_fd == NULL)
         return NULL;
-    if (!elf_check_header(elf_fd))
-        return NULL;
 
-    Fhdr fhdr;
-    uint8_t *buf;
-    uint64_t len;
+    Sect sects[SECTION_END];
+    if (!locate_sections(elf_fd, sects))
+        return NULL;
 
-    elf_data data = malloc(sizeof(section_data) * SECTION_END);
-    if (!data)
+    elf_storage *storage = malloc(sizeof(elf_storage));
+    if (!storage)
         return NULL;
+    storage->map = NULL;
+    storage->map_len = 0;
+
+    elf_data data = storage->sections;
 
     for (uint8_t i = 0; i < SECTION_END; i++) {
-        buf = readelfsection(elf_fd, SECTION_NAME[i], &len, &fhdr);
-        if (!buf) {
-            data[i].data = NULL;
-            data[i].len = 0;
-        } else {
+        data[i].data = NULL;
+        data[i].len = 0;
+
+        if (!sects[i].size)
+            continue;
+
+        uint8_t *buf = read_section(elf_fd, sects[i].offset, sects[i].size);
+        if (buf) {
             data[i].data = buf;
-            data[i].len = len;
+            data[i].len = sects[i].size;
+        }
+    }
+
+    return data;
+}
+
+/*
+ * Map the ELF file in memory and get all its section data.
+ * The sections are read-only views into the mapping, which stays valid after
+ * elf_fd is closed and until elf_free() is called.
+ */
+elf_data elf_map_data(FILE *elf_fd)
+{
+    if (elf_fd == NULL)
+        return NULL;
+
+    Sect sects[SECTION_END];
+    if (!locate_sections(elf_fd, sects))
+        return NULL;
+
+    struct stat info;
+    if (fstat(fileno(elf_fd), &info) != 0 || info.st_size <= 0)
+        return NULL;
+
+    elf_storage *storage = malloc(sizeof(elf_storage));
+    if (!storage)
+        return NULL;
+
+    storage->map_len = info.st_size;
+    storage->map = mmap(NULL, storage->map_len, PROT_READ, MAP_PRIVATE,
+                        fileno(elf_fd), 0);
+    if (storage->map == MAP_FAILED) {
+        free(storage);
+        return NULL;
+    }
+    posix_madvise(storage->map, storage->map_len, POSIX_MADV_SEQUENTIAL);
+
+    elf_data data = storage->sections;
+
+    for (uint8_t i = 0; i < SECTION_END; i++) {
+        data[i].data = NULL;
+        data[i].len = 0;
+
+        /* Sections running past the end of the file are ignored */
+        if (sects[i].size && sects[i].offset <= storage->map_len &&
+            sects[i].size <= storage->map_len - sects[i].offset) {
+            data[i].data = storage->map + sects[i].offset;
+            data[i].len = sects[i].size;
         }
-        freeelf(&fhdr);
     }
 
     return data;
@@ -67,10 +167,15 @@ void elf_free(elf_data data)
     if (!data)
         return;
 
-    for (uint8_t i = 0; i < SECTION_END; i++)
-        if (data[i].len)
-            free(data[i].data);
-    free(data);
+    elf_storage *storage = get_storage(data);
+
+    if (storage->map != NULL)
+        munmap(storage->map, storage->map_len);
+    else
+        for (uint8_t i = 0; i < SECTION_END; i++)
+            if (data[i].len)
+                free(data[i].data);
+    free(storage);
 }
 
 void elf_print_section(section_data data, section_e section)
@@ -0,0 +1,152 @@
+#include "shard.h"
+
+#include <inttypes.h>
+#include <string.h>
+
+/* clang-format off */
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325 /* Initial value of the FNV hash */
+#define FNV_PRIME 0x100000001b3             /* Prime number */
+/* clang-format on */
+
+/* Static Functions */
+
+/* FNV-1a hash of size bytes, following the bytes hashed in hash */
+static uint64_t fnv_update(uint64_t hash, const void *data, size_t size)
+{
+    const uint8_t *bytes = data;
+    for (size_t i = 0; i < size; i++)
+        hash = (hash ^ bytes[i]) * FNV_PRIME;
+
+    return hash;
+}
+
+/* External functions */
+
+uint64_t shard_fingerprint(const sig_db_t *db)
+{
+    if (db == NULL)
+        return 0;
+
+    uint64_t hash = FNV_OFFSET_BASIS;
+    for (uint64_t i = 0; i < db->nb_entries; i++) {
+        const sig_db_entry_t *entry = &db->entries[i];
+        const char *name = sig_db_get_name(db, i);
+        hash = fnv_update(hash, name, strlen(name) + 1);
+        hash = fnv_update(hash, &entry->flags, sizeof(entry->flags));
+
+        char ctph[SIG_DB_CTPH_MAX_LENGTH + 1];
+        if (sig_db_get_ctph(db, i, ctph))
+            hash = fnv_update(hash, ctph, strlen(ctph) + 1);
+
+        if (entry->flags & SIG_DB_SIMHASH) {
+            hash = fnv_update(hash, &entry->shingle_hash,
+                              sizeof(entry->shingle_hash));
+            hash = fnv_update(hash, db->simhash[i], SIMHASH_SIZE);
+        }
+    }
+
+    return hash;
+}
+
+bool shard_same_options(const shard_header_t *header_1,
+                        const shard_header_t *header_2)
+{
+    return header_1->top == header_2->top &&
+           header_1->min_score == header_2->min_score &&
+           header_1->ctph_index == header_2->ctph_index &&
+           header_1->simhash_radius == header_2->simhash_radius &&
+           header_1->cascade == header_2->cascade;
+}
+
+bool shard_write_header(FILE *out, const shard_header_t *header)
+{
+    if (out == NULL || header == NULL)
+        return false;
+
+    /* 9 digits : the minimum score is read back exactly */
+    return fprintf(out,
+                   "%s %d %" PRIu64 " %" PRIu64 " %" PRIu64 " %016" PRIx64
+                   " %" PRIu64 " %.9g %d %d %d\n",
+                   SHARD_MAGIC, SHARD_VERSION, header->shard,
+                   header->nb_shards, header->nb_files, header->fingerprint,
+                   header->top, header->min_score, header->ctph_index,
+                   header->simhash_radius, header->cascade) > 0;
+}
+
+bool shard_read_header(FILE *in, shard_header_t *header)
+{
+    if (in == NULL || header == NULL)
+        return false;
+
+    char magic[sizeof(SHARD_MAGIC)];
+    int version, ctph_index, cascade;
+    if (fscanf(in, "%8s %d", magic, &version) != 2 ||
+        strcmp(magic, SHARD_MAGIC) != 0 || version != SHARD_VERSION)
+        return false;
+
+    if (fscanf(in,
+               "%" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNx64 " %" SCNu64
+               " %f %d %d %d",
+               &header->shard, &header->nb_shards, &header->nb_files,
+               &header->fingerprint, &header->top, &header->min_score,
+               &ctph_index, &header->simhash_radius, &cascade) != 9)
+        return false;
+    header->ctph_index = ctph_index;
+    header->cascade = cascade;
+
+    return header->shard < header->nb_shards;
+}
+
+bool shard_write_matches(FILE *out, const char *name,
+                         const compare_result_t *result)
+{
+    if (out == NULL || name == NULL || result == NULL ||
+        strlen(name) > SHARD_NAME_LENGTH)
+        return false;
+
+    uint64_t nb_matches = 0;
+    for (uint64_t i = 0; i < result->nb_files; i++)
+        nb_matches += result->lists[i].nb_matches;
+
+    if (fprintf(out, "%s %" PRIu64 "\n", name, nb_matches) < 0)
+        return false;
+
+    /* 9 digits : the float scores are read back exactly */
+    for (uint64_t i = 0; i < result->nb_files; i++) {
+        const compare_list_t *list = &result->lists[i];
+        for (uint64_t k = 0; k < list->nb_matches; k++)
+            if (fprintf(out, "%" PRIu64 " %" PRIu64 " %.9g\n", i,
+                        list->matches[k].index, list->matches[k].score) < 0)
+                return false;
+    }
+
+    return true;
+}
+
+bool shard_read_matches(FILE *in, const char *name, compare_result_t *result,
+                        float min_score, uint64_t top)
+{
+    if (in == NULL || name == NULL || result == NULL)
+        return false;
+
+    char section[SHARD_NAME_LENGTH + 1];
+    uint64_t nb_matches;
+    if (fscanf(in, "%15s %" SCNu64, section, &nb_matches) != 2 ||
+        strcmp(section, name) != 0)
+        return false;
+
+    for (uint64_t m = 0; m < nb_matches; m++) {
+        uint64_t i, index;
+        float score;
+        if (fscanf(in, "%" SCNu64 " %" SCNu64 " %f", &i, &index, &score) != 3 ||
+            i >= result->nb_files || index >= result->nb_files)
+            return false;
+
+        if (score < min_score)
+            continue;
+        if (!compare_result_add(result, i, index, score, top))
+            return false;
+    }
+
+    return true;
+}
@@ -2,54 +2,91 @@
 
 #include <stdio.h>
 #include <stdlib.h>
-
-/* Internal structure (hiden from outside) to represent a hash table */
+#include <string.h>
+
+/* Slot of the table : its digest, all zero if the slot is unused */
+typedef struct {
+    uint8_t md5_digest[MD5_LENGTH];
+} slot_t;
+
+/* Bytes hashed into a digest, only read back by remove_first() and next() */
+typedef struct {
+    uint8_t *buffer;
+    uint64_t buffer_size;
+} slot_buffer_t;
+
+/*
+ * Internal structure (hiden from outside) to represent a hash table.
+ * The digests are stored in the slots themselves, with linear probing, and
+ * their buffers aside : the probes only read 16 bytes per slot. The number
+ * of slots is a power of 2 keeping the load factor under 3/4.
+ */
 struct _shingle_table_t {
     uint64_t size;
     uint64_t elt_count;
-    uint64_t index_first;
+    uint64_t index_first; /* First used slot */
+
+    uint64_t mask; /* Number of slots - 1 */
+    slot_t *slots;
+    slot_buffer_t *buffers;
 
-    shingle_t **table;
+    /* The all-zero digest can't be stored in a slot : it comes after them */
+    bool zero_used;
+    slot_buffer_t zero_buffer;
 };
 
+static const uint8_t ZERO_DIGEST[MD5_LENGTH] = {0};
+
 /* Static Functions */
-static uint64_t get_hash(uint8_t md5_digest[MD5_LENGTH], uint64_t table_size)
+static uint64_t get_hash(uint8_t md5_digest[MD5_LENGTH], uint64_t mask)
 {
-    uint64_t hash = 1;
+    /* The digest is uniformly distributed : use its first bytes */
+    uint64_t hash;
+    memcpy(&hash, md5_digest, sizeof(hash));
 
-    for (uint64_t i = 0; i < MD5_LENGTH; i++)
-        hash *= md5_digest[i];
-    hash %= table_size;
-
-    for (uint64_t i = 0; i < MD5_LENGTH; i++)
-        hash += md5_digest[i];
-    hash %= table_size;
-
-    return hash;
+    return hash & mask;
 }
 
 static bool is_md5_equal(uint8_t md5_digest_1[MD5_LENGTH],
                          uint8_t md5_digest_2[MD5_LENGTH])
 {
-    for (uint64_t i = 0; i < MD5_LENGTH; i++)
-        if (md5_digest_1[i] != md5_digest_2[i])
-            return false;
+    return memcmp(md5_digest_1, md5_digest_2, MD5_LENGTH) == 0;
+}
 
-    return true;
+static bool is_md5_zero(const uint8_t md5_digest[MD5_LENGTH])
+{
+    uint64_t words[2];
+    memcpy(words, md5_digest, MD5_LENGTH);
+
+    return (words[0] | words[1]) == 0;
 }
 
-static void copy_md5(uint8_t src[MD5_LENGTH], uint8_t dest[MD5_LENGTH])
+static bool is_used(const shingle_table_t *table, uint64_t index)
 {
-    for (uint8_t i = 0; i < MD5_LENGTH; i++)
-        dest[i] = src[i];
+    return !is_md5_zero(table->slots[index].md5_digest);
 }
 
-static shingle_t *shingle_malloc(void)
+/* Shingle of the digest and the buffer */
+static shingle_t get_shingle(const uint8_t md5_digest[MD5_LENGTH],
+                             slot_buffer_t buffer)
 {
-    shingle_t *shingle = malloc(sizeof(shingle_t));
+    shingle_t shingle = {.buffer = buffer.buffer,
+                         .buffer_size = buffer.buffer_size};
+    memcpy(shingle.md5_digest, md5_digest, MD5_LENGTH);
+
     return shingle;
 }
 
+/* Number of slots needed for size shingles */
+static uint64_t get_nb_slots(uint64_t size)
+{
+    uint64_t nb_slots = 1;
+    while (nb_slots - nb_slots / 4 < size)
+        nb_slots <<= 1;
+
+    return nb_slots;
+}
+
 /* External functions */
 shingle_table_t *shingle_table_malloc(uint64_t size)
 {
@@ -60,22 +97,29 @@ shingle_table_t *shingle_table_malloc(uint64_t size)
     if (table == NULL)
         goto err_table;
 
-    table->table = malloc(sizeof(shingle_t *) * size);
-    if (table->table == NULL)
-        goto err_table_shingle;
+    uint64_t nb_slots = get_nb_slots(size);
+
+    /* Init all slots to unused */
+    table->slots = calloc(nb_slots, sizeof(slot_t));
+    if (table->slots == NULL)
+        goto err_table_slots;
+
+    table->buffers = malloc(sizeof(slot_buffer_t) * nb_slots);
+    if (table->buffers == NULL)
+        goto err_table_buffers;
 
     table->size = size;
     table->elt_count = 0;
     table->index_first = (uint64_t) -1;
-
-    /* Init all elements to NULL */
-    for (uint64_t i = 0; i < size; i++)
-        table->table[i] = NULL;
+    table->mask = nb_slots - 1;
+    table->zero_used = false;
 
     return table;
 
     /* Errors */
-err_table_shingle:
+err_table_buffers:
+    free(table->slots);
+err_table_slots:
     free(table);
 err_table:
     return NULL;
@@ -93,10 +137,9 @@ uint8_t shingle_table_expand_size(shingle_table_t **table)
 
     /* Insert shingle from previous table to the new table */
     shingle_t sh;
-    while (!shingle_table_is_empty(old_table)) {
-        shingle_table_remove_first(old_table, &sh);
+    uint64_t index = 0;
+    while (shingle_table_next(old_table, &index, &sh))
         shingle_table_insert(new_table, sh);
-    }
 
     shingle_table_free(old_table);
 
@@ -110,16 +153,8 @@ void shingle_table_free(shingle_table_t *table)
     if (table == NULL)
         return;
 
-    if (table->table != NULL) {
-
-        if (!shingle_table_is_empty(table))
-            for (uint64_t i = 0; i < table->size; i++)
-                if (table->table[i] != NULL)
-                    free(table->table[i]);
-
-        free(table->table);
-    }
-
+    free(table->slots);
+    free(table->buffers);
     free(table);
 }
 
@@ -155,37 +190,35 @@ uint8_t shingle_table_insert(shingle_table_t *table, shingle_t shingle)
 {
     if (table == NULL)
         return ERROR_INSERT;
-
     if (shingle_table_is_full(table))
         return ERROR_TABLE_FULL_INSERT;
 
+    slot_buffer_t buffer = {shingle.buffer, shingle.buffer_size};
+    if (is_md5_zero(shingle.md5_digest)) {
+        if (table->zero_used)
+            return NO_INSERT;
+
+        table->zero_used = true;
+        table->zero_buffer = buffer;
+        (table->elt_count)++;
+        return SUCCESSFUL_INSERT;
+    }
+
     /* Compute index */
-    uint64_t index = get_hash(shingle.md5_digest, table->size);
+    uint64_t index = get_hash(shingle.md5_digest, table->mask);
 
     /* Find an available index */
-    uint64_t new_ind;
-    bool found = false;
-    for (uint64_t i = index; !found; i = (i + 1) % table->size) {
-        if (table->table[i] == NULL) {
-            new_ind = i;
-            found = true;
-        } else if (is_md5_equal(shingle.md5_digest,
-                                table->table[i]->md5_digest))
+    for (; is_used(table, index); index = (index + 1) & table->mask)
+        if (is_md5_equal(shingle.md5_digest, table->slots[index].md5_digest))
             return NO_INSERT;
-    }
 
     /* Insert in the table */
-    table->table[new_ind] = shingle_malloc();
-    if (table->table[new_ind] == NULL)
-        return ERROR_INSERT;
-
-    copy_md5(shingle.md5_digest, table->table[new_ind]->md5_digest);
-    table->table[new_ind]->buffer = shingle.buffer;
-    table->table[new_ind]->buffer_size = shingle.buffer_size;
+    memcpy(table->slots[index].md5_digest, shingle.md5_digest, MD5_LENGTH);
+    table->buffers[index] = buffer;
 
     (table->elt_count)++;
-    if (new_ind < table->index_first)
-        table->index_first = new_ind;
+    if (index < table->index_first)
+        table->index_first = index;
 
     return SUCCESSFUL_INSERT;
 }
@@ -197,26 +230,72 @@ uint8_t shingle_table_remove_first(shingle_table_t *table, shingle_t *shingle)
     if (shingle_table_is_empty(table))
         return ERROR_REMOVE;
 
-    shingle_t *sh = table->table[table->index_first];
-    copy_md5(sh->md5_digest, shingle->md5_digest);
-    shingle->buffer = sh->buffer;
-    shingle->buffer_size = sh->buffer_size;
+    /* The all-zero digest is the last one */
+    if (table->index_first == (uint64_t) -1) {
+        *shingle = get_shingle(ZERO_DIGEST, table->zero_buffer);
+        table->zero_used = false;
+        (table->elt_count)--;
+        return SUCCESSFUL_REMOVE;
+    }
 
-    /* Remove shingle from table */
-    free(sh);
-    table->table[table->index_first] = NULL;
+    uint64_t hole = table->index_first;
+    *shingle = get_shingle(table->slots[hole].md5_digest, table->buffers[hole]);
+
+    /*
+     * Remove shingle from table : the following shingles of the cluster are
+     * moved back so that none is separated from its index by an unused slot
+     */
+    for (uint64_t i = (hole + 1) & table->mask; is_used(table, i);
+         i = (i + 1) & table->mask) {
+        uint64_t index = get_hash(table->slots[i].md5_digest, table->mask);
+        if (((i - index) & table->mask) >= ((i - hole) & table->mask)) {
+            table->slots[hole] = table->slots[i];
+            table->buffers[hole] = table->buffers[i];
+            hole = i;
+        }
+    }
+    memset(&table->slots[hole], 0, sizeof(slot_t));
     (table->elt_count)--;
 
-    /* Find new first element */
-    if (shingle_table_is_empty(table)) {
+    /*
+     * Find new first element : no shingle is moved before the first one, as
+     * the slots before it are unused
+     */
+    if (table->elt_count == (uint64_t) table->zero_used) {
         table->index_first = (uint64_t) -1;
     } else {
-        uint64_t i = (table->index_first + 1) % table->size;
-        while (table->table[i] == NULL)
-            i = (i + 1) % table->size;
+        uint64_t i = table->index_first;
+        while (!is_used(table, i))
+            i++;
 
         table->index_first = i;
     }
 
     return SUCCESSFUL_REMOVE;
-}
\ No newline at end of file
+}
+
+bool shingle_table_next(shingle_table_t *table, uint64_t *index,
+                        shingle_t *shingle)
+{
+    if (table == NULL || index == NULL || shingle == NULL)
+        return false;
+
+    for (uint64_t i = *index; i <= table->mask; i++) {
+        if (is_used(table, i)) {
+            *shingle = get_shingle(table->slots[i].md5_digest,
+                                   table->buffers[i]);
+            *index = i + 1;
+            return true;
+        }
+    }
+
+    /* The all-zero digest is after the slots */
+    if (table->zero_used && *index <= table->mask + 1) {
+        *shingle = get_shingle(ZERO_DIGEST, table->zero_buffer);
+        *index = table->mask + 2;
+        return true;
+    }
+
+    *index = table->mask + 2;
+    return false;
+}
@@ -0,0 +1,446 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "sig_db.h"
+
+#include <stdlib.h>
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SIG_DB_ALIGN 8
+#define SIG_DB_DEFAULT_CAPACITY 64
+#define SIG_DB_DEFAULT_NAMES_CAPACITY 4096
+
+/* The layout of the records is the file format */
+_Static_assert(sizeof(sig_db_header_t) == 64, "sig_db_header_t layout");
+_Static_assert(sizeof(sig_db_entry_t) == 16, "sig_db_entry_t layout");
+_Static_assert(sizeof(sig_db_ctph_t) == 136, "sig_db_ctph_t layout");
+
+/* Static Functions */
+
+static uint64_t align(uint64_t offset)
+{
+    return (offset + SIG_DB_ALIGN - 1) & ~(uint64_t)(SIG_DB_ALIGN - 1);
+}
+
+/* Make room for one more entry */
+static bool grow_entries(sig_db_t *db)
+{
+    if (db->nb_entries < db->capacity)
+        return true;
+
+    uint64_t capacity =
+        db->capacity ? db->capacity * 2 : SIG_DB_DEFAULT_CAPACITY;
+
+    sig_db_entry_t *entries =
+        realloc(db->entries, sizeof(sig_db_entry_t) * capacity);
+    if (entries == NULL)
+        return false;
+    db->entries = entries;
+
+    uint8_t(*simhash)[SIMHASH_SIZE] =
+        realloc(db->simhash, SIMHASH_SIZE * capacity);
+    if (simhash == NULL)
+        return false;
+    db->simhash = simhash;
+
+    sig_db_ctph_t *ctph = realloc(db->ctph, sizeof(sig_db_ctph_t) * capacity);
+    if (ctph == NULL)
+        return false;
+    db->ctph = ctph;
+
+    db->capacity = capacity;
+    return true;
+}
+
+/* Add a name to the pool, return its offset or UINT64_MAX if problems */
+static uint64_t add_name(sig_db_t *db, const char *name, uint64_t length)
+{
+    if (db->names_size + length + 1 > db->names_capacity) {
+        uint64_t capacity = db->names_capacity ? db->names_capacity
+                                               : SIG_DB_DEFAULT_NAMES_CAPACITY;
+        while (db->names_size + length + 1 > capacity)
+            capacity *= 2;
+
+        char *names = realloc(db->names, capacity);
+        if (names == NULL)
+            return UINT64_MAX;
+        db->names = names;
+        db->names_capacity = capacity;
+    }
+
+    uint64_t offset = db->names_size;
+    memcpy(&db->names[offset], name, length);
+    db->names[offset + length] = '\0';
+    db->names_size += length + 1;
+
+    return offset;
+}
+
+/*
+ * Split a CTPH string "roll:<block size>:<sign 1>:<sign 2>" in its fields. The
+ * signatures without the tag, of another rolling hash, are malformed.
+ */
+static bool parse_ctph(const char *string, sig_db_ctph_t *ctph)
+{
+    memset(ctph, 0, sizeof(sig_db_ctph_t));
+
+    if (strncmp(string, CTPH_TAG ":", sizeof(CTPH_TAG)) != 0)
+        return false;
+    string += sizeof(CTPH_TAG);
+
+    if (string[0] < '0' || string[0] > '9')
+        return false;
+
+    char *end;
+    unsigned long block_size = strtoul(string, &end, 10);
+    if (*end != ':' || block_size > UINT32_MAX)
+        return false;
+    ctph->block_size = block_size;
+
+    const char *sign = end + 1;
+    for (uint8_t k = 0; k < 2; k++) {
+        size_t length = (k == 0) ? strcspn(sign, ":") : strlen(sign);
+        if (length > SIG_DB_CTPH_LENGTH || (k == 0 && sign[length] != ':'))
+            return false;
+
+        memcpy(ctph->signature[k], sign, length);
+        ctph->length[k] = length;
+        sign += length + 1;
+    }
+
+    return true;
+}
+
+/* Write size bytes of data at offset, after zeros from *position */
+static bool write_part(FILE *out, uint64_t *position, uint64_t offset,
+                       const void *data, uint64_t size)
+{
+    for (; *position < offset; (*position)++)
+        if (fputc(0, out) == EOF)
+            return false;
+
+    if (size > 0 && fwrite(data, size, 1, out) != 1)
+        return false;
+
+    *position += size;
+    return true;
+}
+
+/* Check that count elements of size bytes at offset are in the file */
+static bool check_part(uint64_t offset, uint64_t count, uint64_t size,
+                       uint64_t file_len)
+{
+    if (offset % SIG_DB_ALIGN != 0 || offset > file_len)
+        return false;
+
+    return count <= (file_len - offset) / size;
+}
+
+/* Check the entries of a mapped database */
+static bool check_entries(const sig_db_t *db)
+{
+    for (uint64_t i = 0; i < db->nb_entries; i++) {
+        const sig_db_entry_t *entry = &db->entries[i];
+
+        if (entry->name_offset >= db->names_size ||
+            entry->name_length >= db->names_size - entry->name_offset ||
+            db->names[entry->name_offset + entry->name_length] != '\0')
+            return false;
+
+        if ((entry->flags & SIG_DB_SIMHASH) &&
+            entry->shingle_hash >= SHINGLE_HASH_END)
+            return false;
+
+        if (entry->flags & SIG_DB_CTPH) {
+            if (db->ctph == NULL ||
+                db->ctph[i].length[0] > SIG_DB_CTPH_LENGTH ||
+                db->ctph[i].length[1] > SIG_DB_CTPH_LENGTH)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+/* External functions */
+
+sig_db_t *sig_db_new(void)
+{
+    return calloc(1, sizeof(sig_db_t));
+}
+
+bool sig_db_add(sig_db_t *db, const char *name, const char *ctph,
+                const char *simhash)
+{
+    if (db == NULL || db->map != NULL || name == NULL)
+        return false;
+
+    uint64_t name_length = strlen(name);
+    if (name_length > UINT32_MAX || !grow_entries(db))
+        return false;
+
+    uint64_t name_offset = add_name(db, name, name_length);
+    if (name_offset == UINT64_MAX)
+        return false;
+
+    uint64_t i = db->nb_entries++;
+    sig_db_entry_t *entry = &db->entries[i];
+    memset(entry, 0, sizeof(sig_db_entry_t));
+    entry->name_offset = name_offset;
+    entry->name_length = name_length;
+    memset(&db->ctph[i], 0, sizeof(sig_db_ctph_t));
+    memset(db->simhash[i], 0, SIMHASH_SIZE);
+
+    sig_db_set_ctph(db, i, ctph);
+    sig_db_set_simhash(db, i, simhash);
+
+    return true;
+}
+
+bool sig_db_append(sig_db_t *db, const sig_db_t *other, uint64_t i)
+{
+    if (db == NULL || db->map != NULL || other == NULL ||
+        i >= other->nb_entries || !grow_entries(db))
+        return false;
+
+    const sig_db_entry_t *entry = &other->entries[i];
+    uint64_t name_offset =
+        add_name(db, sig_db_get_name(other, i), entry->name_length);
+    if (name_offset == UINT64_MAX)
+        return false;
+
+    uint64_t k = db->nb_entries++;
+    db->entries[k] = *entry;
+    db->entries[k].name_offset = name_offset;
+    memcpy(db->simhash[k], other->simhash[i], SIMHASH_SIZE);
+    if (entry->flags & SIG_DB_CTPH)
+        db->ctph[k] = other->ctph[i];
+    else
+        memset(&db->ctph[k], 0, sizeof(sig_db_ctph_t));
+    db->flags |= entry->flags;
+
+    return true;
+}
+
+bool sig_db_set_ctph(sig_db_t *db, uint64_t i, const char *ctph)
+{
+    if (db == NULL || db->map != NULL || i >= db->nb_entries || ctph == NULL)
+        return false;
+
+    sig_db_entry_t *entry = &db->entries[i];
+    entry->flags &= ~SIG_DB_CTPH;
+    if (!parse_ctph(ctph, &db->ctph[i]))
+        return false;
+
+    entry->flags |= SIG_DB_CTPH;
+    db->flags |= SIG_DB_CTPH;
+    return true;
+}
+
+bool sig_db_set_simhash(sig_db_t *db, uint64_t i, const char *simhash)
+{
+    if (db == NULL || db->map != NULL || i >= db->nb_entries ||
+        simhash == NULL)
+        return false;
+
+    sig_db_entry_t *entry = &db->entries[i];
+    entry->flags &= ~SIG_DB_SIMHASH;
+
+    shingle_hash_e shingle_hash;
+    if (!simhash_decode(simhash, &shingle_hash, db->simhash[i])) {
+        memset(db->simhash[i], 0, SIMHASH_SIZE);
+        return false;
+    }
+
+    entry->flags |= SIG_DB_SIMHASH;
+    entry->shingle_hash = shingle_hash;
+    db->flags |= SIG_DB_SIMHASH;
+    return true;
+}
+
+bool sig_db_write(sig_db_t *db, FILE *out)
+{
+    if (db == NULL || out == NULL)
+        return false;
+
+    uint64_t n = db->nb_entries;
+    sig_db_header_t header = {.version = SIG_DB_VERSION,
+                              .byte_order = SIG_DB_BYTE_ORDER,
+                              .flags = db->flags,
+                              .nb_entries = n};
+    memcpy(header.magic, SIG_DB_MAGIC, SIG_DB_MAGIC_LENGTH);
+
+    /* Layout */
+    uint64_t offset = align(sizeof(sig_db_header_t));
+    header.entries_offset = offset;
+    offset = align(offset + sizeof(sig_db_entry_t) * n);
+    header.simhash_offset = offset;
+    offset = align(offset + SIMHASH_SIZE * n);
+    if (db->flags & SIG_DB_CTPH) {
+        header.ctph_offset = offset;
+        offset = align(offset + sizeof(sig_db_ctph_t) * n);
+    }
+    header.names_offset = offset;
+    header.names_size = db->names_size;
+
+    /* Parts */
+    uint64_t position = 0;
+    if (!write_part(out, &position, 0, &header, sizeof(header)) ||
+        !write_part(out, &position, header.entries_offset, db->entries,
+                    sizeof(sig_db_entry_t) * n) ||
+        !write_part(out, &position, header.simhash_offset, db->simhash,
+                    SIMHASH_SIZE * n))
+        return false;
+
+    if (header.ctph_offset != 0 &&
+        !write_part(out, &position, header.ctph_offset, db->ctph,
+                    sizeof(sig_db_ctph_t) * n))
+        return false;
+
+    if (!write_part(out, &position, header.names_offset, db->names,
+                    db->names_size))
+        return false;
+
+    return fflush(out) == 0;
+}
+
+bool sig_db_is_file(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL)
+        return false;
+
+    char magic[SIG_DB_MAGIC_LENGTH];
+    bool is_db = fread(magic, SIG_DB_MAGIC_LENGTH, 1, f) == 1 &&
+                 memcmp(magic, SIG_DB_MAGIC, SIG_DB_MAGIC_LENGTH) == 0;
+
+    fclose(f);
+    return is_db;
+}
+
+sig_db_t *sig_db_map(const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        goto err_null;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size < (off_t) sizeof(sig_db_header_t))
+        goto err_close;
+
+    uint64_t len = info.st_size;
+    uint8_t *map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED)
+        goto err_close;
+    close(fd);
+
+    /* Header */
+    sig_db_header_t header;
+    memcpy(&header, map, sizeof(header));
+    if (memcmp(header.magic, SIG_DB_MAGIC, SIG_DB_MAGIC_LENGTH) != 0 ||
+        header.version != SIG_DB_VERSION)
+        goto err_unmap;
+
+    /* Written on a host of the other byte order : the values are swapped */
+    if (header.byte_order != SIG_DB_BYTE_ORDER)
+        goto err_unmap;
+
+    uint64_t n = header.nb_entries;
+    if (!check_part(header.entries_offset, n, sizeof(sig_db_entry_t), len) ||
+        !check_part(header.simhash_offset, n, SIMHASH_SIZE, len) ||
+        !check_part(header.names_offset, header.names_size, 1, len))
+        goto err_unmap;
+    if ((header.flags & SIG_DB_CTPH) &&
+        !check_part(header.ctph_offset, n, sizeof(sig_db_ctph_t), len))
+        goto err_unmap;
+
+    sig_db_t *db = calloc(1, sizeof(sig_db_t));
+    if (db == NULL)
+        goto err_unmap;
+
+    db->flags = header.flags;
+    db->nb_entries = n;
+    db->entries = (sig_db_entry_t *) (map + header.entries_offset);
+    db->simhash = (uint8_t(*)[SIMHASH_SIZE])(map + header.simhash_offset);
+    db->ctph = (header.flags & SIG_DB_CTPH)
+                   ? (sig_db_ctph_t *) (map + header.ctph_offset)
+                   : NULL;
+    db->names = (char *) (map + header.names_offset);
+    db->names_size = header.names_size;
+    db->map = map;
+    db->map_len = len;
+
+    if (!check_entries(db)) {
+        free(db);
+        goto err_unmap;
+    }
+
+    return db;
+
+    /* Errors */
+err_unmap:
+    munmap(map, len);
+    return NULL;
+err_close:
+    close(fd);
+err_null:
+    return NULL;
+}
+
+void sig_db_free(sig_db_t *db)
+{
+    if (db == NULL)
+        return;
+
+    if (db->map != NULL) {
+        munmap(db->map, db->map_len);
+    } else {
+        free(db->entries);
+        free(db->simhash);
+        free(db->ctph);
+        free(db->names);
+    }
+    free(db);
+}
+
+bool sig_db_view(const sig_db_t *db, uint64_t first, uint64_t end,
+                 sig_db_t *view)
+{
+    if (db == NULL || view == NULL || first > end || end > db->nb_entries)
+        return false;
+
+    *view = (sig_db_t){
+        .flags = db->flags,
+        .nb_entries = end - first,
+        .entries = db->entries + first,
+        .simhash = db->simhash + first,
+        .ctph = (db->ctph != NULL) ? db->ctph + first : NULL,
+        .names = db->names,
+        .names_size = db->names_size};
+
+    return true;
+}
+
+const char *sig_db_get_name(const sig_db_t *db, uint64_t i)
+{
+    return &db->names[db->entries[i].name_offset];
+}
+
+bool sig_db_get_ctph(const sig_db_t *db, uint64_t i,
+                     char ctph[SIG_DB_CTPH_MAX_LENGTH + 1])
+{
+    if (!(db->entries[i].flags & SIG_DB_CTPH))
+        return false;
+
+    const sig_db_ctph_t *c = &db->ctph[i];
+    snprintf(ctph, SIG_DB_CTPH_MAX_LENGTH + 1,
+             CTPH_TAG ":%" PRIu32 ":%.*s:%.*s", c->block_size, c->length[0],
+             c->signature[0], c->length[1], c->signature[1]);
+
+    return true;
+}
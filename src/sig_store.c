@@ -0,0 +1,443 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "sig_store.h"
+
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <pthread.h>
+
+#define SIG_STORE_DEFAULT_CAPACITY 16
+
+/* Files of the store indexed together, without index if no memory for it */
+typedef struct {
+    sig_db_t *db;
+    uint64_t first; /* Index in the store of its first file */
+    compare_index_t *indexes[COMPARE_END];
+} sig_store_part_t;
+
+/* Internal structure (hiden from outside) to represent the store */
+struct _sig_store_t {
+    compare_options_t options;
+    sig_store_part_t *parts; /* The files given, then the segments */
+    uint64_t nb_parts;
+    uint64_t capacity;
+    sig_db_t *sealed; /* Full segment being indexed, without index until then */
+    uint64_t sealed_first;
+    sig_db_t *last; /* Files added since the last segment, without index */
+    uint64_t nb_files;
+    pthread_rwlock_t lock;
+
+    /* Thread indexing the full segments and merging them */
+    pthread_t sealer;
+    pthread_mutex_t wake_lock;
+    pthread_cond_t wake_cond;
+    bool wake; /* The last segment is full */
+    bool stop; /* The store is being freed */
+};
+
+/* Static Functions */
+
+static void free_indexes(sig_store_part_t *part)
+{
+    for (compare_algorithm_e algo = COMPARE_CTPH; algo < COMPARE_END; algo++) {
+        compare_index_free(part->indexes[algo]);
+        part->indexes[algo] = NULL;
+    }
+}
+
+static void free_part(sig_store_part_t *part)
+{
+    free_indexes(part);
+    sig_db_free(part->db);
+}
+
+/* Index the files of the part for each algorithm, return false if problems */
+static bool index_part(const sig_store_t *store, sig_store_part_t *part)
+{
+    for (compare_algorithm_e algo = COMPARE_CTPH; algo < COMPARE_END; algo++) {
+        part->indexes[algo] =
+            compare_index_new(part->db, algo, &store->options);
+        if (part->indexes[algo] == NULL)
+            return false;
+    }
+
+    return true;
+}
+
+/* Room for a part after the last one, return false if problems */
+static bool grow_parts(sig_store_t *store)
+{
+    if (store->nb_parts < store->capacity)
+        return true;
+
+    uint64_t capacity =
+        store->capacity ? store->capacity * 2 : SIG_STORE_DEFAULT_CAPACITY;
+    sig_store_part_t *parts =
+        realloc(store->parts, sizeof(sig_store_part_t) * capacity);
+    if (parts == NULL)
+        return false;
+
+    store->parts = parts;
+    store->capacity = capacity;
+    return true;
+}
+
+/*
+ * Merge the last two segments while the last one is as large as the one
+ * before : their sizes double from the last one to the first one. The merged
+ * segment is built and indexed without the lock, then swapped in.
+ * The files given first are never merged. Return false if problems.
+ */
+static bool merge_segments(sig_store_t *store)
+{
+    /* Only the thread sealing changes the parts : it reads them unlocked */
+    while (store->nb_parts > 2) {
+        sig_store_part_t part_1 = store->parts[store->nb_parts - 2];
+        sig_store_part_t part_2 = store->parts[store->nb_parts - 1];
+        if (part_1.db->nb_entries > part_2.db->nb_entries)
+            return true;
+
+        sig_db_t *db = sig_db_new();
+        if (db == NULL)
+            return false;
+
+        bool ret = true;
+        for (uint64_t i = 0; i < part_1.db->nb_entries && ret; i++)
+            ret = sig_db_append(db, part_1.db, i);
+        for (uint64_t i = 0; i < part_2.db->nb_entries && ret; i++)
+            ret = sig_db_append(db, part_2.db, i);
+
+        sig_store_part_t merged = {.db = db, .first = part_1.first};
+        if (!ret || !index_part(store, &merged)) {
+            free_part(&merged);
+            return false;
+        }
+
+        pthread_rwlock_wrlock(&store->lock);
+        store->parts[store->nb_parts - 2] = merged;
+        store->nb_parts--;
+        pthread_rwlock_unlock(&store->lock);
+
+        /* No query uses them anymore */
+        free_part(&part_1);
+        free_part(&part_2);
+    }
+
+    return true;
+}
+
+/*
+ * Index the full last segments as new segments, and merge them. Each one is
+ * detached with the lock, still compared without index while it is indexed
+ * without the lock, then swapped in : the files added meanwhile go to the
+ * next last segment. Only called by the sealer thread.
+ */
+static void seal_segments(sig_store_t *store)
+{
+    bool ret = true;
+    while (ret) {
+        pthread_rwlock_wrlock(&store->lock);
+        if (store->sealed == NULL &&
+            store->last->nb_entries >= SIG_STORE_SEGMENT_SIZE) {
+            sig_db_t *last = sig_db_new();
+            if (last != NULL) {
+                store->sealed = store->last;
+                store->sealed_first = store->nb_files - store->last->nb_entries;
+                store->last = last;
+            }
+        }
+        bool sealed = store->sealed != NULL;
+        pthread_rwlock_unlock(&store->lock);
+        if (!sealed)
+            break;
+
+        /* Without memory to index it, the segment is compared without index */
+        sig_store_part_t part = {.db = store->sealed,
+                                 .first = store->sealed_first};
+        if (!index_part(store, &part))
+            free_indexes(&part);
+
+        pthread_rwlock_wrlock(&store->lock);
+        ret = grow_parts(store);
+        if (ret) {
+            store->parts[store->nb_parts++] = part;
+            store->sealed = NULL;
+        }
+        pthread_rwlock_unlock(&store->lock);
+
+        if (!ret)
+            free_indexes(&part);
+        ret = ret && merge_segments(store);
+    }
+}
+
+/* Seal the segments each time the last one is full, until the store is freed */
+static void *run_sealer(void *arg)
+{
+    sig_store_t *store = arg;
+
+    pthread_mutex_lock(&store->wake_lock);
+    while (!store->stop) {
+        if (!store->wake) {
+            pthread_cond_wait(&store->wake_cond, &store->wake_lock);
+            continue;
+        }
+
+        store->wake = false;
+        pthread_mutex_unlock(&store->wake_lock);
+        seal_segments(store);
+        pthread_mutex_lock(&store->wake_lock);
+    }
+    pthread_mutex_unlock(&store->wake_lock);
+
+    return NULL;
+}
+
+/*
+ * Database holding the file i of the store, whose index in it is written in
+ * local. NULL if there is no such file.
+ */
+static const sig_db_t *find_file(const sig_store_t *store, uint64_t i,
+                                 uint64_t *local)
+{
+    if (i >= store->nb_files)
+        return NULL;
+
+    uint64_t last_first = store->nb_files - store->last->nb_entries;
+    if (i >= last_first) {
+        *local = i - last_first;
+        return store->last;
+    }
+    if (store->sealed != NULL && i >= store->sealed_first) {
+        *local = i - store->sealed_first;
+        return store->sealed;
+    }
+
+    /* Last part starting at i or before */
+    uint64_t low = 0, high = store->nb_parts - 1;
+    while (low < high) {
+        uint64_t mid = low + (high - low + 1) / 2;
+        if (store->parts[mid].first <= i)
+            low = mid;
+        else
+            high = mid - 1;
+    }
+
+    *local = i - store->parts[low].first;
+    return store->parts[low].db;
+}
+
+/*
+ * Add the matches of the result to the ones of the store, the indexes of the
+ * result starting at first. Return false if problems.
+ */
+static bool add_matches(const sig_store_t *store, compare_result_t *matches,
+                        const compare_result_t *result, uint64_t first)
+{
+    for (uint64_t q = 0; q < result->nb_files; q++) {
+        const compare_list_t *list = &result->lists[q];
+        for (uint64_t k = 0; k < list->nb_matches; k++)
+            if (!compare_result_add(matches, q, first + list->matches[k].index,
+                                    list->matches[k].score,
+                                    store->options.top))
+                return false;
+    }
+
+    return true;
+}
+
+/* External functions */
+
+sig_store_t *sig_store_new(sig_db_t *db, const compare_options_t *options)
+{
+    if (db == NULL || options == NULL)
+        return NULL;
+
+    sig_store_t *store = calloc(1, sizeof(sig_store_t));
+    if (store == NULL)
+        return NULL;
+
+    store->options = *options;
+    store->last = sig_db_new();
+    sig_store_part_t part = {.db = db};
+    if (store->last == NULL || !grow_parts(store) ||
+        !index_part(store, &part)) {
+        free_indexes(&part);
+        sig_db_free(store->last);
+        free(store->parts);
+        free(store);
+        return NULL;
+    }
+    store->parts[store->nb_parts++] = part;
+    store->nb_files = db->nb_entries;
+    pthread_rwlock_init(&store->lock, NULL);
+    pthread_mutex_init(&store->wake_lock, NULL);
+    pthread_cond_init(&store->wake_cond, NULL);
+
+    /* The signals go to the threads of the caller, not to the sealer */
+    sigset_t all_signals, old_mask;
+    sigfillset(&all_signals);
+    pthread_sigmask(SIG_BLOCK, &all_signals, &old_mask);
+    bool started =
+        pthread_create(&store->sealer, NULL, run_sealer, store) == 0;
+    pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+
+    if (!started) {
+        pthread_cond_destroy(&store->wake_cond);
+        pthread_mutex_destroy(&store->wake_lock);
+        pthread_rwlock_destroy(&store->lock);
+        free_indexes(&store->parts[0]);
+        sig_db_free(store->last);
+        free(store->parts);
+        free(store);
+        return NULL;
+    }
+
+    return store;
+}
+
+void sig_store_free(sig_store_t *store)
+{
+    if (store == NULL)
+        return;
+
+    /* The segment being indexed is finished first */
+    pthread_mutex_lock(&store->wake_lock);
+    store->stop = true;
+    pthread_cond_signal(&store->wake_cond);
+    pthread_mutex_unlock(&store->wake_lock);
+    pthread_join(store->sealer, NULL);
+
+    for (uint64_t p = 0; p < store->nb_parts; p++)
+        free_part(&store->parts[p]);
+    free(store->parts);
+    sig_db_free(store->sealed);
+    sig_db_free(store->last);
+    pthread_cond_destroy(&store->wake_cond);
+    pthread_mutex_destroy(&store->wake_lock);
+    pthread_rwlock_destroy(&store->lock);
+    free(store);
+}
+
+uint64_t sig_store_count(sig_store_t *store)
+{
+    if (store == NULL)
+        return 0;
+
+    pthread_rwlock_rdlock(&store->lock);
+    uint64_t nb_files = store->nb_files;
+    pthread_rwlock_unlock(&store->lock);
+
+    return nb_files;
+}
+
+uint64_t sig_store_add(sig_store_t *store, const char *name,
+                       const char *ctph, const char *simhash)
+{
+    if (store == NULL)
+        return UINT64_MAX;
+
+    pthread_rwlock_wrlock(&store->lock);
+    uint64_t index = UINT64_MAX;
+    bool seal = false;
+    if (sig_db_add(store->last, name, ctph, simhash)) {
+        index = store->nb_files++;
+        seal = store->last->nb_entries >= SIG_STORE_SEGMENT_SIZE;
+    }
+    pthread_rwlock_unlock(&store->lock);
+
+    /* The segment is indexed by the sealer, the caller doesn't wait */
+    if (seal) {
+        pthread_mutex_lock(&store->wake_lock);
+        store->wake = true;
+        pthread_cond_signal(&store->wake_cond);
+        pthread_mutex_unlock(&store->wake_lock);
+    }
+
+    return index;
+}
+
+compare_result_t *sig_store_query(sig_store_t *store, const sig_db_t *queries,
+                                  compare_algorithm_e algo)
+{
+    if (store == NULL || queries == NULL || algo >= COMPARE_END)
+        return NULL;
+
+    compare_result_t *matches = compare_result_new(queries->nb_entries);
+    if (matches == NULL)
+        return NULL;
+
+    pthread_rwlock_rdlock(&store->lock);
+    bool ret = true;
+    for (uint64_t p = 0; p < store->nb_parts && ret; p++) {
+        const sig_store_part_t *part = &store->parts[p];
+        compare_result_t *result =
+            (part->indexes[algo] != NULL)
+                ? compare_index_query(part->indexes[algo], queries)
+                : compare_query(queries, part->db, algo, &store->options);
+
+        ret = result != NULL &&
+              add_matches(store, matches, result, part->first);
+        compare_result_free(result);
+    }
+
+    if (ret && store->sealed != NULL) {
+        compare_result_t *result =
+            compare_query(queries, store->sealed, algo, &store->options);
+
+        ret = result != NULL &&
+              add_matches(store, matches, result, store->sealed_first);
+        compare_result_free(result);
+    }
+
+    if (ret && store->last->nb_entries > 0) {
+        compare_result_t *result =
+            compare_query(queries, store->last, algo, &store->options);
+
+        ret = result != NULL &&
+              add_matches(store, matches, result,
+                          store->nb_files - store->last->nb_entries);
+        compare_result_free(result);
+    }
+    pthread_rwlock_unlock(&store->lock);
+
+    if (!ret) {
+        compare_result_free(matches);
+        return NULL;
+    }
+
+    compare_result_sort(matches);
+    return matches;
+}
+
+char *sig_store_get_name(sig_store_t *store, uint64_t i)
+{
+    if (store == NULL)
+        return NULL;
+
+    pthread_rwlock_rdlock(&store->lock);
+    uint64_t local;
+    const sig_db_t *db = find_file(store, i, &local);
+    char *name = (db != NULL) ? strdup(sig_db_get_name(db, local)) : NULL;
+    pthread_rwlock_unlock(&store->lock);
+
+    return name;
+}
+
+float sig_store_simhash_score(sig_store_t *store, const sig_db_t *queries,
+                              uint64_t q, uint64_t i)
+{
+    if (store == NULL)
+        return 0.0;
+
+    pthread_rwlock_rdlock(&store->lock);
+    uint64_t local;
+    const sig_db_t *db = find_file(store, i, &local);
+    float score =
+        (db != NULL) ? compare_simhash_score(queries, q, db, local) : 0.0;
+    pthread_rwlock_unlock(&store->lock);
+
+    return score;
+}
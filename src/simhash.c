@@ -3,10 +3,31 @@
 #include <stdlib.h>
 
 #include <openssl/md5.h>
+#include <string.h>
+#include <strings.h>
 
 #include "shingle_table.h"
 
-#define SIM_HASH_SIZE 16
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#define NB_BITS (MD5_LENGTH * 8)
+/* Votes kept in 8-bit counters before adding them to the totals */
+#define VOTE_BATCH 255
+
+/* clang-format off */
+char *SHINGLE_HASH_NAME[SHINGLE_HASH_END] =
+{
+    [SHINGLE_HASH_MD5]  = "md5",
+    [SHINGLE_HASH_WY]   = "wy"
+};
+/* clang-format on */
+
+/* Secrets of wyhash */
+static const uint64_t WY_SECRET[4] = {
+    0xa0761d6478bd642full, 0xe7037ed1a0b428dbull, 0x8ebc6af09c88c6e3ull,
+    0x589965cc75374cc3ull};
 
 /* clang-format off */
 uint64_t SHINGLE_SIZE[SECTION_END] =
@@ -42,12 +63,158 @@ uint64_t SHINGLE_SIZE[SECTION_END] =
 /* clang-format on */
 
 /* Static Functions */
-static bool compute_hash(elf_data data, uint8_t **hash)
+
+/* Read n bytes (n <= 8) in little-endian */
+static uint64_t wy_read(const uint8_t *buf, uint8_t n)
+{
+    uint64_t v = 0;
+    for (uint8_t i = 0; i < n; i++)
+        v |= (uint64_t) buf[i] << (8 * i);
+    return v;
+}
+
+/* 64x64 -> 128 bits multiplication, folded in 64 bits */
+static uint64_t wy_mix(uint64_t a, uint64_t b)
+{
+    __uint128_t r = (__uint128_t) a * b;
+    return (uint64_t) r ^ (uint64_t) (r >> 64);
+}
+
+/*
+ * Non-cryptographic 128-bit hash following wyhash
+ * (https://github.com/wangyi-fudan/wyhash) : the state is mixed with one
+ * 64x64 -> 128 bits multiplication per 16 bytes, and two different
+ * finalizations give the two halves of the digest.
+ */
+static void wy_hash(const uint8_t *buf, uint64_t len,
+                    uint8_t digest[MD5_LENGTH])
+{
+    uint64_t seed = WY_SECRET[0] ^ wy_mix(len ^ WY_SECRET[0], WY_SECRET[1]);
+    uint64_t a, b;
+
+    if (len <= 16) {
+        if (len >= 4) {
+            uint64_t shift = (len >> 3) << 2;
+            a = (wy_read(buf, 4) << 32) | wy_read(buf + shift, 4);
+            b = (wy_read(buf + len - 4, 4) << 32) |
+                wy_read(buf + len - 4 - shift, 4);
+        } else if (len > 0) {
+            a = ((uint64_t) buf[0] << 16) | ((uint64_t) buf[len >> 1] << 8) |
+                buf[len - 1];
+            b = 0;
+        } else
+            a = b = 0;
+    } else {
+        uint64_t i = len;
+        for (; i > 16; i -= 16, buf += 16)
+            seed = wy_mix(wy_read(buf, 8) ^ WY_SECRET[1],
+                          wy_read(buf + 8, 8) ^ seed);
+        a = wy_read(buf + i - 16, 8);
+        b = wy_read(buf + i - 8, 8);
+    }
+
+    a ^= WY_SECRET[1];
+    b ^= seed;
+    __uint128_t r = (__uint128_t) a * b;
+    a = (uint64_t) r;
+    b = (uint64_t) (r >> 64);
+
+    uint64_t half[2] = {wy_mix(a ^ WY_SECRET[0] ^ len, b ^ WY_SECRET[1]),
+                        wy_mix(a ^ WY_SECRET[2], b ^ WY_SECRET[3] ^ len)};
+    for (uint8_t i = 0; i < MD5_LENGTH; i++)
+        digest[i] = half[i / 8] >> (8 * (i % 8));
+}
+
+/* Hash a shingle with the shingle hash function */
+static void hash_shingle(shingle_t *sh, shingle_hash_e shingle_hash)
+{
+    if (shingle_hash == SHINGLE_HASH_WY)
+        wy_hash(sh->buffer, sh->buffer_size, sh->md5_digest);
+    else
+        MD5(sh->buffer, sh->buffer_size, sh->md5_digest);
+}
+
+/* Votes of the shingle digests for each bit of the SimHash */
+typedef struct {
+    uint64_t nb_votes;
+    uint64_t ones[NB_BITS];  /* Number of digests with the bit set */
+    uint8_t batch[NB_BITS];  /* Same for the last votes, not yet in ones */
+    uint8_t nb_batch;
+} vote_state;
+
+/* Add the batch counters to the totals */
+static void vote_flush(vote_state *vote)
+{
+    for (uint8_t i = 0; i < NB_BITS; i++)
+        vote->ones[i] += vote->batch[i];
+
+    memset(vote->batch, 0, sizeof(vote->batch));
+    vote->nb_batch = 0;
+}
+
+/* Count the bits of a digest, bit i of the digest goes to the counter i */
+static void vote_add(vote_state *vote, uint8_t digest[MD5_LENGTH])
+{
+#ifdef __AVX2__
+    /* Byte lane j takes the bit (j % 8) of the byte (j / 8) */
+    const __m256i spread = _mm256_setr_epi8(
+        0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+        2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+    const __m256i bits = _mm256_set1_epi64x(0x8040201008040201ll);
+
+    for (uint8_t i = 0; i < MD5_LENGTH; i += 4) {
+        uint32_t chunk;
+        memcpy(&chunk, &digest[i], sizeof(chunk));
+
+        __m256i v = _mm256_shuffle_epi8(_mm256_set1_epi32(chunk), spread);
+        __m256i set = _mm256_cmpeq_epi8(_mm256_and_si256(v, bits), bits);
+
+        /* A set lane is -1 : subtracting it counts one vote */
+        __m256i *counters = (__m256i *) &vote->batch[i * 8];
+        _mm256_storeu_si256(counters,
+                            _mm256_sub_epi8(_mm256_loadu_si256(counters), set));
+    }
+#else
+    for (uint8_t i = 0; i < MD5_LENGTH; i++)
+        for (uint8_t bit = 0; bit < 8; bit++)
+            vote->batch[i * 8 + bit] += (digest[i] >> bit) & 1;
+#endif
+
+    vote->nb_votes++;
+    if (++(vote->nb_batch) == VOTE_BATCH)
+        vote_flush(vote);
+}
+
+/* Upper bound of the number of distinct shingles in the sections */
+static uint64_t get_nb_shingles_max(elf_data data)
+{
+    uint64_t nb_shingles = 0;
+
+    for (uint8_t i = 0; i < SECTION_END; i++) {
+        uint64_t sh_size = SHINGLE_SIZE[i];
+        if (data[i].len < SHINGLE_SIZE[i])
+            sh_size = data[i].len;
+
+        uint64_t nb_positions = data[i].len - sh_size;
+
+        /* Short shingles can not take more than 256^sh_size values */
+        if (sh_size < 8 && nb_positions > (1ULL << (8 * sh_size)))
+            nb_positions = 1ULL << (8 * sh_size);
+
+        nb_shingles += nb_positions;
+    }
+
+    return (nb_shingles > 0) ? nb_shingles : 1;
+}
+
+static bool compute_hash(elf_data data, shingle_hash_e shingle_hash,
+                         uint8_t **hash)
 {
     if (data == NULL || hash == NULL)
         goto err_null;
 
-    shingle_table_t *table = shingle_table_malloc(SHINGLE_TABLE_DEFAULT_SIZE);
+    /* No expansion is needed once the table is sized for every shingle */
+    shingle_table_t *table = shingle_table_malloc(get_nb_shingles_max(data));
     if (table == NULL)
         goto err_null;
 
@@ -68,11 +235,11 @@ static bool compute_hash(elf_data data, uint8_t **hash)
         for (uint64_t j = 0; j < (data[i].len - sh_size); j++) {
             sh.buffer = &(data[i].data[j]);
             sh.buffer_size = sh_size;
-            MD5(sh.buffer, sh.buffer_size, sh.md5_digest);
+            hash_shingle(&sh, shingle_hash);
 
             if (shingle_table_insert(table, sh) == ERROR_TABLE_FULL_INSERT) {
                 if (shingle_table_expand_size(&table) == ERROR_EXPAND)
-                    goto err_f_table;
+                    goto err_f_final_hash;
 
                 shingle_table_insert(table, sh);
             }
@@ -80,36 +247,23 @@ static bool compute_hash(elf_data data, uint8_t **hash)
     }
 
     /* Compute hash */
-    int64_t tmp_hash[MD5_LENGTH * 8];
-    for (uint8_t i = 0; i < (MD5_LENGTH * 8); i++)
-        tmp_hash[i] = 0;
-
-    while (!shingle_table_is_empty(table)) {
-        shingle_table_remove_first(table, &sh);
-
-        for (uint8_t i = 0; i < MD5_LENGTH; i++) {
-            for (uint8_t bit = 0; bit < 8; bit++) {
-                uint8_t val_bit = ((sh.md5_digest[i]) >> bit) & 1;
+    vote_state vote = {0};
 
-                tmp_hash[i * 8 + bit] += (val_bit > 0) ? 1 : -1;
-            }
-        }
-    }
+    uint64_t index = 0;
+    while (shingle_table_next(table, &index, &sh))
+        vote_add(&vote, sh.md5_digest);
+    vote_flush(&vote);
 
     shingle_table_free(table);
 
+    /* A bit is set if more digests have it set than unset */
     for (uint8_t octet = 0; octet < MD5_LENGTH; octet++) {
         uint8_t tmp_octet = 0;
 
-        uint8_t bit = 8;
-        do {
-            bit--;
-            uint8_t final_val = (tmp_hash[octet * 8 + bit] > 0) ? 1 : 0;
+        for (uint8_t bit = 0; bit < 8; bit++)
+            if (vote.ones[octet * 8 + bit] * 2 > vote.nb_votes)
+                tmp_octet |= 1 << bit;
 
-            tmp_octet <<= 1;
-            tmp_octet += final_val;
-
-        } while (bit != 0);
         final_hash[octet] = tmp_octet;
     }
 
@@ -118,6 +272,8 @@ static bool compute_hash(elf_data data, uint8_t **hash)
 
     return true;
 
+err_f_final_hash:
+    free(final_hash);
 err_f_table:
     shingle_table_free(table);
 
@@ -125,17 +281,9 @@ err_null:
     return false;
 }
 
-static float compare_hash(uint8_t *hash_1, uint8_t *hash_2)
+/* Score of a Hamming distance */
+static float distance_score(uint32_t dist)
 {
-    if (hash_1 == NULL || hash_2 == NULL)
-        return 0;
-
-    /* Compute hamming distance */
-    uint64_t dist = 0;
-    for (uint64_t i = 0; i < SIM_HASH_SIZE; i++) {
-        uint64_t xor_val = hash_1[i] ^ hash_2[i];
-        dist += __builtin_popcountll(xor_val);
-    }
     float res = (1.0 - (dist / 128.0)) * 100.0;
 
     /* Rescale result */
@@ -150,52 +298,95 @@ static float compare_hash(uint8_t *hash_1, uint8_t *hash_2)
     return res;
 }
 
-static char *simhash_to_string(uint8_t hash[])
+static float compare_hash(const uint8_t *hash_1, const uint8_t *hash_2)
+{
+    if (hash_1 == NULL || hash_2 == NULL)
+        return 0;
+
+    return distance_score(simhash_distance(hash_1, hash_2, SIMHASH_SIZE * 8));
+}
+
+static char *simhash_to_string(uint8_t hash[], shingle_hash_e shingle_hash)
 {
     if (hash == NULL)
         return NULL;
 
-    char *string = malloc(sizeof(char) * (SIM_HASH_SIZE * 2 + 1));
+    char *string = malloc(sizeof(char) * (SIMHASH_MAX_LENGTH + 1));
     if (string == NULL)
         return NULL;
 
-    for (uint8_t i = 0; i < SIM_HASH_SIZE; i++)
-        snprintf(&(string[i * 2]), 3, "%02x", hash[i]);
+    int offset = snprintf(string, SIMHASH_MAX_LENGTH + 1, "%s:",
+                          SHINGLE_HASH_NAME[shingle_hash]);
+    for (uint8_t i = 0; i < SIMHASH_SIZE; i++)
+        snprintf(&(string[offset + i * 2]), 3, "%02x", hash[i]);
 
     return string;
 }
 
-static uint8_t *simhash_string_to_uint(char *hash)
+/*
+ * Get the shingle hash function of a SimHash string and move hash past its
+ * name. Strings without name are from MD5.
+ */
+static shingle_hash_e simhash_string_shingle_hash(char **hash)
 {
-    if (hash == NULL)
-        return NULL;
-
-    uint8_t *hash_tab = malloc(sizeof(uint8_t) * SIM_HASH_SIZE);
-    if (hash_tab == NULL)
-        return NULL;
-
-    char tmp[5] = "0x00";
-
-    for (uint8_t i = 0; hash[i] != '\0'; i += 2) {
-        tmp[2] = hash[i];
-        tmp[3] = hash[i + 1];
+    char *sep = strchr(*hash, ':');
+    if (sep == NULL)
+        return SHINGLE_HASH_MD5;
+
+    shingle_hash_e shingle_hash = SHINGLE_HASH_END;
+    for (uint8_t i = 0; i < SHINGLE_HASH_END; i++)
+        if (strlen(SHINGLE_HASH_NAME[i]) == (size_t)(sep - *hash) &&
+            strncmp(*hash, SHINGLE_HASH_NAME[i], sep - *hash) == 0)
+            shingle_hash = i;
+
+    *hash = sep + 1;
+    return shingle_hash;
+}
 
-        hash_tab[i / 2] = strtol(tmp, NULL, 16);
+/* Read the value of two hexadecimal digits, -1 if they are not */
+static int hex_byte(const char *hex)
+{
+    int value = 0;
+    for (uint8_t i = 0; i < 2; i++) {
+        char c = hex[i];
+        if (c >= '0' && c <= '9')
+            value = value * 16 + c - '0';
+        else if (c >= 'a' && c <= 'f')
+            value = value * 16 + c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F')
+            value = value * 16 + c - 'A' + 10;
+        else
+            return -1;
     }
 
-    return hash_tab;
+    return value;
 }
 
 /* Extern Functions */
 
-char *simhash_compute(elf_data data)
+shingle_hash_e simhash_get_shingle_hash(const char *name)
+{
+    if (name == NULL)
+        return SHINGLE_HASH_END;
+
+    for (uint8_t i = 0; i < SHINGLE_HASH_END; i++)
+        if (strcasecmp(name, SHINGLE_HASH_NAME[i]) == 0)
+            return i;
+
+    return SHINGLE_HASH_END;
+}
+
+char *simhash_compute(elf_data data, shingle_hash_e shingle_hash)
 {
     uint8_t *hash = NULL;
 
-    if (compute_hash(data, &hash) == false)
+    if (shingle_hash >= SHINGLE_HASH_END)
+        return NULL;
+
+    if (compute_hash(data, shingle_hash, &hash) == false)
         return NULL;
 
-    char *string = simhash_to_string(hash);
+    char *string = simhash_to_string(hash, shingle_hash);
 
     free(hash);
 
@@ -207,20 +398,100 @@ float simhash_compare(char *hash_1, char *hash_2)
     if (hash_1 == NULL || hash_2 == NULL)
         return 0.0;
 
-    uint8_t *hash_1_uint = simhash_string_to_uint(hash_1);
-    if (hash_1_uint == NULL)
+    /* Decoded on the stack, without allocation */
+    shingle_hash_e shingle_hash_1, shingle_hash_2;
+    uint8_t value_1[SIMHASH_SIZE], value_2[SIMHASH_SIZE];
+    if (!simhash_decode(hash_1, &shingle_hash_1, value_1) ||
+        !simhash_decode(hash_2, &shingle_hash_2, value_2))
         return 0.0;
 
-    uint8_t *hash_2_uint = simhash_string_to_uint(hash_2);
-    if (hash_2_uint == NULL) {
-        free(hash_1_uint);
+    /* Mixed shingle hash functions can't be compared */
+    if (shingle_hash_1 != shingle_hash_2)
         return 0.0;
+
+    return compare_hash(value_1, value_2);
+}
+
+bool simhash_decode(const char *hash, shingle_hash_e *shingle_hash,
+                    uint8_t value[SIMHASH_SIZE])
+{
+    if (hash == NULL || shingle_hash == NULL || value == NULL)
+        return false;
+
+    char *digits = (char *) hash;
+    *shingle_hash = simhash_string_shingle_hash(&digits);
+    if (*shingle_hash == SHINGLE_HASH_END)
+        return false;
+
+    for (uint8_t i = 0; i < SIMHASH_SIZE; i++) {
+        int byte = hex_byte(&digits[i * 2]);
+        if (byte < 0)
+            return false;
+        value[i] = byte;
     }
 
-    float res = compare_hash(hash_1_uint, hash_2_uint);
+    return digits[SIMHASH_SIZE * 2] == '\0';
+}
 
-    free(hash_1_uint);
-    free(hash_2_uint);
+float simhash_compare_values(const uint8_t value_1[SIMHASH_SIZE],
+                             const uint8_t value_2[SIMHASH_SIZE])
+{
+    return compare_hash(value_1, value_2);
+}
 
-    return res;
-}
\ No newline at end of file
+uint32_t simhash_distance(const uint8_t value_1[SIMHASH_SIZE],
+                          const uint8_t value_2[SIMHASH_SIZE],
+                          uint32_t max_distance)
+{
+    uint32_t dist = 0;
+    for (uint8_t i = 0; i < SIMHASH_SIZE; i += sizeof(uint64_t)) {
+        uint64_t word_1, word_2;
+        memcpy(&word_1, &value_1[i], sizeof(uint64_t));
+        memcpy(&word_2, &value_2[i], sizeof(uint64_t));
+
+        dist += __builtin_popcountll(word_1 ^ word_2);
+        if (dist > max_distance)
+            break;
+    }
+
+    return dist;
+}
+
+void simhash_distances(const uint8_t query[SIMHASH_SIZE],
+                       const uint8_t values[][SIMHASH_SIZE], uint64_t nb_values,
+                       uint32_t distances[])
+{
+    uint64_t k = 0;
+
+#if defined(__AVX512F__) && defined(__AVX512VPOPCNTDQ__)
+    /* 4 values at once : count the bits of each word, add the 2 words */
+    __m512i q =
+        _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *) query));
+    for (; k + 4 <= nb_values; k += 4) {
+        __m512i x = _mm512_xor_si512(q, _mm512_loadu_si512(values[k]));
+        __m512i count = _mm512_popcnt_epi64(x);
+        count = _mm512_add_epi64(count,
+                                 _mm512_shuffle_epi32(count, _MM_PERM_BADC));
+        count = _mm512_maskz_compress_epi64(0x55, count);
+        _mm_storeu_si128((__m128i *) &distances[k],
+                         _mm256_castsi256_si128(_mm512_cvtepi64_epi32(count)));
+    }
+#endif
+
+    for (; k < nb_values; k++)
+        distances[k] = simhash_distance(query, values[k], SIMHASH_SIZE * 8);
+}
+
+float simhash_distance_score(uint32_t distance)
+{
+    return distance_score(distance);
+}
+
+uint32_t simhash_max_distance(float min_score)
+{
+    uint32_t dist = 0;
+    while (dist < SIMHASH_SIZE * 8 && distance_score(dist + 1) >= min_score)
+        dist++;
+
+    return dist;
+}
@@ -0,0 +1,267 @@
+#include "simhash_index.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* At most 32 chunks of 4 bits or more */
+#define SIMHASH_INDEX_MAX_CHUNKS 32
+/* A lookup costs about as much as comparing this many values in a scan */
+#define SIMHASH_INDEX_LOOKUP_COST 8
+
+/* Chunk of a value */
+typedef struct {
+    uint64_t key;
+    uint64_t id;
+} simhash_posting_t;
+
+/*
+ * Internal structure (hiden from outside) to represent the index.
+ * The postings of each chunk are grouped by the low bits of their key, by
+ * increasing id : the bucket of a key starts at offsets[key & mask].
+ */
+struct _simhash_index_t {
+    const uint8_t (*values)[SIMHASH_SIZE];
+    uint64_t nb_values;
+    uint64_t *ids; /* Sorted */
+    uint64_t nb_ids;
+    uint32_t radius;
+
+    /* Searching the tables would cost more than comparing every value */
+    bool scan;
+    uint32_t nb_chunks;
+    uint32_t first_bit[SIMHASH_INDEX_MAX_CHUNKS + 1];
+    uint64_t mask; /* Of the buckets */
+    uint64_t *offsets[SIMHASH_INDEX_MAX_CHUNKS];
+    simhash_posting_t *postings[SIMHASH_INDEX_MAX_CHUNKS];
+};
+
+/* Search of the neighbors of a value */
+typedef struct {
+    const simhash_index_t *index;
+    uint64_t words[2]; /* Of the value */
+    uint64_t first_id;
+    uint64_t *neighbors;
+    uint32_t *distances;
+    uint64_t nb_neighbors;
+} simhash_search_t;
+
+/* Static Functions */
+
+static void get_words(const uint8_t value[SIMHASH_SIZE], uint64_t words[2])
+{
+    memcpy(words, value, SIMHASH_SIZE);
+}
+
+/* Bits [first, first + width) of the words, width being at most 64 */
+static uint64_t get_bits(const uint64_t words[2], uint32_t first,
+                         uint32_t width)
+{
+    uint64_t bits = words[first / 64] >> (first % 64);
+    if (first % 64 + width > 64)
+        bits |= words[first / 64 + 1] << (64 - first % 64);
+
+    return (width == 64) ? bits : bits & ((1ULL << width) - 1);
+}
+
+/* Key of the chunk c of the words */
+static uint64_t get_key(const simhash_index_t *index, const uint64_t words[2],
+                        uint32_t c)
+{
+    return get_bits(words, index->first_bit[c],
+                    index->first_bit[c + 1] - index->first_bit[c]);
+}
+
+static int compare_id(const void *id_1, const void *id_2)
+{
+    uint64_t i1 = *(const uint64_t *) id_1, i2 = *(const uint64_t *) id_2;
+    return (i1 < i2) ? -1 : (i1 > i2);
+}
+
+/* Add the id to the neighbors if its value is within the radius */
+static void add_neighbor(simhash_search_t *search, uint64_t id,
+                         const uint64_t words[2])
+{
+    uint32_t dist = __builtin_popcountll(search->words[0] ^ words[0]) +
+                    __builtin_popcountll(search->words[1] ^ words[1]);
+    if (dist > search->index->radius)
+        return;
+
+    search->neighbors[search->nb_neighbors] = id;
+    search->distances[search->nb_neighbors++] = dist;
+}
+
+/* Look for the values having the key for their chunk c */
+static void lookup(simhash_search_t *search, uint32_t c, uint64_t key)
+{
+    const simhash_index_t *index = search->index;
+    const simhash_posting_t *postings = index->postings[c];
+    uint64_t bucket = key & index->mask;
+
+    uint64_t end = index->offsets[c][bucket + 1];
+    for (uint64_t k = index->offsets[c][bucket]; k < end; k++) {
+        if (postings[k].key != key || postings[k].id < search->first_id)
+            continue;
+
+        uint64_t words[2];
+        get_words(index->values[postings[k].id], words);
+        uint64_t diff[2] = {search->words[0] ^ words[0],
+                            search->words[1] ^ words[1]};
+
+        /* Already found with a previous chunk */
+        uint32_t prev = 0;
+        while (prev < c && get_key(index, diff, prev) != 0)
+            prev++;
+        if (prev == c)
+            add_neighbor(search, postings[k].id, words);
+    }
+}
+
+/*
+ * Cost of a search in nb_chunks chunks, compared with a scan of the nb_ids
+ * values : a lookup per chunk, and the values found with each
+ */
+static double search_cost(uint32_t nb_chunks, uint64_t nb_ids)
+{
+    uint32_t width = SIMHASH_SIZE * 8 / nb_chunks;
+    double nb_keys = (width >= 64) ? 0x1p64 : (double) (1ULL << width);
+
+    return nb_chunks * (1.0 + nb_ids / nb_keys) * SIMHASH_INDEX_LOOKUP_COST;
+}
+
+/* External functions */
+
+simhash_index_t *simhash_index_new(const uint8_t values[][SIMHASH_SIZE],
+                                   uint64_t nb_values, const uint64_t ids[],
+                                   uint64_t nb_ids, uint32_t radius)
+{
+    if (values == NULL || (ids == NULL && nb_ids > 0))
+        return NULL;
+
+    simhash_index_t *index = calloc(1, sizeof(simhash_index_t));
+    if (index == NULL)
+        return NULL;
+
+    index->values = values;
+    index->nb_values = nb_values;
+    index->nb_ids = nb_ids;
+    index->radius = radius;
+
+    index->ids = malloc(sizeof(uint64_t) * (nb_ids + 1));
+    if (index->ids == NULL)
+        goto err_index;
+    for (uint64_t k = 0; k < nb_ids; k++) {
+        if (ids[k] >= nb_values)
+            goto err_index;
+        index->ids[k] = ids[k];
+    }
+    qsort(index->ids, nb_ids, sizeof(uint64_t), compare_id);
+
+    /*
+     * radius + 1 chunks : the values within radius bits have a chunk in common.
+     * Wider chunks within a few bits would need more lookups.
+     */
+    uint32_t nb_chunks = (radius < 1) ? 2 : radius + 1;
+    index->scan = nb_chunks > SIMHASH_INDEX_MAX_CHUNKS ||
+                  search_cost(nb_chunks, nb_ids) > nb_ids;
+    if (index->scan)
+        return index;
+
+    index->nb_chunks = nb_chunks;
+    for (uint32_t c = 0; c <= index->nb_chunks; c++)
+        index->first_bit[c] = c * SIMHASH_SIZE * 8 / index->nb_chunks;
+
+    /* About one value per bucket */
+    uint32_t bucket_bits = 64 - __builtin_clzll(nb_ids | 1);
+    if (bucket_bits > index->first_bit[1])
+        bucket_bits = index->first_bit[1];
+    index->mask = (1ULL << bucket_bits) - 1;
+
+    for (uint32_t c = 0; c < index->nb_chunks; c++) {
+        uint64_t *offsets = calloc(index->mask + 2, sizeof(uint64_t));
+        simhash_posting_t *postings =
+            malloc(sizeof(simhash_posting_t) * (nb_ids + 1));
+        index->offsets[c] = offsets;
+        index->postings[c] = postings;
+        if (offsets == NULL || postings == NULL)
+            goto err_index;
+
+        /* Counting sort by bucket, the ids staying in order */
+        for (uint64_t k = 0; k < nb_ids; k++) {
+            uint64_t words[2];
+            get_words(values[index->ids[k]], words);
+            offsets[(get_key(index, words, c) & index->mask) + 1]++;
+        }
+        for (uint64_t bucket = 1; bucket <= index->mask + 1; bucket++)
+            offsets[bucket] += offsets[bucket - 1];
+
+        for (uint64_t k = 0; k < nb_ids; k++) {
+            uint64_t words[2];
+            get_words(values[index->ids[k]], words);
+            uint64_t key = get_key(index, words, c);
+            postings[offsets[key & index->mask]++] =
+                (simhash_posting_t){.key = key, .id = index->ids[k]};
+        }
+
+        /* offsets[bucket] is now the start of the next bucket */
+        memmove(&offsets[1], offsets, sizeof(uint64_t) * (index->mask + 1));
+        offsets[0] = 0;
+    }
+
+    return index;
+
+err_index:
+    simhash_index_free(index);
+    return NULL;
+}
+
+void simhash_index_free(simhash_index_t *index)
+{
+    if (index == NULL)
+        return;
+
+    for (uint32_t c = 0; c < index->nb_chunks; c++) {
+        free(index->offsets[c]);
+        free(index->postings[c]);
+    }
+    free(index->ids);
+    free(index);
+}
+
+bool simhash_index_scans(const simhash_index_t *index)
+{
+    return index != NULL && index->scan;
+}
+
+uint64_t simhash_index_neighbors(const simhash_index_t *index,
+                                 const uint8_t value[SIMHASH_SIZE],
+                                 uint64_t first_id, uint64_t neighbors[],
+                                 uint32_t distances[])
+{
+    if (index == NULL || value == NULL || neighbors == NULL ||
+        distances == NULL)
+        return 0;
+
+    simhash_search_t search = {.index = index,
+                               .first_id = first_id,
+                               .neighbors = neighbors,
+                               .distances = distances};
+    get_words(value, search.words);
+
+    if (index->scan) {
+        for (uint64_t k = 0; k < index->nb_ids; k++) {
+            if (index->ids[k] < first_id)
+                continue;
+
+            uint64_t words[2];
+            get_words(index->values[index->ids[k]], words);
+            add_neighbor(&search, index->ids[k], words);
+        }
+        return search.nb_neighbors;
+    }
+
+    for (uint32_t c = 0; c < index->nb_chunks; c++)
+        lookup(&search, c, get_key(index, search.words, c));
+
+    return search.nb_neighbors;
+}
@@ -0,0 +1,146 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "spill.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/types.h>
+
+#define SPILL_DEFAULT_CAPACITY 16
+
+/* Chunks of a partition written to the file, and its chunk being filled */
+typedef struct {
+    spill_record_t *buffer; /* SPILL_CHUNK_SIZE records, NULL if none yet */
+    uint64_t nb_buffered;
+    uint64_t *offsets; /* Of the chunks in the file */
+    uint64_t nb_chunks;
+    uint64_t capacity;
+} spill_partition_t;
+
+/* Internal structure (hiden from outside) to represent the records spilled */
+struct _spill_t {
+    FILE *file;
+    uint64_t size; /* Of the file */
+    uint64_t nb_partitions;
+    spill_partition_t *partitions;
+};
+
+/* Static Functions */
+
+/* Write the chunk being filled of the partition, return false if problems */
+static bool write_chunk(spill_t *spill, spill_partition_t *partition)
+{
+    if (partition->nb_chunks == partition->capacity) {
+        uint64_t capacity = partition->capacity ? partition->capacity * 2
+                                                : SPILL_DEFAULT_CAPACITY;
+        uint64_t *offsets =
+            realloc(partition->offsets, sizeof(uint64_t) * capacity);
+        if (offsets == NULL)
+            return false;
+
+        partition->offsets = offsets;
+        partition->capacity = capacity;
+    }
+
+    if (fseeko(spill->file, spill->size, SEEK_SET) != 0 ||
+        fwrite(partition->buffer, sizeof(spill_record_t), SPILL_CHUNK_SIZE,
+               spill->file) != SPILL_CHUNK_SIZE)
+        return false;
+
+    partition->offsets[partition->nb_chunks++] = spill->size;
+    spill->size += sizeof(spill_record_t) * SPILL_CHUNK_SIZE;
+    partition->nb_buffered = 0;
+
+    return true;
+}
+
+/* External functions */
+
+spill_t *spill_new(uint64_t nb_partitions)
+{
+    spill_t *spill = calloc(1, sizeof(spill_t));
+    if (spill == NULL)
+        return NULL;
+
+    spill->nb_partitions = nb_partitions;
+    spill->partitions = calloc(nb_partitions + 1, sizeof(spill_partition_t));
+    spill->file = tmpfile();
+    if (spill->partitions == NULL || spill->file == NULL) {
+        spill_free(spill);
+        return NULL;
+    }
+
+    return spill;
+}
+
+void spill_free(spill_t *spill)
+{
+    if (spill == NULL)
+        return;
+
+    if (spill->file != NULL)
+        fclose(spill->file);
+
+    for (uint64_t p = 0; spill->partitions != NULL && p < spill->nb_partitions;
+         p++) {
+        free(spill->partitions[p].buffer);
+        free(spill->partitions[p].offsets);
+    }
+    free(spill->partitions);
+    free(spill);
+}
+
+uint64_t spill_memory(uint64_t nb_partitions)
+{
+    return sizeof(spill_t) +
+           nb_partitions * (sizeof(spill_partition_t) +
+                            sizeof(spill_record_t) * SPILL_CHUNK_SIZE);
+}
+
+bool spill_add(spill_t *spill, uint64_t partition,
+               const spill_record_t *record)
+{
+    if (spill == NULL || partition >= spill->nb_partitions || record == NULL)
+        return false;
+
+    spill_partition_t *part = &spill->partitions[partition];
+    if (part->buffer == NULL) {
+        part->buffer = malloc(sizeof(spill_record_t) * SPILL_CHUNK_SIZE);
+        if (part->buffer == NULL)
+            return false;
+    }
+
+    if (part->nb_buffered == SPILL_CHUNK_SIZE && !write_chunk(spill, part))
+        return false;
+
+    part->buffer[part->nb_buffered++] = *record;
+    return true;
+}
+
+uint64_t spill_read(spill_t *spill, uint64_t partition, uint64_t chunk,
+                    spill_record_t records[SPILL_CHUNK_SIZE])
+{
+    if (spill == NULL || partition >= spill->nb_partitions || records == NULL)
+        return UINT64_MAX;
+
+    spill_partition_t *part = &spill->partitions[partition];
+
+    /* The last chunk is still in memory */
+    if (chunk == part->nb_chunks) {
+        if (part->nb_buffered > 0)
+            memcpy(records, part->buffer,
+                   sizeof(spill_record_t) * part->nb_buffered);
+        return part->nb_buffered;
+    }
+    if (chunk > part->nb_chunks)
+        return 0;
+
+    if (fseeko(spill->file, part->offsets[chunk], SEEK_SET) != 0 ||
+        fread(records, sizeof(spill_record_t), SPILL_CHUNK_SIZE, spill->file) !=
+            SPILL_CHUNK_SIZE)
+        return UINT64_MAX;
+
+    return SPILL_CHUNK_SIZE;
+}
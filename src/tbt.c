@@ -1,9 +1,19 @@
 /* INCLUDES */
+#define _POSIX_C_SOURCE 200809L
+
 #include "tbt.h"
+#include "cluster.h"
+#include "compare.h"
+#include "compare_blocks.h"
 #include "ctph.h"
+#include "daemon.h"
 #include "elf_manager.h"
+#include "shard.h"
+#include "sig_db.h"
+#include "sig_store.h"
 #include "simhash.h"
 
+#include <stdarg.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -13,33 +23,63 @@
 #include <errno.h>
 #include <getopt.h>
 #include <inttypes.h>
+#include <pthread.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 
 #include <unistd.h>
 /* DEFINES */
-#define LINE_BUF_SIZE 400
+#ifndef MIN
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#endif
 
 /* ENUMS */
 typedef enum { ALL, CTPH, SIMHASH } algorithm;
 
+/* Options without short name */
+/* clang-format off */
+typedef enum
+{
+  OPT_TOP = 256,
+  OPT_MIN_SCORE,
+  OPT_CTPH_INDEX,
+  OPT_SIMHASH_RADIUS,
+  OPT_CLUSTER,
+  OPT_SHARD,
+  OPT_MERGE_SHARDS,
+  OPT_MEM_LIMIT,
+  OPT_CASCADE,
+  OPT_DAEMON
+} long_option_e;
+/* clang-format on */
+
 /* GLOBAL VARIABLES */
-static bool verbose = false, comparision_wanted = false;
+static bool verbose = false, comparision_wanted = false, use_mmap = false;
 static FILE *OUTPUT = NULL;
+static sig_db_t *OUTPUT_DB = NULL; /* Hashes to write in binary or query */
 static algorithm chosen_algorithm = ALL;
+static uint64_t nb_jobs = 1;
+static uint64_t top_matches = 0;
+static float min_score = 0.0;
+static bool ctph_index_wanted = false;
+static int simhash_radius = -1; /* All the pairs */
+static int cascade_radius = -1;  /* No cascade */
+static float cluster_threshold = -1.0; /* Ranked lists instead of clusters */
+static shard_header_t shard = {0};       /* Written if nb_shards > 0 */
+static char **shard_paths = NULL;        /* Of the shards to merge */
+static FILE **shard_files = NULL;
+static uint64_t nb_shard_files = 0;
+static uint64_t mem_limit = 0; /* Bytes for the comparision, 0 for no limit */
+static shingle_hash_e chosen_shingle_hash = SHINGLE_HASH_MD5;
 
 /* Structures */
-typedef struct {
-    char name[LINE_BUF_SIZE];
-    char SIMHASH_hash[33];
-    char CTPH_hash[150];
-} file_info_t;
-
+/* Fuzzy hashes of a file, NULL if not computed */
 typedef struct {
     char *name;
-    float percentage;
-} res_comp_t;
+    char *ctph;
+    char *simhash;
+} file_hashes_t;
 
 /* FUNCTIONS */
 
@@ -57,12 +97,46 @@ static void close_output()
  */
 static void help(void)
 {
-    printf("Usage: tbt [-a ALGO|-o FILE|-c|-v|-V|-h] FILE|DIR\n"
+    printf("Usage: tbt [-a ALGO|-o FILE|-b|-c|-j N|-m|-s HASH|-v|-V|-h] "
+           "FILE|DIR\n"
+           "       tbt -q NEW -d DB [-a ALGO|-o FILE|-j N|-m|-s HASH]\n"
+           "       tbt --merge-shards [-a ALGO|-o FILE] FILE SHARD...\n"
+           "       tbt --daemon SOCKET [-a ALGO|-j N|-m|-s HASH] [FILE]\n"
            "Compute Fuzzy Hashing\n\n"
            " -a ALGO,--algorithm ALGO\tALGO : CTPH|SIMHASH|ALL\n"
+           " -b,--binary\t\t\twrite the hashes in a binary signature "
+           "database\n"
            " -c ,--compareHashes\t\tCompare the hashes stored in the given "
            "file\n"
+           " --cascade R\t\t\tonly compare the CTPH of the SimHash within "
+           "R bits\n"
+           " --cluster T\t\t\toutput the clusters of the files matching at "
+           "least T %%\n"
+           " --ctph-index\t\t\tonly compare the CTPH sharing 7 characters "
+           "in a row\n"
+           " -d DB,--database DB\t\tsignature database compared with the "
+           "query\n"
+           " --daemon SOCKET\t\tserve the signatures of FILE on the "
+           "Unix SOCKET\n"
+           " -j N,--jobs N\t\t\tuse N threads, 0 for one per processor\n"
+           " --merge-shards\t\t\tmerge the SHARD files of the comparision "
+           "of FILE\n"
+           " --mem-limit SIZE\t\tcompare by blocks within SIZE bytes "
+           "(K, M or G)\n"
+           " -m,--mmap\t\t\tmap the files in memory instead of "
+           "reading them\n"
+           " --min-score S\t\t\tonly output the matches scoring at least "
+           "S %%\n"
            " -o FILE,--output FILE\t\twrite result to FILE\n"
+           " -q NEW,--query NEW\t\tonly compare NEW (ELF file, directory or "
+           "hashes) with DB\n"
+           " --shard I/N\t\t\tonly compare the slice I of N, see "
+           "--merge-shards\n"
+           " -s HASH,--shingle-hash HASH\tHASH : MD5|WY, hash of the "
+           "SimHash shingles\n"
+           " --simhash-radius R\t\tonly compare the SimHash within R bits, "
+           "indexed\n"
+           " --top K\t\t\tonly output the K best matches of each file\n"
            " -v,--verbose\t\t\tverbose output\n"
            " -V,--version\t\t\tdisplay version and exit\n"
            " -h,--help\t\t\tdisplay this help\n");
@@ -79,197 +153,263 @@ static void version(void)
            REVISION);
     exit(EXIT_SUCCESS);
 }
-/**
- * compara function used by the quick_sort() function
+/*
+ * Outputs the clusters of the files of the database, with their size and
+ * their medoid
  */
-static int compare_result(const void *res_1, const void *res_2)
+static void print_clusters(sig_db_t *db, const compare_result_t *result)
 {
-    return ((res_comp_t *) res_2)->percentage -
-           ((res_comp_t *) res_1)->percentage;
+    cluster_result_t *clusters = cluster_new(result, cluster_threshold);
+    if (clusters == NULL)
+        errx(EXIT_FAILURE, "cluster malloc!");
+
+    for (uint64_t c = 0; c < clusters->nb_clusters; c++) {
+        uint64_t size = cluster_size(clusters, c);
+        fprintf(OUTPUT,
+                "\ncluster %" PRIu64 " : %" PRIu64 " file%s, medoid %s\n", c,
+                size, (size > 1) ? "s" : "",
+                sig_db_get_name(db, clusters->medoids[c]));
+
+        for (uint64_t k = clusters->first[c]; k < clusters->first[c + 1]; k++)
+            fprintf(OUTPUT, "\t%s\n", sig_db_get_name(db, clusters->files[k]));
+    }
+
+    cluster_free(clusters);
 }
+
 /*
- * Outputs the likeness percentage of all files
+ * Outputs the matches of the files first + i of files, whose lists are the
+ * ones of the result, with the files of the database
  */
-static void comparision(int nb_files, file_info_t file_content[])
+static void print_lists(sig_db_t *files, sig_db_t *db, compare_algorithm_e algo,
+                        const compare_result_t *result, uint64_t first)
 {
-    res_comp_t results[nb_files];
-
-    if (chosen_algorithm == ALL || chosen_algorithm == CTPH) {
-        fprintf(OUTPUT, "--- CTPH ---\n");
-
-        for (int i = 0; i < nb_files; i++) {
-            fprintf(OUTPUT, "\n%s :\n", file_content[i].name);
+    for (uint64_t i = 0; i < result->nb_files; i++) {
+        fprintf(OUTPUT, "\n%s :\n", sig_db_get_name(files, first + i));
+
+        compare_list_t *list = &result->lists[i];
+        for (uint64_t k = 0; k < list->nb_matches; k++) {
+            uint64_t index = list->matches[k].index;
+            const char *name = sig_db_get_name(db, index);
+            if (cascade_radius >= 0)
+                fprintf(OUTPUT, "[ %03.f %% | %06.02f %% ] %s\n",
+                        list->matches[k].score,
+                        compare_simhash_score(files, first + i, db, index),
+                        name);
+            else if (algo == COMPARE_CTPH)
+                fprintf(OUTPUT, "[ %03.f %% ] %s\n", list->matches[k].score,
+                        name);
+            else
+                fprintf(OUTPUT, "[ %06.02f %% ] %s\n",
+                        list->matches[k].score, name);
+        }
+    }
+}
 
-            /* Sort result */
-            for (int j = 0; j < nb_files; j++) {
-                results[j].name = file_content[j].name;
-                results[j].percentage = (float) ctph_compare(
-                    file_content[i].CTPH_hash, file_content[j].CTPH_hash);
-            }
+/* Options of the comparisions */
+static compare_options_t get_options(void)
+{
+    compare_options_t options = {
+        .nb_jobs = nb_jobs,
+        .top = top_matches,
+        .min_score = min_score,
+        .ctph_index = ctph_index_wanted,
+        .simhash_radius = simhash_radius,
+        .cascade = cascade_radius >= 0,
+        .shard = shard.shard,
+        .nb_shards = shard.nb_shards};
+
+    /* The SimHash radius of the cascade filters the CTPH pairs */
+    if (options.cascade)
+        options.simhash_radius = cascade_radius;
+
+    /* Only the pairs linking the clusters are kept */
+    if (cluster_threshold > options.min_score)
+        options.min_score = cluster_threshold;
+
+    return options;
+}
 
-            qsort(results, nb_files, sizeof(res_comp_t), compare_result);
+/*
+ * Header of the shard of the comparision of the database, the minimum score
+ * not raised by --cluster which can be given to the merge only
+ */
+static shard_header_t get_shard_header(const sig_db_t *db)
+{
+    compare_options_t options = get_options();
+    shard_header_t header = shard;
+    header.nb_files = db->nb_entries;
+    header.fingerprint = shard_fingerprint(db);
+    header.top = options.top;
+    header.min_score = min_score;
+    header.ctph_index = options.ctph_index;
+    header.simhash_radius = options.simhash_radius;
+    header.cascade = options.cascade;
+
+    return header;
+}
 
-            /* Print */
-            for (int j = 0; j < nb_files; j++) {
-                if (strcmp(file_content[i].name, results[j].name) == 0)
-                    continue;
-                if (results[j].percentage == 0.0)
-                    continue;
+/* Name of the section of the algorithm in the shards */
+static const char *get_shard_name(compare_algorithm_e algo)
+{
+    if (cascade_radius >= 0)
+        return "CASCADE";
+    return (algo == COMPARE_CTPH) ? "CTPH" : "SIMHASH";
+}
 
-                fprintf(OUTPUT, "[ %03.f %% ] %s\n", results[j].percentage,
-                        results[j].name);
-            }
-        }
+/*
+ * Matches of the files of the database read from the shards, the same as if
+ * the database was compared at once
+ */
+static compare_result_t *merge_shards(sig_db_t *db, compare_algorithm_e algo)
+{
+    compare_options_t options = get_options();
+    compare_result_t *result = compare_result_new(db->nb_entries);
+    if (result == NULL)
+        errx(EXIT_FAILURE, "comparision malloc!");
+
+    for (uint64_t k = 0; k < nb_shard_files; k++)
+        if (!shard_read_matches(shard_files[k], get_shard_name(algo), result,
+                                options.min_score, options.top))
+            errx(EXIT_FAILURE, "error: invalid %s matches in the shard '%s'",
+                 get_shard_name(algo), shard_paths[k]);
+
+    compare_result_sort(result);
+    return result;
+}
 
-        fprintf(OUTPUT, "\n");
+/*
+ * Outputs the likeness percentage of each file with the others, comparing the
+ * database by blocks within the memory limit
+ */
+static void print_blocks(sig_db_t *db, compare_algorithm_e algo)
+{
+    compare_options_t options = get_options();
+    uint64_t block_size =
+        compare_blocks_size(db->nb_entries, &options, mem_limit);
+    if (block_size == 0)
+        errx(EXIT_FAILURE, "error: --mem-limit is too low");
+
+    compare_blocks_t *blocks =
+        compare_blocks_new(db, algo, &options, block_size);
+    if (blocks == NULL)
+        errx(EXIT_FAILURE, "comparision malloc!");
+
+    for (uint64_t b = 0; b < compare_blocks_count(blocks); b++) {
+        compare_result_t *result = compare_blocks_result(blocks, b);
+        if (result == NULL)
+            errx(EXIT_FAILURE, "error: can't read the spilled matches");
+
+        print_lists(db, db, algo, result, b * block_size);
+        compare_result_free(result);
     }
-    if (chosen_algorithm == ALL || chosen_algorithm == SIMHASH) {
-        fprintf(OUTPUT, "--- SIMHASH ---\n");
-
-        for (int i = 0; i < nb_files; i++) {
-            fprintf(OUTPUT, "\n%s :\n", file_content[i].name);
 
-            /* Sort result */
-            for (int j = 0; j < nb_files; j++) {
+    compare_blocks_free(blocks);
+}
 
-                results[j].name = file_content[j].name;
-                results[j].percentage = simhash_compare(
-                    file_content[i].SIMHASH_hash, file_content[j].SIMHASH_hash);
-            }
+/*
+ * Outputs the likeness percentage of each file with the others, or of each
+ * query with the files of the database if queries isn't NULL
+ */
+static void print_comparision(sig_db_t *queries, sig_db_t *db,
+                              compare_algorithm_e algo)
+{
+    compare_options_t options = get_options();
+    compare_result_t *result;
+    if (mem_limit > 0 && queries == NULL && nb_shard_files == 0) {
+        print_blocks(db, algo);
+        return;
+    }
 
-            qsort(results, nb_files, sizeof(res_comp_t), compare_result);
+    if (nb_shard_files > 0)
+        result = merge_shards(db, algo);
+    else if (queries == NULL)
+        result = compare_all(db, algo, &options);
+    else
+        result = compare_query(queries, db, algo, &options);
+    if (result == NULL)
+        errx(EXIT_FAILURE, "comparision malloc!");
+
+    if (queries == NULL && cluster_threshold >= 0.0) {
+        print_clusters(db, result);
+        compare_result_free(result);
+        return;
+    }
 
-            /* Print */
-            for (int j = 0; j < nb_files; j++) {
-                if (strcmp(file_content[i].name, results[j].name) == 0)
-                    continue;
-                if (results[j].percentage == 0.0)
-                    continue;
+    print_lists(queries ? queries : db, db, algo, result, 0);
+    compare_result_free(result);
+}
 
-                fprintf(OUTPUT, "[ %06.02f %% ] %s\n", results[j].percentage,
-                        results[j].name);
-            }
-        }
+/*
+ * Write the matches of the shard of the comparision of the database, for each
+ * algorithm
+ */
+static void write_shard(sig_db_t *db)
+{
+    shard_header_t header = get_shard_header(db);
+    if (!shard_write_header(OUTPUT, &header))
+        errx(EXIT_FAILURE, "error: can't write the shard");
+
+    for (compare_algorithm_e algo = COMPARE_CTPH; algo < COMPARE_END; algo++) {
+        if (chosen_algorithm != ALL &&
+            chosen_algorithm != ((algo == COMPARE_CTPH) ? CTPH : SIMHASH))
+            continue;
+        /* The cascade only scores CTPH */
+        if (cascade_radius >= 0 && algo != COMPARE_CTPH)
+            continue;
+
+        compare_options_t options = get_options();
+        compare_result_t *result = compare_all(db, algo, &options);
+        if (result == NULL)
+            errx(EXIT_FAILURE, "comparision malloc!");
+
+        if (!shard_write_matches(OUTPUT, get_shard_name(algo), result))
+            errx(EXIT_FAILURE, "error: can't write the shard");
+        compare_result_free(result);
     }
 }
 
-/**
- * Returns the number of files concerned by the comparision mode
- * 0 if none
+/*
+ * Outputs the likeness percentage of all files, or of the queries with the
+ * database if queries isn't NULL. Only the shard is written if one is wanted.
  */
-static uint64_t get_nb_files(FILE *in)
+static void comparision(sig_db_t *queries, sig_db_t *db)
 {
-    uint64_t nb_files = 0;
-    char line_buf[LINE_BUF_SIZE];
+    if (shard.nb_shards > 0) {
+        write_shard(db);
+        return;
+    }
 
-    /* Returning to the beginning of the file */
-    if (fseek(in, 0, SEEK_SET) != 0)
-        errx(EXIT_FAILURE, "Couldn't return to the beginning of the file");
+    if (cascade_radius >= 0) {
+        fprintf(OUTPUT, "--- CASCADE ---\n");
+        print_comparision(queries, db, COMPARE_CTPH);
+        return;
+    }
 
-    /* Get nb_files */
-    fgets(line_buf, LINE_BUF_SIZE, in);
-    while (!feof(in)) {
-        if (ferror(in)) {
-            fprintf(stderr, "Reading error with code %d\n", errno);
-            break;
-        }
-        if (line_buf[0] == '\t')
-            fgets(line_buf, LINE_BUF_SIZE, in);
-        else {
-            nb_files++;
-            fgets(line_buf, LINE_BUF_SIZE, in);
-        }
+    if (chosen_algorithm == ALL || chosen_algorithm == CTPH) {
+        fprintf(OUTPUT, "--- CTPH ---\n");
+        print_comparision(queries, db, COMPARE_CTPH);
+        fprintf(OUTPUT, "\n");
+    }
+    if (chosen_algorithm == ALL || chosen_algorithm == SIMHASH) {
+        fprintf(OUTPUT, "--- SIMHASH ---\n");
+        print_comparision(queries, db, COMPARE_SIMHASH);
     }
-    return nb_files;
 }
 
-/* DEBUG STRUCT PRINT */
 /**
- * static void print_struct(file_info_t file_content[], uint64_t size)
- * {
- *     for (uint64_t i = 0; i < size; i++) {
- *         printf("%s\n", file_content[i].name);
- *         printf("%s\n", file_content[i].CTPH_hash);
- *         // for (int i = 0; i < 32; i++)
- *         printf("%s\n", file_content[i].SIMHASH_hash);
- *         if (i != size - 1)
- *             printf("\n");
- *     }
- * }
+ * Check that the algorithm required is present in the signatures, and only
+ * compare the ones present if all are required
  */
-
-/**
- * Parses the file and stores the hashes of each file in the structure
- * file_content
- */
-static void get_file_content(FILE *in, file_info_t file_content[],
-                             uint64_t nb_files)
+static void check_algorithms(sig_db_t *db)
 {
+    bool ctph_present = db->flags & SIG_DB_CTPH;
+    bool simhash_present = db->flags & SIG_DB_SIMHASH;
 
-    char line_buf[LINE_BUF_SIZE];
-    uint64_t file_count = 0;
-    int ctph_present = false, simhash_present = false;
-
-    /* Returning to the beginning of the file */
-    if (fseek(in, 0, SEEK_SET) != 0)
-        errx(EXIT_FAILURE, "Couldn't return to the beginning of the file");
+    if (cascade_radius >= 0 && (!ctph_present || !simhash_present))
+        errx(EXIT_FAILURE,
+             "error: --cascade needs the CTPH and SIMHASH hashes");
 
-    while (!feof(in)) {
-        if (ferror(in)) {
-            fprintf(stderr, "Reading error with code %d\n", errno);
-            break;
-        }
-        if (file_count > nb_files)
-            errx(EXIT_FAILURE, "Wrong number of entry in the file");
-
-        int i = 0, index = 0;
-        while (line_buf[i] != '\0') {
-            /** Checks if the content of the line is 1 (CTPH)
-             * if yes stores it
-             */
-            if (line_buf[i] == '\t') {
-                while (line_buf[i] != '1' && line_buf[i] != '2')
-                    i++;
-            } else if (line_buf[i] == '1' && i != 0 && file_count > 0) {
-                for (i = i + 2, index = 0;
-                     line_buf[i] != '\0' && line_buf[i] != '\n'; i++, index++) {
-                    file_content[file_count - 1].CTPH_hash[index] = line_buf[i];
-                }
-                ctph_present = true;
-                file_content[file_count - 1].CTPH_hash[index] = '\0';
-            }
-            /** Checks if the content of the line is 2 (SIMHASH)
-             * if yes stores it
-             */
-            else if (line_buf[i] == '2' && i != 0 && file_count > 0) {
-                for (i = i + 2, index = 0;
-                     line_buf[i] != '\0' && line_buf[i] != '\n'; i++, index++) {
-
-                    file_content[file_count - 1].SIMHASH_hash[index] =
-                        line_buf[i];
-                }
-                simhash_present = true;
-                file_content[file_count - 1].SIMHASH_hash[index] = '\0';
-            }
-            /** Checks if the content of the line is the name of the file,
-             * if yes, Stores it
-             */
-            else if (i == 0) {
-                for (index = 0; line_buf[i] != '\0' && line_buf[i] != '\n';
-                     i++, index++) {
-                    file_content[file_count].name[index] = line_buf[i];
-                }
-                file_content[file_count].name[index - 1] = '\0';
-                file_count++;
-
-                i++;
-            } else {
-                i++;
-            }
-        }
-        fgets(line_buf, LINE_BUF_SIZE, in);
-    }
-    /* check which algorithm was required and if present in the file */
     if (!ctph_present) {
         if (chosen_algorithm == CTPH)
             errx(EXIT_FAILURE,
@@ -289,28 +429,164 @@ static void get_file_content(FILE *in, file_info_t file_content[],
 }
 
 /**
- * General call to functions to get the number of files, get the hashes for each
- * file and do the comparision
+ * Load the signatures of a text hash file, in a single pass. Each entry is a
+ * line "name:" followed by lines "\t1:CTPH" and/or "\t2:SIMHASH".
  */
-static void file_parser(char *file_name)
+static sig_db_t *text_file_parser(char *file_name)
 {
     FILE *in = fopen(file_name, "r");
     if (in == NULL)
         errx(EXIT_FAILURE, "problem opening file");
 
-    uint64_t nb_files = get_nb_files(in);
-    file_info_t file_content[nb_files];
-    get_file_content(in, file_content, nb_files);
-    comparision(nb_files, file_content);
+    sig_db_t *db = sig_db_new();
+    if (db == NULL)
+        errx(EXIT_FAILURE, "signature database malloc!");
+
+    char *line = NULL;
+    size_t line_size = 0;
+    ssize_t len;
+    uint64_t line_number = 0;
+    while ((len = getline(&line, &line_size, in)) != -1) {
+        line_number++;
+
+        /* Remove the end of line */
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+            line[--len] = '\0';
+        if (len == 0)
+            continue;
+
+        /* Name of a new entry */
+        if (line[0] != '\t' && line[0] != ' ') {
+            if (line[len - 1] == ':')
+                line[--len] = '\0';
+            if (!sig_db_add(db, line, NULL, NULL))
+                errx(EXIT_FAILURE, "can't add '%s' to the signature database",
+                     line);
+            continue;
+        }
+
+        /* Hash of the last entry */
+        char *hash = line + strspn(line, "\t ");
+        if ((hash[0] != '1' && hash[0] != '2') || hash[1] != ':')
+            continue;
+        if (db->nb_entries == 0) {
+            warnx("%s:%" PRIu64 ": signature without file name, ignored",
+                  file_name, line_number);
+            continue;
+        }
+
+        /* The CTPH of tbt 1.0, without tag, can't be compared */
+        if (hash[0] == '1' && hash[2] >= '0' && hash[2] <= '9')
+            errx(EXIT_FAILURE,
+                 "error: '%s' has CTPH signatures of tbt 1.0, hash the files "
+                 "again",
+                 file_name);
+
+        uint64_t i = db->nb_entries - 1;
+        bool ctph = hash[0] == '1';
+        bool set = ctph ? sig_db_set_ctph(db, i, hash + 2)
+                        : sig_db_set_simhash(db, i, hash + 2);
+        if (!set)
+            warnx("%s:%" PRIu64 ": invalid %s signature of '%s', ignored",
+                  file_name, line_number, ctph ? "CTPH" : "SimHash",
+                  sig_db_get_name(db, i));
+    }
+    if (ferror(in))
+        fprintf(stderr, "Reading error with code %d\n", errno);
+
+    free(line);
     fclose(in);
+    return db;
 }
 
 /**
- * Treatment ELF File.
- * Return false if problems, true otherwise.
+ * Load the hashes of each file, from a binary signature database or a text
+ * hash file
  */
-static bool treat_file(char *file_path)
+static sig_db_t *load_signatures(char *file_name)
+{
+    if (!sig_db_is_file(file_name))
+        return text_file_parser(file_name);
+
+    sig_db_t *db = sig_db_map(file_name);
+    if (db == NULL)
+        errx(EXIT_FAILURE, "error: '%s' is an invalid signature database",
+             file_name);
+    return db;
+}
+
+/**
+ * General call to functions to get the hashes for each file, and do the
+ * comparision
+ */
+static void file_parser(char *file_name)
+{
+    sig_db_t *db = load_signatures(file_name);
+
+    check_algorithms(db);
+    comparision(NULL, db);
+    sig_db_free(db);
+}
+
+/**
+ * Merge the shards of the comparision of the signatures of a file, checking
+ * that each shard is given once
+ */
+static void merge_parser(char *file_name, char *paths[], uint64_t nb_paths)
+{
+    sig_db_t *db = load_signatures(file_name);
+    check_algorithms(db);
+
+    shard_paths = paths;
+    shard_files = calloc(nb_paths + 1, sizeof(FILE *));
+    bool *present = calloc(nb_paths + 1, sizeof(bool));
+    if (shard_files == NULL || present == NULL)
+        errx(EXIT_FAILURE, "shards malloc!");
+    shard_header_t expected = get_shard_header(db);
+
+    for (uint64_t k = 0; k < nb_paths; k++) {
+        shard_files[k] = fopen(paths[k], "r");
+        if (shard_files[k] == NULL)
+            errx(EXIT_FAILURE, "error: can't open the shard '%s'", paths[k]);
+
+        shard_header_t header;
+        if (!shard_read_header(shard_files[k], &header))
+            errx(EXIT_FAILURE, "error: '%s' is an invalid shard", paths[k]);
+        if (header.nb_files != expected.nb_files ||
+            header.fingerprint != expected.fingerprint)
+            errx(EXIT_FAILURE, "error: the shard '%s' isn't of '%s'", paths[k],
+                 file_name);
+        if (!shard_same_options(&header, &expected))
+            errx(EXIT_FAILURE,
+                 "error: the shard '%s' was compared with other options",
+                 paths[k]);
+        if (header.nb_shards != nb_paths)
+            errx(EXIT_FAILURE,
+                 "error: %" PRIu64 " shards expected, not %" PRIu64,
+                 header.nb_shards, nb_paths);
+        if (present[header.shard])
+            errx(EXIT_FAILURE, "error: the shard %" PRIu64 " is given twice",
+                 header.shard);
+        present[header.shard] = true;
+    }
+    nb_shard_files = nb_paths;
+
+    comparision(NULL, db);
+
+    for (uint64_t k = 0; k < nb_paths; k++)
+        fclose(shard_files[k]);
+    free(shard_files);
+    free(present);
+    sig_db_free(db);
+}
+
+/**
+ * Compute the fuzzy hashes of an ELF File.
+ * Return false if problems.
+ */
+static bool hash_file(char *file_path, file_hashes_t *hashes)
 {
+    hashes->name = hashes->ctph = hashes->simhash = NULL;
     if (file_path == NULL)
         return false;
 
@@ -320,7 +596,7 @@ static bool treat_file(char *file_path)
         return false;
 
     /* Get Data */
-    elf_data data = elf_get_data(f);
+    elf_data data = use_mmap ? elf_map_data(f) : elf_get_data(f);
     fclose(f);
     if (data == NULL)
         return false;
@@ -328,32 +604,151 @@ static bool treat_file(char *file_path)
     /* Compute Fuzzy Hashing */
     fprintf(stderr, "[+] Fuzzy hashing of '%s'\n", file_path);
 
+    char *temp_file_name = strrchr(file_path, '/');
+    temp_file_name = (temp_file_name == NULL) ? file_path : temp_file_name + 1;
+    hashes->name = strdup(temp_file_name);
+
     /* CTPH */
-    char *CTPhash = ctph_hash(data);
+    if (chosen_algorithm == ALL || chosen_algorithm == CTPH)
+        hashes->ctph = ctph_hash(data);
 
     /* LSH */
-    char *simHash = simhash_compute(data);
-
-    char *temp_file_name = strrchr(file_path, '/');
-    temp_file_name = (temp_file_name == NULL) ? file_path : temp_file_name + 1;
+    if (chosen_algorithm == ALL || chosen_algorithm == SIMHASH)
+        hashes->simhash = simhash_compute(data, chosen_shingle_hash);
 
-    /* Write the hash(es) in the output */
-    if (chosen_algorithm == ALL)
-        fprintf(OUTPUT,
-                "%s:\n\t1:%s\n\t2:"
-                "%s\n",
-                temp_file_name, CTPhash, simHash);
-    else
-        fprintf(OUTPUT, "%s:\n\t%d:%s\n", temp_file_name,
-                (chosen_algorithm == CTPH) ? 1 : 2,
-                (chosen_algorithm == CTPH) ? CTPhash : simHash);
     /* Free Data */
-    free(CTPhash);
-    free(simHash);
     elf_free(data);
+    return hashes->name != NULL;
+}
+
+/**
+ * Write the hashes of a file in the output, or add them to the binary
+ * database. Return false if problems.
+ */
+static bool write_hashes(file_hashes_t *hashes)
+{
+    if (OUTPUT_DB != NULL)
+        return sig_db_add(OUTPUT_DB, hashes->name, hashes->ctph,
+                          hashes->simhash);
+
+    fprintf(OUTPUT, "%s:\n", hashes->name);
+    if (hashes->ctph != NULL)
+        fprintf(OUTPUT, "\t1:%s\n", hashes->ctph);
+    if (hashes->simhash != NULL)
+        fprintf(OUTPUT, "\t2:%s\n", hashes->simhash);
+
     return true;
 }
 
+static void free_hashes(file_hashes_t *hashes)
+{
+    free(hashes->name);
+    free(hashes->ctph);
+    free(hashes->simhash);
+}
+
+/**
+ * Treatment ELF File.
+ * Return false if problems, true otherwise.
+ */
+static bool treat_file(char *file_path)
+{
+    file_hashes_t hashes;
+    bool ret = hash_file(file_path, &hashes);
+
+    /* Write the hash(es) in the output */
+    if (ret)
+        ret = write_hashes(&hashes);
+
+    free_hashes(&hashes);
+    return ret;
+}
+
+/* A file of a directory to hash */
+typedef struct {
+    char *name;
+    char *path;
+    off_t size;
+    file_hashes_t hashes; /* Result of hash_file() */
+    bool valid;
+    bool done;
+} dir_file_t;
+
+/* A file to hash in the schedule */
+typedef struct {
+    off_t size;
+    uint64_t index; /* Index in the files sorted by name */
+} dir_job_t;
+
+/* Work shared by the threads hashing a directory */
+typedef struct {
+    dir_file_t *files;      /* Sorted by name : output order */
+    dir_job_t *schedule;    /* Largest files first */
+    uint64_t nb_files;
+    uint64_t next_schedule; /* Next file to hash in schedule */
+    uint64_t next_output;   /* Next file to write in files */
+    pthread_mutex_t lock;
+} dir_work_t;
+
+/**
+ * compare function used to sort the files of a directory by name
+ */
+static int compare_file_name(const void *file_1, const void *file_2)
+{
+    return strcmp(((dir_file_t *) file_1)->name, ((dir_file_t *) file_2)->name);
+}
+
+/**
+ * compare function used to schedule the largest files first
+ */
+static int compare_file_size(const void *job_1, const void *job_2)
+{
+    const dir_job_t *j1 = job_1, *j2 = job_2;
+
+    if (j1->size != j2->size)
+        return (j1->size < j2->size) ? 1 : -1;
+    return (j1->index < j2->index) ? -1 : 1;
+}
+
+/**
+ * Hash the files of the schedule until there is none left. The entries are
+ * written in the order of the names as soon as all the previous ones are done.
+ */
+static void *hash_dir_files(void *arg)
+{
+    dir_work_t *work = arg;
+
+    pthread_mutex_lock(&work->lock);
+    while (work->next_schedule < work->nb_files) {
+        dir_file_t *file =
+            &work->files[work->schedule[work->next_schedule++].index];
+        pthread_mutex_unlock(&work->lock);
+
+        file_hashes_t hashes;
+        bool valid = hash_file(file->path, &hashes);
+
+        pthread_mutex_lock(&work->lock);
+        file->hashes = hashes;
+        file->valid = valid;
+        file->done = true;
+
+        /* Write all the entries ready in order */
+        while (work->next_output < work->nb_files &&
+               work->files[work->next_output].done) {
+            dir_file_t *out = &work->files[work->next_output++];
+            if (out->valid) {
+                if (!write_hashes(&out->hashes))
+                    warnx("can't write the hashes of '%s'", out->name);
+            } else if (verbose)
+                warnx("'%s' is an invalid file", out->name);
+            free_hashes(&out->hashes);
+        }
+    }
+    pthread_mutex_unlock(&work->lock);
+
+    return NULL;
+}
+
 /**
  * Treatment Directory
  */
@@ -368,33 +763,260 @@ static bool treat_dir(char *dir_path)
         return false;
 
     /* Get File(s) */
+    dir_work_t work = {.files = NULL, .nb_files = 0};
+    uint64_t capacity = 0;
     struct dirent *file;
-    char path[strlen(dir_path) + 1024];
+    bool ret = true;
+
     while ((file = readdir(dir)) != NULL) {
-        sprintf(path, "%s%s", dir_path, file->d_name);
-        /* Treat File */
-        if (!treat_file(path))
-            if (verbose)
-                warnx("'%s' is an invalid file", file->d_name);
+        if (work.nb_files == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            dir_file_t *files =
+                realloc(work.files, sizeof(dir_file_t) * capacity);
+            if (files == NULL) {
+                ret = false;
+                break;
+            }
+            work.files = files;
+        }
+
+        dir_file_t *f = &work.files[work.nb_files];
+        f->path = malloc(strlen(dir_path) + strlen(file->d_name) + 1);
+        if (f->path == NULL) {
+            ret = false;
+            break;
+        }
+        sprintf(f->path, "%s%s", dir_path, file->d_name);
+        f->name = f->path + strlen(dir_path);
+        f->done = false;
+
+        struct stat info;
+        f->size = (stat(f->path, &info) == 0) ? info.st_size : 0;
+        work.nb_files++;
     }
 
     /* Close Dir */
     closedir(dir);
+
+    work.schedule = malloc(sizeof(dir_job_t) * (work.nb_files + 1));
+    if (work.schedule == NULL)
+        ret = false;
+
+    if (ret) {
+        /* Output by name, hash the largest files first */
+        qsort(work.files, work.nb_files, sizeof(dir_file_t), compare_file_name);
+        for (uint64_t i = 0; i < work.nb_files; i++)
+            work.schedule[i] = (dir_job_t){work.files[i].size, i};
+        qsort(work.schedule, work.nb_files, sizeof(dir_job_t),
+              compare_file_size);
+
+        /* Treat File(s) */
+        pthread_mutex_init(&work.lock, NULL);
+        work.next_schedule = work.next_output = 0;
+
+        /* On the heap : the number of jobs isn't bounded */
+        uint64_t nb_threads = MIN(nb_jobs, work.nb_files);
+        pthread_t *threads = NULL;
+        if (nb_threads > 1)
+            threads = malloc(sizeof(pthread_t) * nb_threads);
+
+        /* The calling thread hashes too, alone without threads */
+        uint64_t nb_started = 0;
+        for (; threads != NULL && nb_started < nb_threads; nb_started++)
+            if (pthread_create(&threads[nb_started], NULL, hash_dir_files,
+                               &work) != 0)
+                break;
+
+        hash_dir_files(&work);
+
+        for (uint64_t i = 0; i < nb_started; i++)
+            pthread_join(threads[i], NULL);
+        free(threads);
+        pthread_mutex_destroy(&work.lock);
+    }
+
+    for (uint64_t i = 0; i < work.nb_files; i++)
+        free(work.files[i].path);
+    free(work.files);
+    free(work.schedule);
+    return ret;
+}
+
+/**
+ * Treatment of a file or a directory, the hashes being written in the output
+ * or added to OUTPUT_DB.
+ * Return false if problems, true otherwise.
+ */
+static bool treat_path(char *path)
+{
+    /* Check file type */
+    struct stat info;
+
+    if (stat(path, &info) != 0)
+        errx(EXIT_FAILURE, "error: cannot access '%s'", path);
+
+    if (S_ISDIR(info.st_mode)) {
+        fprintf(stderr, "[+] '%s' is a directory\n", path);
+
+        char dir_path[2048];
+        uint16_t i = strlen(path);
+        if (path[i - 1] == '/')
+            sprintf(dir_path, "%s", path);
+        else
+            sprintf(dir_path, "%s/", path);
+
+        return treat_dir(dir_path);
+    } else if (S_ISREG(info.st_mode)) {
+        fprintf(stderr, "[+] '%s' is a regular file\n", path);
+        if (!treat_file(path))
+            errx(EXIT_FAILURE, "error: '%s' is an invalid file", path);
+        return true;
+    }
+
+    errx(EXIT_FAILURE, "error: invalid file");
+}
+
+/**
+ * Check if the path is a directory or an ELF file, to hash, and not a file
+ * of hashes
+ */
+static bool is_hashable(char *path)
+{
+    struct stat info;
+    if (stat(path, &info) != 0)
+        errx(EXIT_FAILURE, "error: cannot access '%s'", path);
+
+    if (S_ISDIR(info.st_mode))
+        return true;
+
+    FILE *f = fopen(path, "rb");
+    if (f == NULL)
+        errx(EXIT_FAILURE, "error: can't open the file '%s'!", path);
+
+    bool is_elf = elf_check_header(f);
+    fclose(f);
+    return is_elf;
+}
+
+/**
+ * Compare the queries with the files of a database only : the files of the
+ * database are never compared with each other. The queries are hashed if
+ * query is an ELF file or a directory, loaded otherwise.
+ */
+static void query_parser(char *query, char *db_file)
+{
+    sig_db_t *db = load_signatures(db_file);
+    check_algorithms(db);
+
+    /* Only the hashes the database has are computed */
+    sig_db_t *queries;
+    if (is_hashable(query)) {
+        if ((OUTPUT_DB = sig_db_new()) == NULL)
+            errx(EXIT_FAILURE, "signature database malloc!");
+        if (!treat_path(query))
+            errx(EXIT_FAILURE, "error: can't hash '%s'", query);
+        queries = OUTPUT_DB;
+        OUTPUT_DB = NULL;
+    } else {
+        /* Any other file would give entries of its lines, without hashes */
+        queries = load_signatures(query);
+        if (!(queries->flags & (SIG_DB_CTPH | SIG_DB_SIMHASH)))
+            errx(EXIT_FAILURE,
+                 "error: '%s' is neither an ELF file nor a file of hashes",
+                 query);
+    }
+
+    check_algorithms(queries);
+    comparision(queries, db);
+    sig_db_free(queries);
+    sig_db_free(db);
+}
+
+/**
+ * Hash a file for the daemon, the hashes being freed by the daemon. Only the
+ * regular files are hashed.
+ */
+static bool daemon_hash(char *path, char **name, char **ctph, char **simhash)
+{
+    struct stat info;
+    if (stat(path, &info) != 0 || !S_ISREG(info.st_mode))
+        return false;
+
+    file_hashes_t hashes;
+    if (!hash_file(path, &hashes)) {
+        free_hashes(&hashes);
+        return false;
+    }
+
+    *name = hashes.name;
+    *ctph = hashes.ctph;
+    *simhash = hashes.simhash;
     return true;
 }
 
+/**
+ * Serve the signatures of the file, if any, with their indexes kept in
+ * memory : the files inserted are compared with the next queries
+ */
+static void daemon_parser(char *socket_path, char *db_file)
+{
+    sig_db_t *db = (db_file != NULL) ? load_signatures(db_file) : sig_db_new();
+    if (db == NULL)
+        errx(EXIT_FAILURE, "signature database malloc!");
+
+    /* The algorithms of the files inserted are the chosen ones */
+    if (db->nb_entries > 0)
+        check_algorithms(db);
+
+    compare_options_t options = get_options();
+    sig_store_t *store = sig_store_new(db, &options);
+    if (store == NULL)
+        errx(EXIT_FAILURE, "signature store malloc!");
+
+    daemon_config_t config = {
+        .socket_path = socket_path,
+        .store = store,
+        .algorithms = {chosen_algorithm != SIMHASH, chosen_algorithm != CTPH},
+        .cascade = cascade_radius >= 0,
+        .hash = daemon_hash};
+
+    fprintf(stderr, "[+] Serving %" PRIu64 " files on '%s'\n",
+            sig_store_count(store), socket_path);
+    if (!daemon_run(&config))
+        errx(EXIT_FAILURE, "error: can't serve on the socket '%s'",
+             socket_path);
+
+    sig_store_free(store);
+}
+
 /* MAIN */
 int main(int argc, char *argv[])
 {
     /* clang-format off */
     const struct option long_opts[] = {
-        {"output"       , required_argument, NULL, 'o'},
-        {"compareHashes", no_argument      , NULL, 'c'},
-        {"verbose"      , no_argument      , NULL, 'v'},
-        {"version"      , no_argument      , NULL, 'V'},
-        {"help"         , no_argument      , NULL, 'h'},
-        {"algorithm"    , required_argument, NULL, 'a'},
-        { NULL          , 0                , NULL,  0 }
+        {"output"        , required_argument, NULL, 'o'},
+        {"binary"        , no_argument      , NULL, 'b'},
+        {"compareHashes" , no_argument      , NULL, 'c'},
+        {"jobs"          , required_argument, NULL, 'j'},
+        {"mmap"          , no_argument      , NULL, 'm'},
+        {"verbose"       , no_argument      , NULL, 'v'},
+        {"version"       , no_argument      , NULL, 'V'},
+        {"help"          , no_argument      , NULL, 'h'},
+        {"algorithm"     , required_argument, NULL, 'a'},
+        {"shingle-hash"  , required_argument, NULL, 's'},
+        {"top"           , required_argument, NULL, OPT_TOP},
+        {"min-score"     , required_argument, NULL, OPT_MIN_SCORE},
+        {"ctph-index"    , no_argument      , NULL, OPT_CTPH_INDEX},
+        {"simhash-radius", required_argument, NULL, OPT_SIMHASH_RADIUS},
+        {"query"         , required_argument, NULL, 'q'},
+        {"database"      , required_argument, NULL, 'd'},
+        {"cluster"       , required_argument, NULL, OPT_CLUSTER},
+        {"shard"         , required_argument, NULL, OPT_SHARD},
+        {"merge-shards"  , no_argument      , NULL, OPT_MERGE_SHARDS},
+        {"mem-limit"     , required_argument, NULL, OPT_MEM_LIMIT},
+        {"cascade"       , required_argument, NULL, OPT_CASCADE},
+        {"daemon"        , required_argument, NULL, OPT_DAEMON},
+        { NULL           , 0                , NULL,  0 }
     };
     /* clang-format on */
 
@@ -403,7 +1025,9 @@ int main(int argc, char *argv[])
 
     int optc;
     char *outputoption = NULL;
-    const char *options = "o:vVha:c";
+    char *query = NULL, *database = NULL, *daemon_socket = NULL;
+    bool binary_wanted = false, merge_wanted = false;
+    const char *options = "o:bvVha:cj:ms:q:d:";
     while ((optc = getopt_long(argc, argv, options, long_opts, NULL)) != -1) {
 
         switch (optc) {
@@ -415,6 +1039,10 @@ int main(int argc, char *argv[])
             outputoption = optarg;
             break;
 
+        case 'b':
+            binary_wanted = true;
+            break;
+
         case 'v':
             verbose = true;
             break;
@@ -439,22 +1067,215 @@ int main(int argc, char *argv[])
         case 'c':
             comparision_wanted = true;
             break;
+
+        case 'q':
+            query = optarg;
+            break;
+
+        case 'd':
+            database = optarg;
+            break;
+
+        case 'j': {
+            char *end;
+            long jobs = strtol(optarg, &end, 10);
+            if (*optarg == '\0' || *end != '\0' || jobs < 0)
+                errx(EXIT_FAILURE, "-j option's [%s] argument is not valid!",
+                     optarg);
+            if (jobs == 0)
+                jobs = sysconf(_SC_NPROCESSORS_ONLN);
+            nb_jobs = (jobs > 0) ? jobs : 1;
+            break;
+        }
+
+        case 'm':
+            use_mmap = true;
+            break;
+
+        case 's':
+            chosen_shingle_hash = simhash_get_shingle_hash(optarg);
+            if (chosen_shingle_hash == SHINGLE_HASH_END)
+                errx(EXIT_FAILURE, "-s option's [%s] argument is not valid!",
+                     optarg);
+            break;
+
+        case OPT_TOP: {
+            char *end;
+            long long top = strtoll(optarg, &end, 10);
+            if (*optarg == '\0' || *end != '\0' || top <= 0)
+                errx(EXIT_FAILURE,
+                     "--top option's [%s] argument is not valid!", optarg);
+            top_matches = top;
+            break;
+        }
+
+        case OPT_MIN_SCORE: {
+            char *end;
+            min_score = strtof(optarg, &end);
+            if (*optarg == '\0' || *end != '\0' || !(min_score >= 0.0) ||
+                min_score > 100.0)
+                errx(EXIT_FAILURE,
+                     "--min-score option's [%s] argument is not valid!",
+                     optarg);
+            break;
+        }
+
+        case OPT_CTPH_INDEX:
+            ctph_index_wanted = true;
+            break;
+
+        case OPT_SIMHASH_RADIUS: {
+            char *end;
+            long radius = strtol(optarg, &end, 10);
+            if (*optarg == '\0' || *end != '\0' || radius < 0 ||
+                radius > SIMHASH_SIZE * 8)
+                errx(EXIT_FAILURE,
+                     "--simhash-radius option's [%s] argument is not valid!",
+                     optarg);
+            simhash_radius = radius;
+            break;
+        }
+
+        case OPT_CASCADE: {
+            char *end;
+            long radius = strtol(optarg, &end, 10);
+            if (*optarg == '\0' || *end != '\0' || radius < 0 ||
+                radius > SIMHASH_SIZE * 8)
+                errx(EXIT_FAILURE,
+                     "--cascade option's [%s] argument is not valid!", optarg);
+            cascade_radius = radius;
+            break;
+        }
+
+        case OPT_CLUSTER: {
+            char *end;
+            cluster_threshold = strtof(optarg, &end);
+            if (*optarg == '\0' || *end != '\0' ||
+                !(cluster_threshold >= 0.0) || cluster_threshold > 100.0)
+                errx(EXIT_FAILURE,
+                     "--cluster option's [%s] argument is not valid!", optarg);
+            break;
+        }
+
+        case OPT_SHARD: {
+            unsigned long long i, n;
+            char end;
+            if (strspn(optarg, "0123456789/") != strlen(optarg) ||
+                sscanf(optarg, "%llu/%llu%c", &i, &n, &end) != 2 || n == 0 ||
+                i >= n)
+                errx(EXIT_FAILURE,
+                     "--shard option's [%s] argument is not valid!", optarg);
+            shard.shard = i;
+            shard.nb_shards = n;
+            break;
+        }
+
+        case OPT_MERGE_SHARDS:
+            merge_wanted = true;
+            break;
+
+        case OPT_DAEMON:
+            daemon_socket = optarg;
+            break;
+
+        case OPT_MEM_LIMIT: {
+            char *end;
+            unsigned long long limit = strtoull(optarg, &end, 10);
+            int shift = 0;
+            if (*end == 'K' || *end == 'k')
+                shift = 10;
+            else if (*end == 'M' || *end == 'm')
+                shift = 20;
+            else if (*end == 'G' || *end == 'g')
+                shift = 30;
+            if (shift > 0)
+                end++;
+            if (*optarg < '0' || *optarg > '9' || *end != '\0' || limit == 0 ||
+                limit > (UINT64_MAX >> shift))
+                errx(EXIT_FAILURE,
+                     "--mem-limit option's [%s] argument is not valid!",
+                     optarg);
+            mem_limit = (uint64_t) limit << shift;
+            break;
+        }
+
         default:
             errx(EXIT_FAILURE, "error: invalid option '%s'!", argv[optind - 1]);
         }
     }
 
-    if (argc - optind != 1)
+    if ((query == NULL) != (database == NULL))
+        errx(EXIT_FAILURE, "error: -q and -d must be given together");
+    if (query != NULL && (comparision_wanted || binary_wanted))
+        errx(EXIT_FAILURE, "error: -q can't be used with -c or -b");
+    if (cluster_threshold >= 0.0 && !comparision_wanted && !merge_wanted)
+        errx(EXIT_FAILURE,
+             "error: --cluster can only be used with -c or --merge-shards");
+    if (cluster_threshold >= 0.0 && top_matches > 0)
+        errx(EXIT_FAILURE, "error: --cluster can't be used with --top, the "
+                           "clusters are made of all the matches");
+    if (shard.nb_shards > 0 &&
+        (!comparision_wanted || cluster_threshold >= 0.0))
+        errx(EXIT_FAILURE, "error: --shard can only be used with -c, the "
+                           "clusters are made by --merge-shards");
+    if (mem_limit > 0 &&
+        (!comparision_wanted || cluster_threshold >= 0.0 || shard.nb_shards))
+        errx(EXIT_FAILURE, "error: --mem-limit can only be used with -c, "
+                           "without --cluster or --shard");
+    if (mem_limit > 0 && top_matches == 0)
+        errx(EXIT_FAILURE, "error: --mem-limit must be used with --top, the "
+                           "matches of each file are kept in memory");
+    if (cascade_radius >= 0 &&
+        ((!comparision_wanted && query == NULL && !merge_wanted &&
+          daemon_socket == NULL) ||
+         chosen_algorithm != ALL || simhash_radius >= 0))
+        errx(EXIT_FAILURE, "error: --cascade can only be used with -c, -q, "
+                           "--merge-shards or --daemon, without -a or "
+                           "--simhash-radius");
+    if (daemon_socket != NULL &&
+        (comparision_wanted || binary_wanted || query != NULL || merge_wanted ||
+         outputoption != NULL || cluster_threshold >= 0.0 ||
+         shard.nb_shards > 0 || mem_limit > 0))
+        errx(EXIT_FAILURE, "error: --daemon can't be used with -b, -c, -o, -q, "
+                           "--cluster, --shard, --merge-shards or --mem-limit");
+    if (merge_wanted && (comparision_wanted || binary_wanted || query != NULL))
+        errx(EXIT_FAILURE,
+             "error: --merge-shards can't be used with -c, -b or -q");
+
+    if (merge_wanted ? argc - optind < 2
+        : daemon_socket != NULL ? argc - optind > 1
+                                : argc - optind != (query == NULL ? 1 : 0))
         errx(EXIT_FAILURE, "error: invalid number of files or directory");
 
     /* Verifying if the output file already exists. If so, it's an error */
     if (outputoption != NULL) {
         if (access(outputoption, F_OK) == 0)
             errx(EXIT_FAILURE, "error: File %s already exists !", outputoption);
-        if ((OUTPUT = fopen(outputoption, "w")) == NULL)
+        OUTPUT = fopen(outputoption, binary_wanted ? "wb" : "w");
+        if (OUTPUT == NULL)
             errx(EXIT_FAILURE, "error: can't create and/or open the file '%s'!",
                  outputoption);
     }
+    /* MERGE MODE */
+    if (merge_wanted) {
+        merge_parser(argv[optind], &argv[optind + 1], argc - optind - 1);
+        close_output();
+        return return_code;
+    }
+
+    /* DAEMON MODE */
+    if (daemon_socket != NULL) {
+        daemon_parser(daemon_socket, (optind < argc) ? argv[optind] : NULL);
+        return return_code;
+    }
+
+    /* QUERY MODE */
+    if (query != NULL) {
+        query_parser(query, database);
+        close_output();
+        return return_code;
+    }
+
     /* COMPARISION MODE */
     if (comparision_wanted == true) {
         file_parser(argv[optind]);
@@ -463,31 +1284,17 @@ int main(int argc, char *argv[])
     }
 
     /* HASH CREATION MODE */
+    if (binary_wanted && (OUTPUT_DB = sig_db_new()) == NULL)
+        errx(EXIT_FAILURE, "signature database malloc!");
 
-    /* Check file type */
-    struct stat info;
-
-    if (stat(argv[optind], &info) != 0)
-        errx(EXIT_FAILURE, "error: cannot access '%s'", argv[optind]);
+    if (!treat_path(argv[optind]))
+        return_code = EXIT_FAILURE;
 
-    if (S_ISDIR(info.st_mode)) {
-        fprintf(stderr, "[+] '%s' is a directory\n", argv[optind]);
-
-        char dir_path[2048];
-        uint16_t i = strlen(argv[optind]);
-        if (argv[optind][i - 1] == '/')
-            sprintf(dir_path, "%s", argv[optind]);
-        else
-            sprintf(dir_path, "%s/", argv[optind]);
-
-        if (!treat_dir(dir_path))
-            return_code = EXIT_FAILURE;
-    } else if (S_ISREG(info.st_mode)) {
-        fprintf(stderr, "[+] '%s' is a regular file\n", argv[optind]);
-        if (!treat_file(argv[optind]))
-            errx(EXIT_FAILURE, "error: '%s' is an invalid file", argv[optind]);
-    } else
-        errx(EXIT_FAILURE, "error: invalid file");
+    if (OUTPUT_DB != NULL) {
+        if (!sig_db_write(OUTPUT_DB, OUTPUT))
+            errx(EXIT_FAILURE, "error: can't write the signature database");
+        sig_db_free(OUTPUT_DB);
+    }
 
     close_output();
     return return_code;
@@ -2,7 +2,7 @@
 #define TBT_H
 
 #define VERSION 1
-#define SUBVERSION 0
+#define SUBVERSION 1
 #define REVISION 0
 
 #endif /* TBT_H */
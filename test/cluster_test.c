@@ -0,0 +1,75 @@
+#include "cluster.h"
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NB_FILES 5
+
+static void EXPECT(bool test, char *fmt, ...)
+{
+    fprintf(stdout, "Checking '");
+
+    va_list vargs;
+    va_start(vargs, fmt);
+    vprintf(fmt, vargs);
+    va_end(vargs);
+
+    if (test)
+        fprintf(stdout, "': (passed)\n");
+    else
+        fprintf(stdout, "': (failed!)\n");
+}
+
+int main(void)
+{
+    /* Pairs 0-1 at 80, 1-2 at 60, 0-2 at 20 and 3-4 at 90, in both lists */
+    /* clang-format off */
+    compare_match_t matches_0[] = {{1, 80.0}, {2, 20.0}};
+    compare_match_t matches_1[] = {{0, 80.0}, {2, 60.0}};
+    compare_match_t matches_2[] = {{1, 60.0}, {0, 20.0}};
+    compare_match_t matches_3[] = {{4, 90.0}};
+    compare_match_t matches_4[] = {{3, 90.0}};
+    compare_list_t lists[NB_FILES] = {
+        {matches_0, 2, 2},
+        {matches_1, 2, 2},
+        {matches_2, 2, 2},
+        {matches_3, 1, 1},
+        {matches_4, 1, 1}
+    };
+    /* clang-format on */
+    compare_result_t result = {.nb_files = NB_FILES, .lists = lists};
+
+    /* Test cluster_new */
+    printf("----( Check cluster_new )----\n");
+
+    cluster_result_t *clusters = cluster_new(&result, 50.0);
+    EXPECT((clusters != NULL), "cluster_new(result, 50) != NULL");
+    EXPECT((clusters->nb_clusters == 2), "2 clusters at 50");
+    EXPECT((cluster_size(clusters, 0) == 3 && cluster_size(clusters, 1) == 2),
+           "clusters of 3 then 2 files at 50");
+    EXPECT((clusters->cluster[0] == 0 && clusters->cluster[2] == 0 &&
+            clusters->cluster[4] == 1),
+           "0 and 2 in the cluster 0, 4 in the cluster 1");
+    EXPECT((clusters->files[0] == 0 && clusters->files[1] == 1 &&
+            clusters->files[2] == 2 && clusters->files[3] == 3),
+           "files grouped by cluster in order");
+    EXPECT((clusters->medoids[0] == 1), "medoid of the cluster 0 is 1");
+    EXPECT((clusters->medoids[1] == 3), "medoid of the cluster 1 is 3");
+    cluster_free(clusters);
+
+    clusters = cluster_new(&result, 85.0);
+    EXPECT((clusters->nb_clusters == 4), "4 clusters at 85");
+    EXPECT((cluster_size(clusters, 0) == 2 && clusters->cluster[3] == 0),
+           "3 in the largest cluster at 85");
+    EXPECT((clusters->cluster[0] == 1 && clusters->cluster[2] == 3 &&
+            clusters->medoids[2] == 1),
+           "files alone in their cluster by index at 85");
+    cluster_free(clusters);
+
+    EXPECT((cluster_new(NULL, 50.0) == NULL), "cluster_new(NULL) == NULL");
+    EXPECT((cluster_size(NULL, 0) == 0), "cluster_size(NULL) == 0");
+
+    return EXIT_SUCCESS;
+}
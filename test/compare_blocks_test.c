@@ -0,0 +1,150 @@
+#include "compare_blocks.h"
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "test_files.h"
+
+/* Several blocks of COMPARE_BLOCKS_MIN_SIZE files, the last one smaller */
+#define NB_FILES 600
+#define NB_FAMILIES 50
+
+static void EXPECT(bool test, char *fmt, ...)
+{
+    fprintf(stdout, "Checking '");
+
+    va_list vargs;
+    va_start(vargs, fmt);
+    vprintf(fmt, vargs);
+    va_end(vargs);
+
+    if (test)
+        fprintf(stdout, "': (passed)\n");
+    else
+        fprintf(stdout, "': (failed!)\n");
+}
+
+/* Files alike within a family whose files are spread over all the blocks */
+static const test_files_t FILES = {.nb_families = NB_FAMILIES,
+                                   .nb_block_sizes = 4,
+                                   .sparse = true};
+
+/*
+ * Check that the lists of the block read back are the lists [first, first +
+ * nb_files) of the whole result, with the same matches in the same order
+ */
+static bool same_lists(const compare_result_t *block,
+                       const compare_result_t *all, uint64_t first)
+{
+    if (block == NULL || first + block->nb_files > all->nb_files)
+        return false;
+
+    for (uint64_t k = 0; k < block->nb_files; k++) {
+        const compare_list_t *list_1 = &block->lists[k];
+        const compare_list_t *list_2 = &all->lists[first + k];
+        if (list_1->nb_matches != list_2->nb_matches)
+            return false;
+
+        for (uint64_t m = 0; m < list_1->nb_matches; m++)
+            if (list_1->matches[m].index != list_2->matches[m].index ||
+                list_1->matches[m].score != list_2->matches[m].score)
+                return false;
+    }
+
+    return true;
+}
+
+/* Check the blocks of block_size files read back against compare_all() */
+static void check_blocks(const sig_db_t *db, compare_algorithm_e algo,
+                         compare_options_t options, uint64_t block_size,
+                         const char *description)
+{
+    const char *name = (algo == COMPARE_CTPH) ? "CTPH" : "SimHash";
+    compare_result_t *all = compare_all(db, algo, &options);
+
+    compare_blocks_t *blocks =
+        compare_blocks_new(db, algo, &options, block_size);
+    uint64_t nb_blocks = compare_blocks_count(blocks);
+    uint64_t expected = (db->nb_entries + block_size - 1) / block_size;
+
+    bool ret = blocks != NULL && all != NULL && nb_blocks == expected;
+    for (uint64_t b = 0; b < nb_blocks && ret; b++) {
+        compare_result_t *result = compare_blocks_result(blocks, b);
+        ret = same_lists(result, all, b * block_size);
+        compare_result_free(result);
+    }
+    EXPECT(ret,
+           "compare_blocks_result(%s, %s) of %llu blocks of %llu files == "
+           "compare_all()",
+           name, description, (unsigned long long) expected,
+           (unsigned long long) block_size);
+
+    EXPECT((compare_blocks_result(blocks, nb_blocks) == NULL),
+           "compare_blocks_result(%s, %s, block %llu) == NULL", name,
+           description, (unsigned long long) nb_blocks);
+
+    compare_blocks_free(blocks);
+    compare_result_free(all);
+}
+
+int main(void)
+{
+    sig_db_t *db = sig_db_new();
+    for (uint64_t i = 0; i < NB_FILES; i++)
+        test_file_add(&FILES, db, i);
+
+    /* Test compare_blocks_size */
+    printf("----( Check compare_blocks_size )----\n");
+
+    compare_options_t options = {.nb_jobs = 1, .top = 5,
+                                 .simhash_radius = -1};
+    uint64_t size = compare_blocks_size(NB_FILES, &options, 1 << 20);
+    EXPECT((size >= COMPARE_BLOCKS_MIN_SIZE),
+           "compare_blocks_size(top 5, 1 MB) == %llu",
+           (unsigned long long) size);
+    EXPECT((compare_blocks_size(NB_FILES, &options, 1 << 19) <= size),
+           "compare_blocks_size(top 5, 512 KB) <= compare_blocks_size(1 MB)");
+    EXPECT((compare_blocks_size(NB_FILES, &options, 1024) == 0),
+           "compare_blocks_size(top 5, 1 KB) == 0");
+
+    options.top = 0;
+    EXPECT((compare_blocks_size(NB_FILES, &options, 1 << 30) == 0),
+           "compare_blocks_size(without top, 1 GB) == 0");
+
+    printf("\n");
+
+    for (compare_algorithm_e algo = COMPARE_CTPH; algo < COMPARE_END; algo++) {
+        printf("----( Check the blocks of the %s comparision )----\n",
+               (algo == COMPARE_CTPH) ? "CTPH" : "SimHash");
+
+        check_blocks(db, algo,
+                     (compare_options_t){.nb_jobs = 1,
+                                         .top = 3,
+                                         .simhash_radius = -1},
+                     COMPARE_BLOCKS_MIN_SIZE, "top 3");
+        check_blocks(db, algo,
+                     (compare_options_t){.nb_jobs = 2,
+                                         .top = 5,
+                                         .min_score = 30.0,
+                                         .simhash_radius = 20},
+                     150, "top 5, min score 30, radius 20");
+        check_blocks(db, algo,
+                     (compare_options_t){.nb_jobs = 1, .simhash_radius = -1},
+                     100, "all");
+
+        if (algo == COMPARE_CTPH)
+            check_blocks(db, algo,
+                         (compare_options_t){.nb_jobs = 2,
+                                             .top = 4,
+                                             .simhash_radius = 16,
+                                             .cascade = true},
+                         COMPARE_BLOCKS_MIN_SIZE, "cascade 16, top 4");
+
+        printf("\n");
+    }
+
+    sig_db_free(db);
+    return EXIT_SUCCESS;
+}
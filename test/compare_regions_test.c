@@ -0,0 +1,153 @@
+/* The static functions of the comparision are tested too */
+#include "../src/compare.c"
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define SIMHASH "md5:0123456789abcdef0123456789abcdef"
+
+static void EXPECT(bool test, char *fmt, ...)
+{
+    fprintf(stdout, "Checking '");
+
+    va_list vargs;
+    va_start(vargs, fmt);
+    vprintf(fmt, vargs);
+    va_end(vargs);
+
+    if (test)
+        fprintf(stdout, "': (passed)\n");
+    else
+        fprintf(stdout, "': (failed!)\n");
+}
+
+/*
+ * Database of a file per block size, without CTPH for the block size 0, the
+ * file i being named after it
+ */
+static sig_db_t *make_db(const uint64_t block_sizes[], uint64_t nb_files)
+{
+    sig_db_t *db = sig_db_new();
+    for (uint64_t i = 0; i < nb_files && db != NULL; i++) {
+        char name[32], ctph[64];
+        sprintf(name, "file_%llu", (unsigned long long) i);
+        sprintf(ctph, "roll:%llu:ABCDEFGHIJKLMNOP:ABCDEFGH",
+                (unsigned long long) block_sizes[i]);
+
+        if (!sig_db_add(db, name, block_sizes[i] ? ctph : NULL, SIMHASH)) {
+            sig_db_free(db);
+            db = NULL;
+        }
+    }
+
+    return db;
+}
+
+/* Check that the regions of the work are the expected ones, in order */
+static bool same_regions(const compare_work_t *work,
+                         const compare_region_t expected[],
+                         uint64_t nb_regions)
+{
+    if (work->nb_regions != nb_regions)
+        return false;
+
+    for (uint64_t k = 0; k < nb_regions; k++) {
+        const compare_region_t *region = &work->regions[k];
+        if (region->row_first != expected[k].row_first ||
+            region->row_end != expected[k].row_end ||
+            region->column_first != expected[k].column_first ||
+            region->column_end != expected[k].column_end)
+            return false;
+    }
+
+    return true;
+}
+
+/* Check that the order of the work is the expected one */
+static bool same_order(const compare_work_t *work, const uint64_t expected[],
+                       uint64_t nb_files)
+{
+    if (work->nb_files != nb_files)
+        return false;
+
+    for (uint64_t p = 0; p < nb_files; p++)
+        if (work->order[p] != expected[p])
+            return false;
+
+    return true;
+}
+
+/*
+ * Check the order and the regions of the CTPH files of the block sizes,
+ * the order holding the indexes of the files
+ */
+static void check_regions(const uint64_t block_sizes[], uint64_t nb_files,
+                          const uint64_t order[], uint64_t nb_ordered,
+                          const compare_region_t regions[],
+                          uint64_t nb_regions, const char *description)
+{
+    sig_db_t *db = make_db(block_sizes, nb_files);
+    compare_work_t work = {.db = db};
+
+    work.digests = (db != NULL) ? parse_digests(db) : NULL;
+    bool ret = work.digests != NULL && make_ctph_regions(&work);
+
+    EXPECT(ret && same_order(&work, order, nb_ordered),
+           "make_ctph_regions(%s) orders the files by block size",
+           description);
+    EXPECT(ret && same_regions(&work, regions, nb_regions),
+           "make_ctph_regions(%s) == %llu regions", description,
+           (unsigned long long) nb_regions);
+
+    free_work(&work);
+    sig_db_free(db);
+}
+
+int main(void)
+{
+    /* Test make_ctph_regions */
+    printf("----( Check make_ctph_regions )----\n");
+
+    /* The buckets B, 2B and 4B : only B-2B and 2B-4B across them */
+    const uint64_t doubles[] = {12, 3, 6, 3, 12, 6};
+    const uint64_t doubles_order[] = {1, 3, 2, 5, 0, 4};
+    const compare_region_t doubles_regions[] = {
+        {0, 2, 0, 2}, {0, 2, 2, 4}, {2, 4, 2, 4}, {2, 4, 4, 6}, {4, 6, 4, 6}};
+    check_regions(doubles, 6, doubles_order, 6, doubles_regions, 5,
+                  "3, 6 and 12");
+
+    /* The buckets B and 4B can't be compared */
+    const uint64_t apart[] = {12, 3, 3, 12};
+    const uint64_t apart_order[] = {1, 2, 0, 3};
+    const compare_region_t apart_regions[] = {{0, 2, 0, 2}, {2, 4, 2, 4}};
+    check_regions(apart, 4, apart_order, 4, apart_regions, 2, "3 and 12");
+
+    /* The files without CTPH are left out */
+    const uint64_t sparse[] = {0, 6, 0, 3, 6};
+    const uint64_t sparse_order[] = {3, 1, 4};
+    const compare_region_t sparse_regions[] = {
+        {0, 1, 0, 1}, {0, 1, 1, 3}, {1, 3, 1, 3}};
+    check_regions(sparse, 5, sparse_order, 3, sparse_regions, 3,
+                  "3 and 6, without CTPH");
+
+    check_regions(sparse, 0, NULL, 0, NULL, 0, "no file");
+
+    printf("\n");
+
+    /* Test region_nb_tiles */
+    printf("----( Check region_nb_tiles )----\n");
+
+    uint64_t side = 3 * COMPARE_TILE_SIZE;
+    compare_region_t triangle = {0, side, 0, side};
+    compare_region_t rectangle = {0, side, side, 2 * side};
+    EXPECT((region_nb_tiles(&triangle) == 6),
+           "region_nb_tiles(files against each other, 3 tiles per side) == 6");
+    EXPECT((region_nb_tiles(&rectangle) == 9),
+           "region_nb_tiles(files against others, 3 tiles per side) == 9");
+
+    printf("\n");
+
+    return EXIT_SUCCESS;
+}
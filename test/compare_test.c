@@ -0,0 +1,263 @@
+#include "compare.h"
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ctph.h"
+#include "simhash.h"
+#include "test_files.h"
+
+/* More files than a tile of 256 files, in several block sizes */
+#define NB_FILES 700
+#define NB_FAMILIES 60
+#define NB_QUERIES 40
+/* Same files, in more than a tile too */
+#define NB_SAME 300
+
+static void EXPECT(bool test, char *fmt, ...)
+{
+    fprintf(stdout, "Checking '");
+
+    va_list vargs;
+    va_start(vargs, fmt);
+    vprintf(fmt, vargs);
+    va_end(vargs);
+
+    if (test)
+        fprintf(stdout, "': (passed)\n");
+    else
+        fprintf(stdout, "': (failed!)\n");
+}
+
+/*
+ * Files alike within a family. A third of the files of a family have the
+ * double block size, their first part being the second part of the others.
+ * Some files lack a signature, or have a SimHash of wyhash.
+ */
+static const test_files_t FILES = {.nb_families = NB_FAMILIES,
+                                   .nb_block_sizes = 5,
+                                   .double_block_size = true,
+                                   .sparse = true};
+
+/* Score of the file i of db_1 and j of db_2 scored one by one, 0 if none */
+static float brute_score(const sig_db_t *db_1, uint64_t i, const sig_db_t *db_2,
+                         uint64_t j, compare_algorithm_e algo,
+                         const compare_options_t *options)
+{
+    const sig_db_entry_t *entry_1 = &db_1->entries[i];
+    const sig_db_entry_t *entry_2 = &db_2->entries[j];
+    bool simhash = (entry_1->flags & entry_2->flags & SIG_DB_SIMHASH) &&
+                   entry_1->shingle_hash == entry_2->shingle_hash;
+    uint32_t distance =
+        simhash ? simhash_distance(db_1->simhash[i], db_2->simhash[j],
+                                   SIMHASH_SIZE * 8)
+                : 0;
+    bool in_radius =
+        simhash && (options->simhash_radius < 0 ||
+                    distance <= (uint32_t) options->simhash_radius);
+
+    float score = 0.0;
+    if (algo == COMPARE_SIMHASH) {
+        if (in_radius)
+            score = compare_simhash_score(db_1, i, db_2, j);
+    } else if (!options->cascade || in_radius) {
+        char ctph_1[SIG_DB_CTPH_MAX_LENGTH + 1];
+        char ctph_2[SIG_DB_CTPH_MAX_LENGTH + 1];
+        if (sig_db_get_ctph(db_1, i, ctph_1) &&
+            sig_db_get_ctph(db_2, j, ctph_2))
+            score = ctph_compare(ctph_1, ctph_2);
+    }
+
+    return (score > 0.0 && score >= options->min_score) ? score : 0.0;
+}
+
+/* Order of the matches : decreasing score, then increasing index */
+static int compare_match(const void *match_1, const void *match_2)
+{
+    const compare_match_t *m1 = match_1, *m2 = match_2;
+    if (m1->score != m2->score)
+        return (m1->score > m2->score) ? -1 : 1;
+    return (m1->index > m2->index) - (m1->index < m2->index);
+}
+
+/*
+ * Matches of each file of queries with each file of db, or of db with itself
+ * if queries is NULL, scored pair by pair then sorted and cut to the top
+ */
+static compare_result_t *brute_force(const sig_db_t *queries,
+                                     const sig_db_t *db,
+                                     compare_algorithm_e algo,
+                                     const compare_options_t *options)
+{
+    const sig_db_t *rows = (queries != NULL) ? queries : db;
+    compare_result_t *result = compare_result_new(rows->nb_entries);
+
+    for (uint64_t i = 0; i < rows->nb_entries; i++)
+        for (uint64_t j = 0; j < db->nb_entries; j++) {
+            if (queries == NULL && i == j)
+                continue;
+
+            float score = brute_score(rows, i, db, j, algo, options);
+            if (score > 0.0)
+                compare_result_add(result, i, j, score, 0);
+        }
+
+    for (uint64_t i = 0; i < result->nb_files; i++) {
+        compare_list_t *list = &result->lists[i];
+        qsort(list->matches, list->nb_matches, sizeof(compare_match_t),
+              compare_match);
+        if (options->top > 0 && list->nb_matches > options->top)
+            list->nb_matches = options->top;
+    }
+
+    return result;
+}
+
+/* Number of matches of the result */
+static uint64_t nb_matches(const compare_result_t *result)
+{
+    uint64_t n = 0;
+    for (uint64_t i = 0; i < result->nb_files; i++)
+        n += result->lists[i].nb_matches;
+    return n;
+}
+
+/*
+ * Check that each file of the result matches every other file exactly once,
+ * and not itself : each pair was scored once, into the lists of both files
+ */
+static bool each_pair_once(const compare_result_t *result)
+{
+    if (result == NULL)
+        return false;
+
+    bool *seen = calloc(result->nb_files, sizeof(bool));
+    bool ret = seen != NULL;
+    for (uint64_t i = 0; i < result->nb_files && ret; i++) {
+        const compare_list_t *list = &result->lists[i];
+        ret = list->nb_matches == result->nb_files - 1;
+
+        memset(seen, 0, result->nb_files * sizeof(bool));
+        for (uint64_t m = 0; m < list->nb_matches && ret; m++) {
+            uint64_t j = list->matches[m].index;
+            ret = j < result->nb_files && j != i && !seen[j];
+            if (ret)
+                seen[j] = true;
+        }
+    }
+
+    free(seen);
+    return ret;
+}
+
+/* Check compare_all() and compare_query() with 1 and 4 threads */
+static void check_options(const sig_db_t *db, const sig_db_t *queries,
+                          compare_algorithm_e algo, compare_options_t options,
+                          const char *description)
+{
+    const char *name = (algo == COMPARE_CTPH) ? "CTPH" : "SimHash";
+
+    compare_result_t *expected_all = brute_force(NULL, db, algo, &options);
+    compare_result_t *expected_query =
+        brute_force(queries, db, algo, &options);
+
+    for (uint64_t nb_jobs = 1; nb_jobs <= 4; nb_jobs += 3) {
+        options.nb_jobs = nb_jobs;
+
+        compare_result_t *result = compare_all(db, algo, &options);
+        EXPECT(test_same_result(result, expected_all),
+               "compare_all(%s, %s, -j %llu) == brute force (%llu matches)",
+               name, description, (unsigned long long) nb_jobs,
+               (unsigned long long) nb_matches(expected_all));
+        compare_result_free(result);
+
+        result = compare_query(queries, db, algo, &options);
+        EXPECT(test_same_result(result, expected_query),
+               "compare_query(%s, %s, -j %llu) == brute force (%llu matches)",
+               name, description, (unsigned long long) nb_jobs,
+               (unsigned long long) nb_matches(expected_query));
+        compare_result_free(result);
+    }
+
+    compare_result_free(expected_all);
+    compare_result_free(expected_query);
+}
+
+int main(void)
+{
+    sig_db_t *db = sig_db_new();
+    for (uint64_t i = 0; i < NB_FILES; i++)
+        test_file_add(&FILES, db, i);
+
+    sig_db_t *queries = sig_db_new();
+    for (uint64_t q = 0; q < NB_QUERIES; q++)
+        test_file_add(&FILES, queries, NB_FILES + q);
+
+    for (compare_algorithm_e algo = COMPARE_CTPH; algo < COMPARE_END; algo++) {
+        printf("----( Check the %s comparision )----\n",
+               (algo == COMPARE_CTPH) ? "CTPH" : "SimHash");
+
+        check_options(db, queries, algo,
+                      (compare_options_t){.simhash_radius = -1}, "all");
+        check_options(db, queries, algo,
+                      (compare_options_t){.top = 3, .simhash_radius = -1},
+                      "top 3");
+        check_options(db, queries, algo,
+                      (compare_options_t){.min_score = 60.0,
+                                          .simhash_radius = -1},
+                      "min score 60");
+        check_options(db, queries, algo,
+                      (compare_options_t){.top = 2,
+                                          .min_score = 30.0,
+                                          .simhash_radius = 12},
+                      "top 2, min score 30, radius 12");
+
+        if (algo == COMPARE_CTPH) {
+            check_options(db, queries, algo,
+                          (compare_options_t){.simhash_radius = 12,
+                                              .cascade = true},
+                          "cascade 12");
+            check_options(db, queries, algo,
+                          (compare_options_t){.top = 4,
+                                              .simhash_radius = 12,
+                                              .cascade = true},
+                          "cascade 12, top 4");
+        }
+
+        printf("\n");
+    }
+
+    /* Test the pairs of the same files */
+    printf("----( Check the pairs scored once )----\n");
+
+    sig_db_t *same = sig_db_new();
+    test_file_t file;
+    test_file_make(&FILES, 0, &file);
+    for (uint64_t i = 0; i < NB_SAME; i++) {
+        sprintf(file.name, "same_%llu", (unsigned long long) i);
+        sig_db_add(same, file.name, file.ctph, file.simhash);
+    }
+
+    for (compare_algorithm_e algo = COMPARE_CTPH; algo < COMPARE_END; algo++)
+        for (uint64_t nb_jobs = 1; nb_jobs <= 4; nb_jobs += 3) {
+            compare_options_t options = {.nb_jobs = nb_jobs,
+                                         .simhash_radius = -1};
+            compare_result_t *result = compare_all(same, algo, &options);
+            EXPECT(each_pair_once(result),
+                   "compare_all(%s, %d same files, -j %llu) matches each "
+                   "pair once in both lists",
+                   (algo == COMPARE_CTPH) ? "CTPH" : "SimHash", NB_SAME,
+                   (unsigned long long) nb_jobs);
+            compare_result_free(result);
+        }
+
+    printf("\n");
+
+    sig_db_free(same);
+    sig_db_free(db);
+    sig_db_free(queries);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,100 @@
+#include "ctph_index.h"
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NB_DIGESTS 5
+
+static void EXPECT(bool test, char *fmt, ...)
+{
+    fprintf(stdout, "Checking '");
+
+    va_list vargs;
+    va_start(vargs, fmt);
+    vprintf(fmt, vargs);
+    va_end(vargs);
+
+    if (test)
+        fprintf(stdout, "': (passed)\n");
+    else
+        fprintf(stdout, "': (failed!)\n");
+}
+
+int main(void)
+{
+    /* clang-format off */
+    char *str[NB_DIGESTS] = {
+        "roll:48:abcdefghijk:zyxwvu",
+        "roll:48:xxabcdefgyy:zz",      /* Shares "abcdefg" with 0 */
+        "roll:96:abcdefghijk:lmnopqr", /* "abcdefg" at 96, 0 is short */
+        "roll:24:0123456:abcdefghijk", /* "abcdefg" at 48 with 0 and 1 */
+        "roll:48:aaaaaaaaaaa:bcdefgh"  /* "bcdefgh" at 96 with 2 only */
+    };
+    /* clang-format on */
+
+    ctph_digest_t digests[NB_DIGESTS];
+    uint64_t ids[NB_DIGESTS], seen[NB_DIGESTS] = {0};
+    uint64_t candidates[NB_DIGESTS];
+
+    for (uint64_t i = 0; i < NB_DIGESTS; i++) {
+        ctph_digest_parse(str[i], &digests[i]);
+        ids[i] = i;
+    }
+
+    /* Test ctph_index_new */
+    printf("----( Check ctph_index_new )----\n");
+
+    ctph_index_t *index = ctph_index_new(digests, NB_DIGESTS, ids, NB_DIGESTS);
+    EXPECT((index != NULL), "ctph_index_new(digests) != NULL");
+    EXPECT((ctph_index_new(digests, 2, ids, NB_DIGESTS) == NULL),
+           "ctph_index_new(digests, id too high) == NULL");
+
+    printf("\n");
+
+    /* Test ctph_index_candidates */
+    printf("----( Check ctph_index_candidates )----\n");
+
+    uint64_t n = ctph_index_candidates(index, 0, seen, candidates);
+    EXPECT((n == 2 && candidates[0] + candidates[1] == 4),
+           "ctph_index_candidates(0) == {1, 3}");
+    n = ctph_index_candidates(index, 1, seen, candidates);
+    EXPECT((n == 1 && candidates[0] == 3), "ctph_index_candidates(1) == {3}");
+    n = ctph_index_candidates(index, 2, seen, candidates);
+    EXPECT((n == 1 && candidates[0] == 4), "ctph_index_candidates(2) == {4}");
+    n = ctph_index_candidates(index, 3, seen, candidates);
+    EXPECT((n == 0), "ctph_index_candidates(3) == {}");
+    n = ctph_index_candidates(index, 4, seen, candidates);
+    EXPECT((n == 0), "ctph_index_candidates(4) == {}");
+
+    ctph_index_free(index);
+
+    /* Index without the id 1 */
+    uint64_t some_ids[2] = {0, 3};
+    index = ctph_index_new(digests, NB_DIGESTS, some_ids, 2);
+    n = ctph_index_candidates(index, 0, seen, candidates);
+    EXPECT((n == 1 && candidates[0] == 3),
+           "ctph_index_candidates(0) == {3} without 1");
+    n = ctph_index_candidates(index, 1, seen, candidates);
+    EXPECT((n == 0), "ctph_index_candidates(1) == {} without 1");
+
+    printf("\n");
+
+    /* Test ctph_index_lookup */
+    printf("----( Check ctph_index_lookup )----\n");
+
+    ctph_digest_t query;
+    ctph_digest_parse("roll:48:qqabcdefgqq:zz", &query);
+    n = ctph_index_lookup(index, &query, NB_DIGESTS + 1, seen, candidates);
+    EXPECT((n == 2 && candidates[0] + candidates[1] == 3),
+           "ctph_index_lookup(roll:48:qqabcdefgqq:zz) == {0, 3}");
+    n = ctph_index_lookup(index, &query, NB_DIGESTS + 1, seen, candidates);
+    EXPECT((n == 0), "ctph_index_lookup() == {} with the same stamp");
+    ctph_digest_parse("roll:96:qqabcdefgqq:zz", &query);
+    n = ctph_index_lookup(index, &query, NB_DIGESTS + 2, seen, candidates);
+    EXPECT((n == 0), "ctph_index_lookup(roll:96:qqabcdefgqq:zz) == {}");
+    ctph_index_free(index);
+
+    return EXIT_SUCCESS;
+}
@@ -2,12 +2,41 @@
 #include "../include/ctph.h"
 #include "../include/edit_dist.h"
 
+#include <inttypes.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 
 #include <string.h>
 
+/* Parameters of ctph.c */
+#define WINDOW_SIZE 7
+#define MIN_BLOCK_SIZE 3
+#define SIGN_LENGTH 64
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325
+#define FNV_PRIME 0x100000001b3
+
+static const char *b64 =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static void EXPECT(bool test, char *fmt, ...)
+{
+    fprintf(stdout, "Checking '");
+
+    va_list vargs;
+    va_start(vargs, fmt);
+    vprintf(fmt, vargs);
+    va_end(vargs);
+
+    if (test)
+        fprintf(stdout, "': (passed)\n");
+    else
+        fprintf(stdout, "': (failed!)\n");
+}
+
 char *gen_hash(char *path)
 {
     FILE *f = fopen(path, "rb");
@@ -18,6 +47,303 @@ char *gen_hash(char *path)
     return hash;
 }
 
+/* Pseudo-random bytes, from a small alphabet with runs of zeros if low */
+static void fill_buffer(uint8_t *buffer, uint64_t len, uint64_t seed, bool low)
+{
+    uint64_t state = seed * 0x9e3779b97f4a7c15 + 1;
+    for (uint64_t i = 0; i < len; i++) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        buffer[i] = low ? ((state >> 40) % 8 < 3 ? 0 : "\x48\x89\xe5\xc3"
+                                                        [(state >> 20) % 4])
+                        : (uint8_t)(state >> 32);
+    }
+}
+
+/*
+ * Rolling hash of the WINDOW_SIZE bytes ending at last, from its definition :
+ * sum of the bytes, sum of the bytes weighted by their age in the window, and
+ * xor of the bytes shifted by 5 bits per step
+ */
+static uint32_t reference_window(const uint8_t *last)
+{
+    uint32_t sum = 0, weighted = 0, shifted = 0;
+    for (uint32_t j = 0; j < WINDOW_SIZE; j++) {
+        sum += last[-(int) j];
+        weighted += (WINDOW_SIZE - j) * last[-(int) j];
+        shifted ^= (uint32_t) last[-(int) j] << (5 * j);
+    }
+
+    return sum + weighted + shifted;
+}
+
+/*
+ * Signature of the bytes for the block size B alone, byte by byte with a
+ * 64-bit FNV hash. Return its length - 1, as the engine of tbt 1.0.
+ */
+static int reference_signature(const uint8_t *bytes, uint64_t len, uint64_t B,
+                               char signature[SIGN_LENGTH + 1])
+{
+    uint64_t hash = FNV_OFFSET_BASIS;
+    bool pending = false;
+    int count = 0;
+
+    for (uint64_t i = 0; i < len && count < SIGN_LENGTH - 1; i++) {
+        hash = (hash * FNV_PRIME) ^ bytes[i];
+        pending = true;
+
+        if (i + 1 >= WINDOW_SIZE && reference_window(&bytes[i]) % B == B - 1) {
+            signature[count++] = b64[hash & 0x3F];
+            hash = FNV_OFFSET_BASIS;
+            pending = false;
+        }
+    }
+    if (pending)
+        signature[count++] = b64[hash & 0x3F];
+    signature[count] = '\0';
+
+    return count - 1;
+}
+
+/* Rightmost 1 of the first non-zero byte of v, as leftmost() of ctph.c */
+static uint64_t reference_leftmost(uint64_t v)
+{
+    v = __builtin_bswap64(v);
+    return __builtin_bswap64(v & -v);
+}
+
+/*
+ * CTPH of the bytes as tbt 1.0 selected it, one pass per block size : the
+ * block size is halved until the signature has at least 32 characters
+ */
+static char *reference_hash(const uint8_t *bytes, uint64_t len)
+{
+    uint64_t B = MIN_BLOCK_SIZE *
+                 pow(2, log2(len / (SIGN_LENGTH - MIN_BLOCK_SIZE)));
+    if (B == 0)
+        return NULL;
+    B = reference_leftmost(B) << 1;
+
+    char signature[SIGN_LENGTH + 1], previous[SIGN_LENGTH + 1];
+    for (uint64_t block_size = B; block_size > 0; block_size /= 2) {
+        if (reference_signature(bytes, len, block_size, signature) < 32) {
+            strcpy(previous, signature);
+            continue;
+        }
+        if (block_size == B)
+            reference_signature(bytes, len, B * 2, previous);
+
+        char *hash = malloc(27 + 2 * (SIGN_LENGTH + 1));
+        sprintf(hash, "roll:%" PRIu64 ":%s:%s", block_size, signature,
+                previous);
+        return hash;
+    }
+
+    return NULL;
+}
+
+/* CTPH of the bytes, all in the .text section */
+static char *hash_bytes(uint8_t *bytes, uint64_t len)
+{
+    section_data sections[SECTION_END];
+    memset(sections, 0, sizeof(sections));
+    sections[TEXT].data = bytes;
+    sections[TEXT].len = len;
+
+    return ctph_hash(sections);
+}
+
+/*
+ * Check that the single pass over all the block sizes gives the signatures of
+ * one pass per block size
+ */
+static void check_single_pass(void)
+{
+    static const uint64_t sizes[] = {100,   1000,   4096,    10000,
+                                     65536, 300000, 1000000, 3000000};
+
+    printf("----( Check the single pass engine )----\n");
+
+    for (uint8_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+        for (uint8_t low = 0; low < 2; low++) {
+            uint8_t *buffer = malloc(sizes[s]);
+            fill_buffer(buffer, sizes[s], s + 1, low);
+
+            char *hash = hash_bytes(buffer, sizes[s]);
+            char *expected = reference_hash(buffer, sizes[s]);
+            EXPECT((hash != NULL && expected != NULL &&
+                    strcmp(hash, expected) == 0),
+                   "ctph_hash(%s %" PRIu64 " bytes) == one pass per block "
+                   "size",
+                   low ? "low entropy" : "random", sizes[s]);
+
+            free(hash);
+            free(expected);
+            free(buffer);
+        }
+
+    printf("\n");
+}
+
+/*
+ * Check the signatures of fixed buffers : the same on all hosts, with or
+ * without AVX2
+ */
+static void check_digests(void)
+{
+    static const uint64_t sizes[] = {1000, 4096, 65536};
+    /* clang-format off */
+    static const char *expected[][2] = {
+        {"roll:32:"
+         "1rgeN8vkGMi8SlXsyaKtUdtcGijOLHBtHPiD5:"
+         "1rgpaSXsyaKtUV+OLW5",
+         "roll:32:"
+         "vX1yT58h11s+1dQaVRG+X53aaI9c8yNVHwHD1:"
+         "vK58xtNQkpnImSHj"},
+        {"roll:16:"
+         "kIhqPQ5M/mKQZiucCHE2LWs7Zzi2OEU2a/6Pj/XioNDYVBT/mDKgtDIk6gf+n3m:"
+         "kmZQ/mpH1g2OE9asPAQDYxRmEwI5/oMlH8IS0sqIRW8eHWbPqrHZCTZSDVeyNYC",
+         "roll:16:"
+         "JphFfWeazEMQkIyQUtfb+twPaDfa9muEdW6adolrVRQydxksikcWoxDlqWx6Ste:"
+         "Jph/laHBINyb+4aZtusW6fTRQydxksNcBnqg6StqIVOWeT6r/hzm+uti9fnGO6L"},
+        {"roll:1024:"
+         "1W4LZYFdxV27InLBl06HZFpMkaBACITJYv/15jesi+Y96kZyoNR/g3uADl6lyyf:"
+         "GyXWnr0oRpuACGYv/X8lyoJJ/llLORgS",
+         "roll:1024:"
+         "V/btNvIReJP7YCEVszOgnpo07OQZ5EOCfGd:"
+         "V/btXIyPOpVropokOOwfGd"}
+    };
+    /* clang-format on */
+
+    printf("----( Check the digests of fixed buffers )----\n");
+
+    for (uint8_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+        for (uint8_t low = 0; low < 2; low++) {
+            uint8_t *buffer = malloc(sizes[s]);
+            fill_buffer(buffer, sizes[s], s + 1, low);
+
+            char *hash = hash_bytes(buffer, sizes[s]);
+            EXPECT((hash != NULL && strcmp(hash, expected[s][low]) == 0),
+                   "ctph_hash(%s %" PRIu64 " bytes) == %.24s...",
+                   low ? "low entropy" : "random", sizes[s],
+                   expected[s][low]);
+
+            free(hash);
+            free(buffer);
+        }
+
+    /* The signatures of tbt 1.0 have other trigger points */
+    ctph_digest_t digest;
+    EXPECT(!ctph_digest_parse("48:D0NwiJUMuZVXB9:D0NwiJU", &digest),
+           "!ctph_digest_parse(untagged signature)");
+    EXPECT((ctph_compare("48:D0NwiJUMuZVXB9:D0NwiJU",
+                         "roll:48:D0NwiJUMuZVXB9:D0NwiJU") == -1),
+           "ctph_compare(untagged signature, tagged signature) == -1");
+
+    printf("\n");
+}
+
+/*
+ * Check that the signature doesn't depend on how the bytes are split in
+ * sections : the window continues from a section to the next one, whether the
+ * trigger points were searched byte by byte or many at once
+ */
+static void check_sections(void)
+{
+    /* Lengths of the sections, the last one taking the remaining bytes */
+    /* clang-format off */
+    static const uint64_t splits[][SECTION_END - 1] = {
+        {0, 0, 0, 0, 0, 0},
+        {1, 0, 5, 6, 0, 7},
+        {31, 32, 33, 0, 1, 2},
+        {3, 100, 0, 6, 4000, 40},
+        {37, 38, 39, 40, 41, 42},
+        {5000, 1, 5000, 6, 5000, 0}
+    };
+    /* clang-format on */
+    const uint64_t len = 40000;
+
+    printf("----( Check the windows across sections )----\n");
+
+    uint8_t *buffer = malloc(len);
+    fill_buffer(buffer, len, 42, false);
+    char *expected = reference_hash(buffer, len);
+
+    for (uint8_t s = 0; s < sizeof(splits) / sizeof(splits[0]); s++) {
+        section_data sections[SECTION_END];
+        uint64_t offset = 0;
+        for (uint8_t i = 0; i < SECTION_END; i++) {
+            uint64_t size = (i + 1 < SECTION_END) ? splits[s][i] : len - offset;
+            sections[i].data = &buffer[offset];
+            sections[i].len = size;
+            offset += size;
+        }
+
+        char *hash = ctph_hash(sections);
+        EXPECT((hash != NULL && expected != NULL &&
+                strcmp(hash, expected) == 0),
+               "ctph_hash(sections %" PRIu64 ", %" PRIu64 ", %" PRIu64
+               ", %" PRIu64 ", %" PRIu64 ", %" PRIu64 ", ...) == one section",
+               splits[s][0], splits[s][1], splits[s][2], splits[s][3],
+               splits[s][4], splits[s][5]);
+        free(hash);
+    }
+
+    free(expected);
+    free(buffer);
+    printf("\n");
+}
+
+/*
+ * Check that ctph_compare_min() gives the score of ctph_compare() when it is at
+ * least the minimum, else 0, on the samples and on copies of a buffer more and
+ * more modified
+ */
+static void check_compare_min(char *samples[], uint8_t nb_samples)
+{
+    const uint64_t len = 30000;
+    enum { NB_COPIES = 10 };
+
+    printf("----( Check the minimum scores )----\n");
+
+    uint8_t *buffer = malloc(len), *copy = malloc(len);
+    fill_buffer(buffer, len, 7, false);
+    fill_buffer(copy, len, 8, false);
+
+    char *hashes[NB_COPIES];
+    for (uint8_t k = 0; k < NB_COPIES; k++) {
+        /* k * 400 bytes replaced, from several places */
+        for (uint64_t i = 0; i < k * 400; i++)
+            buffer[(i * 7919) % len] = copy[i];
+        hashes[k] = hash_bytes(buffer, len);
+    }
+
+    bool same = true;
+    uint32_t nb_scores = 0;
+    for (uint8_t k = 0; k < NB_COPIES + nb_samples; k++)
+        for (uint8_t l = 0; l < NB_COPIES + nb_samples; l++) {
+            char *a = (k < NB_COPIES) ? hashes[k] : samples[k - NB_COPIES];
+            char *b = (l < NB_COPIES) ? hashes[l] : samples[l - NB_COPIES];
+            int score = ctph_compare(a, b);
+            nb_scores += score > 0 && score < 100;
+
+            for (int min = 0; min <= 101; min++)
+                same = same && ctph_compare_min(a, b, min) ==
+                                   ((score >= min) ? score : 0);
+        }
+    EXPECT(same,
+           "ctph_compare_min(a, b, min) == ctph_compare(a, b) if at least min, "
+           "else 0 (%" PRIu32 " partial scores)",
+           nb_scores);
+
+    for (uint8_t k = 0; k < NB_COPIES; k++)
+        free(hashes[k]);
+    free(copy);
+    free(buffer);
+    printf("\n");
+}
+
 int main(void)
 {
     /* clang-format off */
@@ -84,5 +410,27 @@ int main(void)
     printf("[ %02d%% ] %s - %s\n", res2, f1, f3);
     printf("[ %02d%% ] %s - %s\n", res3, f2, f3);
 
+    printf("\n\n");
+
+    /* Parsed signatures must give the same scores */
+    ctph_digest_t digest[8];
+    bool same = true;
+    for (uint8_t i = 0; i < 8; i++)
+        same = ctph_digest_parse(hash[i], &digest[i]) && same;
+    for (uint8_t i = 0; i < 8; i++)
+        for (uint8_t j = 0; j < 8; j++)
+            same = same && ctph_compare_digest(&digest[i], &digest[j], 0) ==
+                               ctph_compare(hash[i], hash[j]);
+    printf("ctph_compare_digest == ctph_compare : %s\n",
+           same ? "(passed)" : "(failed!)");
+    printf("ctph_digest_parse(\"48:abc\") : %s\n",
+           !ctph_digest_parse("48:abc", &digest[0]) ? "(passed)" : "(failed!)");
+    printf("\n");
+
+    check_single_pass();
+    check_digests();
+    check_sections();
+    check_compare_min(hash, 8);
+
     return EXIT_SUCCESS;
 }
\ No newline at end of file
@@ -0,0 +1,293 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "daemon.h"
+
+#include <signal.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define CTPH_A "roll:48:ABCDEFGHIJKLMNOPQRSTUVWXYZabcdef:ABCDEFGHIJKLMNOP"
+#define CTPH_B "roll:48:ABCDEFGHIJKLMNOPQRSTUVWXYZabcdeX:ABCDEFGHIJKLMNOP"
+#define SIMHASH_A "md5:0123456789abcdef0123456789abcdef"
+#define SIMHASH_B "md5:0123456789abcdef0123456789abcdee"
+
+static void EXPECT(bool test, char *fmt, ...)
+{
+    fprintf(stdout, "Checking '");
+
+    va_list vargs;
+    va_start(vargs, fmt);
+    vprintf(fmt, vargs);
+    va_end(vargs);
+
+    if (test)
+        fprintf(stdout, "': (passed)\n");
+    else
+        fprintf(stdout, "': (failed!)\n");
+}
+
+/* Hashes of the files "a" and "b", the other files can't be hashed */
+static bool fake_hash(char *path, char **name, char **ctph, char **simhash)
+{
+    if (strcmp(path, "a") != 0 && strcmp(path, "b") != 0)
+        return false;
+
+    bool a = strcmp(path, "a") == 0;
+    *name = strdup(path);
+    *ctph = strdup(a ? CTPH_A : CTPH_B);
+    *simhash = strdup(a ? SIMHASH_A : SIMHASH_B);
+    return true;
+}
+
+/* The daemon run by a thread */
+typedef struct {
+    daemon_config_t config;
+    bool ret;
+} daemon_work_t;
+
+static void *run_daemon(void *arg)
+{
+    daemon_work_t *work = arg;
+    work->ret = daemon_run(&work->config);
+    return NULL;
+}
+
+static void wait_a_bit(void)
+{
+    struct timespec delay = {.tv_nsec = 10 * 1000 * 1000};
+    nanosleep(&delay, NULL);
+}
+
+/* Socket connected to path, -1 if problems */
+static int connect_socket(const char *path)
+{
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd >= 0 && connect(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0) {
+        close(fd);
+        fd = -1;
+    }
+
+    return fd;
+}
+
+/* Socket connected to the daemon once it listens on path, -1 if problems */
+static int wait_daemon(const char *path)
+{
+    for (int k = 0; k < 500; k++) {
+        int fd = connect_socket(path);
+        if (fd >= 0)
+            return fd;
+        wait_a_bit();
+    }
+
+    return -1;
+}
+
+/*
+ * Send the request and read the answer up to its "OK" or "ERR" line, the
+ * answer being freed by the caller. NULL if problems.
+ */
+static char *request(int fd, const char *line)
+{
+    size_t len = strlen(line);
+    if (send(fd, line, len, MSG_NOSIGNAL) != (ssize_t) len ||
+        send(fd, "\n", 1, MSG_NOSIGNAL) != 1)
+        return NULL;
+
+    char *answer = NULL;
+    size_t size = 0;
+    FILE *out = open_memstream(&answer, &size);
+    if (out == NULL)
+        return NULL;
+
+    /* The line being read, read byte per byte to leave the next answers */
+    char current[256];
+    size_t n = 0;
+    char c;
+    while (recv(fd, &c, 1, 0) == 1) {
+        fputc(c, out);
+        if (c != '\n') {
+            if (n < sizeof(current) - 1)
+                current[n++] = c;
+            continue;
+        }
+
+        current[n] = '\0';
+        n = 0;
+        if (strncmp(current, "OK", 2) == 0 || strncmp(current, "ERR", 3) == 0) {
+            fclose(out);
+            return answer;
+        }
+    }
+
+    fclose(out);
+    free(answer);
+    return NULL;
+}
+
+/* Check that the answer of the request contains the expected text */
+static bool answers(int fd, const char *line, const char *expected)
+{
+    char *answer = request(fd, line);
+    bool ret = answer != NULL && strstr(answer, expected) != NULL;
+    free(answer);
+    return ret;
+}
+
+/* Check that the client was refused : the daemon serves too many clients */
+static bool refused(int fd)
+{
+    char buffer[64] = {0};
+    ssize_t n = recv(fd, buffer, sizeof(buffer) - 1, 0);
+    return n > 0 && strcmp(buffer, "ERR too many clients\n") == 0 &&
+           recv(fd, buffer, sizeof(buffer), 0) == 0;
+}
+
+int main(void)
+{
+    char path[64], file_path[64];
+    sprintf(path, "/tmp/daemon_test_%d.sock", (int) getpid());
+    sprintf(file_path, "/tmp/daemon_test_%d.file", (int) getpid());
+    unlink(path);
+
+    compare_options_t options = {.nb_jobs = 1, .simhash_radius = -1};
+    daemon_work_t work = {
+        .config = {.socket_path = path,
+                   .store = sig_store_new(sig_db_new(), &options),
+                   .algorithms = {true, true},
+                   .hash = fake_hash}};
+
+    /* Test listen_socket */
+    printf("----( Check the socket )----\n");
+
+    FILE *file = fopen(file_path, "w");
+    fclose(file);
+    daemon_config_t config = work.config;
+    config.socket_path = file_path;
+    struct stat info;
+    EXPECT((daemon_run(&config) == false && stat(file_path, &info) == 0 &&
+            S_ISREG(info.st_mode)),
+           "daemon_run(regular file) == false, the file being kept");
+    unlink(file_path);
+
+    /* A socket left by a daemon no longer running */
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    strcpy(addr.sun_path, path);
+    int stale = socket(AF_UNIX, SOCK_STREAM, 0);
+    bind(stale, (struct sockaddr *) &addr, sizeof(addr));
+    close(stale);
+
+    pthread_t thread;
+    pthread_create(&thread, NULL, run_daemon, &work);
+    int fd = wait_daemon(path);
+    EXPECT((fd >= 0), "daemon_run() replaces a stale socket");
+
+    printf("\n");
+
+    /* Test the requests */
+    printf("----( Check the requests )----\n");
+
+    EXPECT(answers(fd, "COUNT", "OK 0\n"), "COUNT == OK 0");
+    EXPECT(answers(fd, "INSERT a", "OK 0\n"), "INSERT a == OK 0");
+    EXPECT(answers(fd, "INSERT b\r", "OK 1\n"), "INSERT b\\r == OK 1");
+    EXPECT(answers(fd, "COUNT", "OK 2\n"), "COUNT == OK 2");
+    EXPECT(answers(fd, "HASH a", "a:\n\t1:" CTPH_A "\n\t2:" SIMHASH_A "\nOK\n"),
+           "HASH a == its signatures");
+    EXPECT(answers(fd, "QUERY a", "--- CTPH ---\n\na :\n[ 100 % ] a\n"),
+           "QUERY a matches a with CTPH");
+    EXPECT(answers(fd, "QUERY a", "--- SIMHASH ---\n\na :\n[ 100.00 % ] a\n"),
+           "QUERY a matches a with SimHash");
+    EXPECT(answers(fd, "QUERY c", "ERR can't hash 'c'\n"),
+           "QUERY c == ERR can't hash");
+    EXPECT(answers(fd, "COUNT 1", "ERR invalid request\n"),
+           "COUNT 1 == ERR invalid request");
+    EXPECT(answers(fd, "INSERT", "ERR invalid request\n"),
+           "INSERT == ERR invalid request");
+    EXPECT(answers(fd, "INSERT ", "ERR invalid request\n"),
+           "INSERT and a space == ERR invalid request");
+    EXPECT(answers(fd, "REMOVE a", "ERR invalid request\n"),
+           "REMOVE a == ERR invalid request");
+
+    char *longest = malloc(3 * DAEMON_MAX_REQUEST_LENGTH + 1);
+    strcpy(longest, "HASH ");
+    memset(longest + 5, 'x', DAEMON_MAX_REQUEST_LENGTH - 5);
+    longest[DAEMON_MAX_REQUEST_LENGTH] = '\0';
+    EXPECT(answers(fd, longest, "ERR can't hash 'xxx"),
+           "request of %d bytes answered", DAEMON_MAX_REQUEST_LENGTH);
+    memset(longest + 5, 'x', 3 * DAEMON_MAX_REQUEST_LENGTH - 5);
+    longest[3 * DAEMON_MAX_REQUEST_LENGTH] = '\0';
+    EXPECT(answers(fd, longest, "ERR request too long\n"),
+           "request of %d bytes == ERR request too long",
+           3 * DAEMON_MAX_REQUEST_LENGTH);
+    free(longest);
+    EXPECT(answers(fd, "COUNT", "OK 2\n"),
+           "COUNT == OK 2 after a request too long");
+
+    printf("\n");
+
+    /* Test the number of clients */
+    printf("----( Check the clients )----\n");
+
+    int clients[DAEMON_MAX_CLIENTS];
+    bool served = true;
+    clients[0] = fd;
+    for (int k = 1; k < DAEMON_MAX_CLIENTS; k++) {
+        clients[k] = connect_socket(path);
+        served = served && answers(clients[k], "COUNT", "OK 2\n");
+    }
+    EXPECT(served, "%d clients served at once", DAEMON_MAX_CLIENTS);
+
+    int extra = connect_socket(path);
+    EXPECT(refused(extra), "client %d == ERR too many clients",
+           DAEMON_MAX_CLIENTS + 1);
+    close(extra);
+
+    /* The client leaving is no longer counted once its thread ends */
+    close(clients[DAEMON_MAX_CLIENTS - 1]);
+    bool replaced = false;
+    for (int k = 0; k < 500 && !replaced; k++) {
+        clients[DAEMON_MAX_CLIENTS - 1] = connect_socket(path);
+        replaced =
+            answers(clients[DAEMON_MAX_CLIENTS - 1], "COUNT", "OK 2\n");
+        if (!replaced) {
+            close(clients[DAEMON_MAX_CLIENTS - 1]);
+            wait_a_bit();
+        }
+    }
+    EXPECT(replaced, "client served once another one left");
+
+    printf("\n");
+
+    /* Test the shutdown */
+    printf("----( Check the shutdown )----\n");
+
+    pthread_kill(thread, SIGTERM);
+    pthread_join(thread, NULL);
+    EXPECT(work.ret, "daemon_run() == true after SIGTERM");
+    EXPECT((access(path, F_OK) != 0), "socket removed");
+
+    char c;
+    bool closed = true;
+    for (int k = 0; k < DAEMON_MAX_CLIENTS; k++) {
+        closed = closed && recv(clients[k], &c, 1, 0) == 0;
+        close(clients[k]);
+    }
+    EXPECT(closed, "clients disconnected");
+    EXPECT((connect_socket(path) < 0), "no client connects anymore");
+
+    sig_store_free(work.config.store);
+    return EXIT_SUCCESS;
+}
@@ -63,6 +63,43 @@ int main(void)
     EXPECT((edit_distn("Hello world", 11, "HellX world", 11) == 2),
            "edit_distn(Hello world, 11, HellX world, 11) == 2");
 
+    /* Reverse */
+    EXPECT((edit_distn("abc", 3, "cba", 3) == 4),
+           "edit_distn(abc, 3, cba, 3) == 4");
+
+    /* Repeated characters */
+    EXPECT((edit_distn("aaaa", 4, "aa", 2) == 2),
+           "edit_distn(aaaa, 4, aa, 2) == 2");
+
+    /* Longest signatures */
+    const char *SIGN_1 =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    const char *SIGN_2 =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789/+";
+    EXPECT((edit_distn(SIGN_1, 64, SIGN_1, 64) == 0),
+           "edit_distn(SIGN_1, 64, SIGN_1, 64) == 0");
+    EXPECT((edit_distn(SIGN_1, 64, SIGN_2, 64) == 2),
+           "edit_distn(SIGN_1, 64, SIGN_2, 64) == 2");
+    EXPECT((edit_distn(SIGN_1, 64, SIGN_1 + 32, 32) == 32),
+           "edit_distn(SIGN_1, 64, SIGN_1 + 32, 32) == 32");
+    EXPECT((edit_distn(SIGN_1 + 32, 32, SIGN_2, 64) == 34),
+           "edit_distn(SIGN_1 + 32, 32, SIGN_2, 64) == 34");
+
+    /* Both strings longer than a signature */
+    char long_1[200], long_2[200];
+    for (int i = 0; i < 200; i++)
+        long_1[i] = long_2[i] = SIGN_1[(i * 7) % 64];
+    long_2[150] = '*';
+    EXPECT((edit_distn(long_1, 200, long_1, 200) == 0),
+           "edit_distn(long_1, 200, long_1, 200) == 0");
+    EXPECT((edit_distn(long_1, 200, long_2, 200) == 2),
+           "edit_distn(long_1, 200, long_2, 200) == 2");
+    EXPECT((edit_distn(long_1, 100, long_1 + 100, 100) ==
+            edit_distn(long_1 + 100, 100, long_1, 100)),
+           "edit_distn(long_1, 100, long_1 + 100, 100) is symmetric");
+    EXPECT((edit_distn(long_1, 80, long_1, 200) == 120),
+           "edit_distn(long_1, 80, long_1, 200) == 120");
+
     /* Test signature */
     // char *h1 = "9hDvtE7FfBli8UiWFvoxF+uY/RTnyzBzZP6QblD11Z";
     // char *h2 = "9hh76794qjH4Mn3fEO+NiWMeC+r019BrWNtlKvB";
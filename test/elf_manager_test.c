@@ -0,0 +1,135 @@
+#include "elf_manager.h"
+
+#include <libelf/elf.h>
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NB_SAMPLES 5
+
+static char *SAMPLES[NB_SAMPLES] = {"samples/hello_1", "samples/hello_2",
+                                    "samples/J.G-sudoku_H4", "samples/hw_v",
+                                    "samples/sudoku_hw5"};
+
+static void EXPECT(bool test, char *fmt, ...)
+{
+    fprintf(stdout, "Checking '");
+
+    va_list vargs;
+    va_start(vargs, fmt);
+    vprintf(fmt, vargs);
+    va_end(vargs);
+
+    if (test)
+        fprintf(stdout, "': (passed)\n");
+    else
+        fprintf(stdout, "': (failed!)\n");
+}
+
+/* Get the data of the file with get, NULL if problems */
+static elf_data open_data(char *path, elf_data (*get)(FILE *))
+{
+    FILE *fd = fopen(path, "r");
+    if (fd == NULL)
+        return NULL;
+
+    elf_data data = get(fd);
+    fclose(fd);
+    return data;
+}
+
+/* Check that both data have the same sections, with the same bytes */
+static bool same_sections(elf_data data_1, elf_data data_2)
+{
+    if (data_1 == NULL || data_2 == NULL)
+        return false;
+
+    for (uint8_t i = 0; i < SECTION_END; i++)
+        if (data_1[i].len != data_2[i].len ||
+            (data_1[i].len &&
+             memcmp(data_1[i].data, data_2[i].data, data_1[i].len) != 0))
+            return false;
+
+    return true;
+}
+
+/*
+ * Check that the sections found by readelfsects() at once are the ones found
+ * one by one by readelfsection(), with the same bytes. *nb_found is the
+ * number of sections found.
+ */
+static bool same_lookup(char *path, uint8_t *nb_found)
+{
+    FILE *fd = fopen(path, "r");
+    if (fd == NULL)
+        return false;
+
+    Fhdr fhdr;
+    Sect sects[SECTION_END];
+    bool ret =
+        readelfsects(fd, SECTION_NAME, SECTION_END, sects, &fhdr) == 0;
+    freeelf(&fhdr);
+
+    *nb_found = 0;
+    for (uint8_t i = 0; i < SECTION_END && ret; i++) {
+        uint64_t size = 0;
+        uint8_t *sect = readelfsection(fd, SECTION_NAME[i], &size, &fhdr);
+        freeelf(&fhdr);
+
+        uint8_t *buf = malloc(sects[i].size + 1);
+        ret = buf != NULL && sects[i].size == (sect ? size : 0) &&
+              (sect == NULL ||
+               (fseek(fd, sects[i].offset, SEEK_SET) == 0 &&
+                fread(buf, size, 1, fd) == 1 &&
+                memcmp(buf, sect, size) == 0));
+        *nb_found += sect != NULL;
+
+        free(buf);
+        free(sect);
+    }
+
+    fclose(fd);
+    return ret;
+}
+
+int main(void)
+{
+    /* Test elf_map_data */
+    printf("----( Check elf_map_data )----\n");
+
+    for (uint8_t k = 0; k < NB_SAMPLES; k++) {
+        elf_data copied = open_data(SAMPLES[k], elf_get_data);
+        elf_data mapped = open_data(SAMPLES[k], elf_map_data);
+
+        EXPECT((same_sections(mapped, copied) && copied[TEXT].len > 0),
+               "elf_map_data(%s) == elf_get_data(), %" PRIu64 " bytes",
+               SAMPLES[k], copied ? elf_get_data_size(copied) : 0);
+
+        elf_free(copied);
+        elf_free(mapped);
+    }
+
+    EXPECT((open_data("samples/hello_1.c", elf_map_data) == NULL),
+           "elf_map_data(samples/hello_1.c) == NULL");
+
+    printf("\n");
+
+    /* Test readelfsects */
+    printf("----( Check readelfsects )----\n");
+
+    for (uint8_t k = 0; k < NB_SAMPLES; k++) {
+        uint8_t nb_found = 0;
+        bool same = same_lookup(SAMPLES[k], &nb_found);
+        EXPECT((same && nb_found > 0),
+               "readelfsects(%s) == readelfsection() of each section, %u "
+               "sections found",
+               SAMPLES[k], nb_found);
+    }
+
+    printf("\n");
+
+    return EXIT_SUCCESS;
+}
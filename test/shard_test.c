@@ -0,0 +1,184 @@
+#include "shard.h"
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NB_FILES 3
+
+static void EXPECT(bool test, char *fmt, ...)
+{
+    fprintf(stdout, "Checking '");
+
+    va_list vargs;
+    va_start(vargs, fmt);
+    vprintf(fmt, vargs);
+    va_end(vargs);
+
+    if (test)
+        fprintf(stdout, "': (passed)\n");
+    else
+        fprintf(stdout, "': (failed!)\n");
+}
+
+int main(void)
+{
+    FILE *f = tmpfile();
+    shard_header_t header = {.shard = 1,
+                             .nb_shards = 2,
+                             .nb_files = NB_FILES,
+                             .fingerprint = 0xfedcba9876543210,
+                             .top = 5,
+                             .min_score = 33.3,
+                             .ctph_index = true,
+                             .simhash_radius = 12,
+                             .cascade = true};
+
+    compare_result_t *result = compare_result_new(NB_FILES);
+    compare_result_add(result, 0, 2, 82.0, 0);
+    compare_result_add(result, 2, 0, 82.0, 0);
+    compare_result_add(result, 1, 2, 100.0 - 1.5625 * 3, 0);
+    compare_result_add(result, 1, 0, 12.5, 0);
+
+    /* Test shard_write_header and shard_write_matches */
+    printf("----( Check shard_write )----\n");
+
+    EXPECT(shard_write_header(f, &header), "shard_write_header(f, 1/2)");
+    EXPECT(shard_write_matches(f, "CTPH", result),
+           "shard_write_matches(f, CTPH)");
+    EXPECT(shard_write_matches(f, "SIMHASH", result),
+           "shard_write_matches(f, SIMHASH)");
+    EXPECT((shard_write_matches(f, "NAME_TOO_LONG_FOR_A_SECTION", result) ==
+            false),
+           "shard_write_matches(f, name too long) == false");
+    compare_result_free(result);
+
+    printf("\n");
+
+    /* Test shard_read_header and shard_read_matches */
+    printf("----( Check shard_read )----\n");
+
+    rewind(f);
+    shard_header_t read = {0};
+    EXPECT(shard_read_header(f, &read), "shard_read_header(f)");
+    EXPECT((read.shard == 1 && read.nb_shards == 2 && read.nb_files == 3),
+           "header read == 1/2 of 3 files");
+    EXPECT((read.fingerprint == header.fingerprint),
+           "fingerprint read == %016llx",
+           (unsigned long long) header.fingerprint);
+    EXPECT(shard_same_options(&read, &header),
+           "options read == top 5, min score 33.3, index, cascade 12");
+
+    result = compare_result_new(NB_FILES);
+    EXPECT(shard_read_matches(f, "CTPH", result, 0.0, 0),
+           "shard_read_matches(f, CTPH)");
+    compare_result_sort(result);
+    EXPECT((result->lists[0].nb_matches == 1 &&
+            result->lists[1].nb_matches == 2 &&
+            result->lists[2].nb_matches == 1),
+           "matches read in the lists of their file");
+    EXPECT((result->lists[1].matches[0].index == 2 &&
+            result->lists[1].matches[0].score == 100.0f - 1.5625f * 3 &&
+            result->lists[1].matches[1].index == 0),
+           "scores read exactly and sorted");
+    compare_result_free(result);
+
+    result = compare_result_new(NB_FILES);
+    EXPECT((shard_read_matches(f, "CTPH", result, 0.0, 0) == false),
+           "shard_read_matches(f, CTPH) == false on SIMHASH");
+    compare_result_free(result);
+
+    rewind(f);
+    shard_read_header(f, &read);
+    result = compare_result_new(NB_FILES);
+    EXPECT(shard_read_matches(f, "CTPH", result, 50.0, 1),
+           "shard_read_matches(f, CTPH, 50 %%, top 1)");
+    EXPECT((result->lists[1].nb_matches == 1 &&
+            result->lists[1].matches[0].index == 2),
+           "match under 50 %% not kept");
+    compare_result_free(result);
+
+    /* Too few files for the indexes */
+    result = compare_result_new(2);
+    EXPECT((shard_read_matches(f, "SIMHASH", result, 0.0, 0) == false),
+           "shard_read_matches(f) == false with an index too high");
+    compare_result_free(result);
+
+    fclose(f);
+    f = tmpfile();
+    fprintf(f, "TBTSHARD 2 2 2 3 0123456789abcdef 0 0 0 0 -1 0\n");
+    rewind(f);
+    EXPECT((shard_read_header(f, &read) == false),
+           "shard_read_header(shard 2/2) == false");
+    fclose(f);
+
+    /* Shards of tbt without the fingerprint and the options */
+    f = tmpfile();
+    fprintf(f, "TBTSHARD 1 1 2 3\n");
+    rewind(f);
+    EXPECT((shard_read_header(f, &read) == false),
+           "shard_read_header(version 1) == false");
+    fclose(f);
+
+    printf("\n");
+
+    /* Test shard_same_options */
+    printf("----( Check shard_same_options )----\n");
+
+    read = header;
+    read.shard = 0;
+    EXPECT(shard_same_options(&read, &header),
+           "shard_same_options(other shard) == true");
+    read.top = 0;
+    EXPECT((shard_same_options(&read, &header) == false),
+           "shard_same_options(other top) == false");
+    read = header;
+    read.min_score = 40.0;
+    EXPECT((shard_same_options(&read, &header) == false),
+           "shard_same_options(other min score) == false");
+    read = header;
+    read.cascade = false;
+    EXPECT((shard_same_options(&read, &header) == false),
+           "shard_same_options(no cascade) == false");
+
+    printf("\n");
+
+    /* Test shard_fingerprint */
+    printf("----( Check shard_fingerprint )----\n");
+
+    const char *ctph = "roll:3:ABCDEFGHIJ:KLMNO";
+    const char *simhash = "md5:0123456789abcdef0123456789abcdef";
+    sig_db_t *db_1 = sig_db_new();
+    sig_db_t *db_2 = sig_db_new();
+    sig_db_add(db_1, "a", ctph, simhash);
+    sig_db_add(db_1, "b", ctph, NULL);
+    sig_db_add(db_2, "a", ctph, simhash);
+    sig_db_add(db_2, "b", ctph, NULL);
+    EXPECT((shard_fingerprint(db_1) == shard_fingerprint(db_2)),
+           "shard_fingerprint() of the same files are equal");
+
+    sig_db_add(db_1, "c", NULL, simhash);
+    sig_db_add(db_2, "d", NULL, simhash);
+    EXPECT((shard_fingerprint(db_1) != shard_fingerprint(db_2)),
+           "shard_fingerprint() of another name differ");
+    sig_db_free(db_1);
+    sig_db_free(db_2);
+
+    db_1 = sig_db_new();
+    db_2 = sig_db_new();
+    sig_db_add(db_1, "a", ctph, simhash);
+    sig_db_add(db_2, "a", "roll:3:ABCDEFGHIJ:KLMNP", simhash);
+    EXPECT((shard_fingerprint(db_1) != shard_fingerprint(db_2)),
+           "shard_fingerprint() of another CTPH differ");
+    sig_db_free(db_2);
+
+    db_2 = sig_db_new();
+    sig_db_add(db_2, "a", ctph, "md5:1123456789abcdef0123456789abcdef");
+    EXPECT((shard_fingerprint(db_1) != shard_fingerprint(db_2)),
+           "shard_fingerprint() of another SimHash differ");
+    sig_db_free(db_1);
+    sig_db_free(db_2);
+
+    return EXIT_SUCCESS;
+}
@@ -4,6 +4,7 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <err.h>
 #include <openssl/md5.h>
@@ -170,6 +171,22 @@ int main()
 
     printf("\n");
 
+    /* Test shingle_table_next */
+    printf("----( Check shingle_table_next )----\n");
+
+    uint64_t index = 0;
+    EXPECT((shingle_table_next(NULL, &index, &sh_tmp) == false),
+           "shingle_table_next(NULL, &index, &sh_tmp) == false");
+
+    uint64_t nb_next = 0;
+    while (shingle_table_next(table, &index, &sh_tmp))
+        nb_next++;
+    EXPECT((nb_next == 2), "shingle_table_next(table, ...) returns 2 shingles");
+    EXPECT((shingle_table_get_elt_nb(table) == 2),
+           "shingle_table_get_elt_nb(table_iterated) == 2");
+
+    printf("\n");
+
     /* Test shingle_table_remove_first */
     printf("----( Check shingle_table_remove_first )----\n");
 
@@ -196,6 +213,49 @@ int main()
     free(sh.buffer);
     free(sh2.buffer);
 
+    /* Test the all-zero digest, which can't be stored in a slot */
+    printf("----( Check the all-zero digest )----\n");
+
+    static const uint8_t zero_digest[MD5_LENGTH] = {0};
+    shingle_t zero = {.buffer = NULL, .buffer_size = 0};
+    memset(zero.md5_digest, 0, MD5_LENGTH);
+    sh.buffer_size = 100;
+    sh.buffer = gen_rand_buf(sh.buffer_size);
+    MD5(sh.buffer, sh.buffer_size, sh.md5_digest);
+
+    table = shingle_table_malloc(SHINGLE_TABLE_DEFAULT_SIZE);
+    EXPECT((shingle_table_insert(table, zero) == SUCCESSFUL_INSERT),
+           "shingle_table_insert(table, zero) == SUCCESSFUL_INSERT");
+    EXPECT((shingle_table_insert(table, zero) == NO_INSERT),
+           "shingle_table_insert(table, zero) == NO_INSERT");
+    EXPECT((shingle_table_insert(table, sh) == SUCCESSFUL_INSERT),
+           "shingle_table_insert(table, sh) == SUCCESSFUL_INSERT");
+    EXPECT((shingle_table_get_elt_nb(table) == 2),
+           "shingle_table_get_elt_nb(table) == 2");
+
+    uint64_t nb_zero = 0;
+    nb_next = 0;
+    index = 0;
+    while (shingle_table_next(table, &index, &sh_tmp)) {
+        nb_next++;
+        nb_zero += memcmp(sh_tmp.md5_digest, zero_digest, MD5_LENGTH) == 0;
+    }
+    EXPECT((nb_next == 2 && nb_zero == 1),
+           "shingle_table_next(table, ...) returns sh and zero");
+
+    EXPECT((shingle_table_remove_first(table, &sh_tmp) == SUCCESSFUL_REMOVE &&
+            sh_tmp.buffer == sh.buffer),
+           "shingle_table_remove_first(table, &sh_tmp) removes sh");
+    EXPECT((shingle_table_remove_first(table, &sh_tmp) == SUCCESSFUL_REMOVE &&
+            memcmp(sh_tmp.md5_digest, zero_digest, MD5_LENGTH) == 0),
+           "shingle_table_remove_first(table, &sh_tmp) removes zero");
+    EXPECT(shingle_table_is_empty(table), "shingle_table_is_empty(table)");
+
+    shingle_table_free(table);
+    free(sh.buffer);
+
+    printf("\n");
+
     /* Test multiples insertions */
     printf("----( Check multiples insertions )----\n");
 
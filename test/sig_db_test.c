@@ -0,0 +1,147 @@
+#include "sig_db.h"
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DB_FILE "sig_db_test.db"
+
+static void EXPECT(bool test, char *fmt, ...)
+{
+    fprintf(stdout, "Checking '");
+
+    va_list vargs;
+    va_start(vargs, fmt);
+    vprintf(fmt, vargs);
+    va_end(vargs);
+
+    if (test)
+        fprintf(stdout, "': (passed)\n");
+    else
+        fprintf(stdout, "': (failed!)\n");
+}
+
+int main(void)
+{
+    char *ctph = "roll:48:D0NwiJUMuZVXB9:D0NwiJU";
+    char *ctph_untagged = "48:D0NwiJUMuZVXB9:D0NwiJU";
+    char *simhash = "md5:0123456789abcdef0123456789ABCDEF";
+    char *simhash_wy = "wy:ffffffffffffffffffffffffffffffff";
+    char ctph_buf[SIG_DB_CTPH_MAX_LENGTH + 1];
+
+    /* Test sig_db_add */
+    printf("----( Check sig_db_add )----\n");
+
+    sig_db_t *db = sig_db_new();
+    EXPECT((db != NULL), "sig_db_new() != NULL");
+
+    EXPECT(sig_db_add(db, "file_1", ctph, simhash),
+           "sig_db_add(db, file_1, ctph, simhash)");
+    EXPECT(sig_db_add(db, "file_2", NULL, simhash_wy),
+           "sig_db_add(db, file_2, NULL, simhash_wy)");
+    EXPECT(sig_db_add(db, "file_3", "bad", "md5:12"),
+           "sig_db_add(db, file_3, bad, bad)");
+    EXPECT(!sig_db_set_ctph(db, 1, ctph_untagged),
+           "!sig_db_set_ctph(db, 1, untagged ctph)");
+    EXPECT((db->nb_entries == 3), "db->nb_entries == 3");
+    EXPECT((db->entries[0].flags == (SIG_DB_CTPH | SIG_DB_SIMHASH)),
+           "file_1 has CTPH and SimHash");
+    EXPECT((db->entries[1].flags == SIG_DB_SIMHASH), "file_2 has SimHash");
+    EXPECT((db->entries[2].flags == 0), "file_3 has no signatures");
+    EXPECT((sig_db_add(NULL, "file", ctph, simhash) == false),
+           "sig_db_add(NULL, ...) == false");
+
+    printf("\n");
+
+    /* Test sig_db_write and sig_db_map */
+    printf("----( Check sig_db_write and sig_db_map )----\n");
+
+    remove(DB_FILE);
+    FILE *out = fopen(DB_FILE, "wb");
+    EXPECT(sig_db_write(db, out), "sig_db_write(db, out)");
+    fclose(out);
+    sig_db_free(db);
+
+    EXPECT(sig_db_is_file(DB_FILE), "sig_db_is_file(db_file)");
+    EXPECT(!sig_db_is_file("sig_db_test.c"), "!sig_db_is_file(text_file)");
+
+    db = sig_db_map(DB_FILE);
+    EXPECT((db != NULL), "sig_db_map(db_file) != NULL");
+    EXPECT((db->nb_entries == 3), "db->nb_entries == 3");
+    EXPECT((strcmp(sig_db_get_name(db, 1), "file_2") == 0),
+           "sig_db_get_name(db, 1) == file_2");
+    EXPECT((sig_db_get_ctph(db, 0, ctph_buf) &&
+            strcmp(ctph_buf, ctph) == 0),
+           "sig_db_get_ctph(db, 0) == ctph");
+    EXPECT(!sig_db_get_ctph(db, 1, ctph_buf), "!sig_db_get_ctph(db, 1)");
+    EXPECT((db->entries[1].shingle_hash == SHINGLE_HASH_WY),
+           "file_2 SimHash from wy");
+    EXPECT((db->simhash[0][0] == 0x01 && db->simhash[0][15] == 0xef),
+           "file_1 SimHash value");
+    EXPECT((simhash_compare_values(db->simhash[0], db->simhash[0]) == 100.0),
+           "simhash_compare_values(file_1, file_1) == 100");
+
+    sig_db_t view;
+    EXPECT(sig_db_view(db, 1, 3, &view), "sig_db_view(db, 1, 3)");
+    EXPECT((view.nb_entries == 2 &&
+            strcmp(sig_db_get_name(&view, 0), "file_2") == 0 &&
+            view.entries[0].shingle_hash == SHINGLE_HASH_WY),
+           "view entry 0 == file_2");
+    EXPECT(!sig_db_view(db, 2, 4, &view), "!sig_db_view(db, 2, 4)");
+
+    /* Copy of mapped entries */
+    sig_db_t *copy = sig_db_new();
+    EXPECT((sig_db_append(copy, db, 1) && sig_db_append(copy, db, 0)),
+           "sig_db_append(copy, db, 1) and (copy, db, 0)");
+    EXPECT((copy->nb_entries == 2 &&
+            strcmp(sig_db_get_name(copy, 1), "file_1") == 0),
+           "copy entry 1 == file_1");
+    EXPECT((sig_db_get_ctph(copy, 1, ctph_buf) &&
+            strcmp(ctph_buf, ctph) == 0 &&
+            copy->entries[0].shingle_hash == SHINGLE_HASH_WY),
+           "copy signatures == db signatures");
+    EXPECT(!sig_db_append(copy, db, 3), "!sig_db_append(copy, db, 3)");
+    EXPECT(!sig_db_append(db, copy, 0), "!sig_db_append(mapped db, copy, 0)");
+    sig_db_free(copy);
+    sig_db_free(db);
+
+    printf("\n");
+
+    /* Test invalid files */
+    printf("----( Check invalid files )----\n");
+
+    EXPECT((sig_db_map("sig_db_test.c") == NULL),
+           "sig_db_map(text_file) == NULL");
+
+    /* Truncate the names */
+    FILE *in = fopen(DB_FILE, "rb");
+    char buf[4096];
+    size_t len = fread(buf, 1, sizeof(buf), in);
+    fclose(in);
+
+    /* Written on a host of the other byte order */
+    sig_db_header_t header;
+    memcpy(&header, buf, sizeof(header));
+    uint16_t byte_order = SIG_DB_BYTE_ORDER_SWAPPED;
+    memcpy(buf + offsetof(sig_db_header_t, byte_order), &byte_order,
+           sizeof(byte_order));
+    out = fopen(DB_FILE, "wb");
+    fwrite(buf, 1, len, out);
+    fclose(out);
+    EXPECT((header.byte_order == SIG_DB_BYTE_ORDER &&
+            sig_db_map(DB_FILE) == NULL),
+           "sig_db_map(other byte order) == NULL");
+    memcpy(buf, &header, sizeof(header));
+
+    out = fopen(DB_FILE, "wb");
+    fwrite(buf, 1, len - 4, out);
+    fclose(out);
+    EXPECT((sig_db_map(DB_FILE) == NULL), "sig_db_map(truncated) == NULL");
+
+    remove(DB_FILE);
+
+    return EXIT_SUCCESS;
+}
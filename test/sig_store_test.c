@@ -0,0 +1,213 @@
+#include "sig_store.h"
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <pthread.h>
+
+#include "test_files.h"
+
+#define NB_BASE 100
+#define NB_ADDED (3 * SIG_STORE_SEGMENT_SIZE - 100)
+#define NB_FILES (NB_BASE + NB_ADDED)
+#define NB_QUERIES 30
+#define NB_THREADS 4
+#define NB_THREAD_ADDED 600
+
+static void EXPECT(bool test, char *fmt, ...)
+{
+    fprintf(stdout, "Checking '");
+
+    va_list vargs;
+    va_start(vargs, fmt);
+    vprintf(fmt, vargs);
+    va_end(vargs);
+
+    if (test)
+        fprintf(stdout, "': (passed)\n");
+    else
+        fprintf(stdout, "': (failed!)\n");
+}
+
+/* Files alike within a family, all with both signatures */
+static const test_files_t FILES = {.nb_families = 40, .nb_block_sizes = 1};
+
+/* Add the files [first, first + NB_ADDED) to the store, and to db if any */
+static bool fill_store(sig_store_t *store, sig_db_t *db, uint64_t first)
+{
+    for (uint64_t i = first; i < first + NB_ADDED; i++) {
+        test_file_t file;
+        test_file_make(&FILES, i, &file);
+        if (sig_store_add(store, file.name, file.ctph, file.simhash) != i ||
+            (db != NULL &&
+             !sig_db_add(db, file.name, file.ctph, file.simhash)))
+            return false;
+    }
+
+    return true;
+}
+
+/* Check that the store and the database match the queries alike */
+static bool same_matches(sig_store_t *store, sig_db_t *db, sig_db_t *queries,
+                         const compare_options_t *options)
+{
+    bool ret = true;
+    for (compare_algorithm_e algo = COMPARE_CTPH; algo < COMPARE_END; algo++) {
+        compare_result_t *result_1 = sig_store_query(store, queries, algo);
+        compare_result_t *result_2 =
+            compare_query(queries, db, algo, options);
+
+        ret = ret && test_same_result(result_1, result_2);
+        compare_result_free(result_1);
+        compare_result_free(result_2);
+    }
+
+    return ret;
+}
+
+/* Files added by a thread, while querying the store */
+typedef struct {
+    sig_store_t *store;
+    sig_db_t *queries;
+    uint64_t first;
+    bool ret;
+} thread_work_t;
+
+static void *add_and_query(void *arg)
+{
+    thread_work_t *work = arg;
+    work->ret = true;
+
+    for (uint64_t i = work->first; i < work->first + NB_THREAD_ADDED; i++) {
+        test_file_t file;
+        test_file_make(&FILES, i, &file);
+
+        uint64_t index =
+            sig_store_add(work->store, file.name, file.ctph, file.simhash);
+        char *stored = sig_store_get_name(work->store, index);
+        work->ret =
+            work->ret && stored != NULL && strcmp(stored, file.name) == 0;
+        free(stored);
+
+        if (i % 100 == 0) {
+            compare_result_t *result =
+                sig_store_query(work->store, work->queries, COMPARE_CTPH);
+            work->ret = work->ret && result != NULL;
+            compare_result_free(result);
+        }
+    }
+
+    return NULL;
+}
+
+int main(void)
+{
+    compare_options_t options = {.nb_jobs = 2, .simhash_radius = -1};
+
+    sig_db_t *queries = sig_db_new();
+    for (uint64_t q = 0; q < NB_QUERIES; q++)
+        test_file_add(&FILES, queries, NB_FILES + q);
+
+    /* Test sig_store_add */
+    printf("----( Check sig_store_add )----\n");
+
+    sig_db_t *base = sig_db_new();
+    sig_db_t *db = sig_db_new();
+    for (uint64_t i = 0; i < NB_BASE; i++) {
+        test_file_add(&FILES, base, i);
+        test_file_add(&FILES, db, i);
+    }
+
+    sig_store_t *store = sig_store_new(base, &options);
+    EXPECT((store != NULL), "sig_store_new(base) != NULL");
+    EXPECT((sig_store_count(store) == NB_BASE), "sig_store_count() == %d",
+           NB_BASE);
+    EXPECT(same_matches(store, db, queries, &options),
+           "sig_store_query() == compare_query() on the base");
+
+    EXPECT(fill_store(store, db, NB_BASE),
+           "sig_store_add() of %d files, in order", NB_ADDED);
+    EXPECT((sig_store_count(store) == NB_FILES), "sig_store_count() == %d",
+           NB_FILES);
+
+    uint64_t merged = NB_BASE + SIG_STORE_SEGMENT_SIZE;
+    char *name = sig_store_get_name(store, merged);
+    EXPECT((name != NULL && strcmp(name, sig_db_get_name(db, merged)) == 0),
+           "sig_store_get_name() of a merged segment");
+    free(name);
+    EXPECT((sig_store_get_name(store, NB_FILES) == NULL),
+           "sig_store_get_name(%d) == NULL", NB_FILES);
+
+    printf("\n");
+
+    /* Test sig_store_query */
+    printf("----( Check sig_store_query )----\n");
+
+    EXPECT(same_matches(store, db, queries, &options),
+           "sig_store_query() == compare_query()");
+    EXPECT((sig_store_simhash_score(store, queries, 0, 5) ==
+            compare_simhash_score(queries, 0, db, 5)),
+           "sig_store_simhash_score() == compare_simhash_score()");
+    sig_store_free(store);
+
+    compare_options_t indexed = {.nb_jobs = 1,
+                                 .top = 3,
+                                 .min_score = 20.0,
+                                 .ctph_index = true,
+                                 .simhash_radius = 20};
+    base = sig_db_new();
+    for (uint64_t i = 0; i < NB_BASE; i++)
+        test_file_add(&FILES, base, i);
+    store = sig_store_new(base, &indexed);
+    fill_store(store, NULL, NB_BASE);
+    EXPECT(same_matches(store, db, queries, &indexed),
+           "sig_store_query() == compare_query() indexed, top 3");
+
+    compare_options_t cascade = {.nb_jobs = 1,
+                                 .simhash_radius = 20,
+                                 .cascade = true};
+    sig_store_free(store);
+    base = sig_db_new();
+    for (uint64_t i = 0; i < NB_BASE; i++)
+        test_file_add(&FILES, base, i);
+    store = sig_store_new(base, &cascade);
+    fill_store(store, NULL, NB_BASE);
+    compare_result_t *result_1 = sig_store_query(store, queries, COMPARE_CTPH);
+    compare_result_t *result_2 =
+        compare_query(queries, db, COMPARE_CTPH, &cascade);
+    EXPECT(test_same_result(result_1, result_2),
+           "sig_store_query() == compare_query() in cascade");
+    compare_result_free(result_1);
+    compare_result_free(result_2);
+    sig_store_free(store);
+
+    printf("\n");
+
+    /* Test the threads adding and querying at once */
+    printf("----( Check the threads )----\n");
+
+    store = sig_store_new(sig_db_new(), &options);
+    thread_work_t works[NB_THREADS];
+    pthread_t threads[NB_THREADS];
+    for (uint64_t t = 0; t < NB_THREADS; t++) {
+        works[t] = (thread_work_t){store, queries, t * NB_THREAD_ADDED, true};
+        pthread_create(&threads[t], NULL, add_and_query, &works[t]);
+    }
+
+    bool ret = true;
+    for (uint64_t t = 0; t < NB_THREADS; t++) {
+        pthread_join(threads[t], NULL);
+        ret = ret && works[t].ret;
+    }
+    EXPECT(ret, "%d threads adding and querying", NB_THREADS);
+    EXPECT((sig_store_count(store) == NB_THREADS * NB_THREAD_ADDED),
+           "sig_store_count() == %d", NB_THREADS * NB_THREAD_ADDED);
+    sig_store_free(store);
+
+    sig_db_free(db);
+    sig_db_free(queries);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,129 @@
+#include "simhash_index.h"
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NB_VALUES 4000
+#define RADIUS 10
+
+static void EXPECT(bool test, char *fmt, ...)
+{
+    fprintf(stdout, "Checking '");
+
+    va_list vargs;
+    va_start(vargs, fmt);
+    vprintf(fmt, vargs);
+    va_end(vargs);
+
+    if (test)
+        fprintf(stdout, "': (passed)\n");
+    else
+        fprintf(stdout, "': (failed!)\n");
+}
+
+/* Neighbors of the value i found in the index, the same as in a scan */
+static bool check_neighbors(simhash_index_t *index, uint8_t values[][SIMHASH_SIZE],
+                            uint64_t ids[], uint64_t nb_ids, uint64_t i,
+                            uint32_t radius)
+{
+    static uint64_t neighbors[NB_VALUES];
+    static uint32_t distances[NB_VALUES];
+    static bool found[NB_VALUES];
+
+    uint64_t n =
+        simhash_index_neighbors(index, values[i], i, neighbors, distances);
+    for (uint64_t k = 0; k < NB_VALUES; k++)
+        found[k] = false;
+    for (uint64_t k = 0; k < n; k++) {
+        if (found[neighbors[k]] || neighbors[k] < i ||
+            distances[k] != simhash_distance(values[i], values[neighbors[k]],
+                                             SIMHASH_SIZE * 8))
+            return false;
+        found[neighbors[k]] = true;
+    }
+
+    for (uint64_t k = 0; k < nb_ids; k++) {
+        uint32_t dist =
+            simhash_distance(values[i], values[ids[k]], SIMHASH_SIZE * 8);
+        if (ids[k] >= i && (dist <= radius) != found[ids[k]])
+            return false;
+    }
+
+    return true;
+}
+
+int main(void)
+{
+    static uint8_t values[NB_VALUES][SIMHASH_SIZE];
+    static uint64_t ids[NB_VALUES];
+
+    /* Groups of close values */
+    srand(42);
+    for (uint64_t i = 0; i < NB_VALUES; i++) {
+        if (i % 20 == 0)
+            for (uint8_t b = 0; b < SIMHASH_SIZE; b++)
+                values[i][b] = rand();
+        else
+            for (uint8_t b = 0; b < SIMHASH_SIZE; b++)
+                values[i][b] = values[i - 1][b];
+
+        for (int flips = rand() % 8; flips > 0; flips--) {
+            int bit = rand() % (SIMHASH_SIZE * 8);
+            values[i][bit / 8] ^= 1 << (bit % 8);
+        }
+        ids[i] = NB_VALUES - 1 - i;
+    }
+
+    /* Test simhash_index_new */
+    printf("----( Check simhash_index_new )----\n");
+
+    simhash_index_t *index =
+        simhash_index_new((const void *) values, NB_VALUES, ids, NB_VALUES,
+                          RADIUS);
+    EXPECT((index != NULL), "simhash_index_new(values) != NULL");
+    EXPECT((simhash_index_new((const void *) values, 10, ids, NB_VALUES,
+                              RADIUS) == NULL),
+           "simhash_index_new(values, id too high) == NULL");
+
+    printf("\n");
+
+    /* Test simhash_index_neighbors */
+    printf("----( Check simhash_index_neighbors )----\n");
+
+    bool same = true;
+    for (uint64_t i = 0; i < NB_VALUES; i++)
+        same = same && check_neighbors(index, values, ids, NB_VALUES, i,
+                                       RADIUS);
+    EXPECT(same, "simhash_index_neighbors() == scan (radius %d)", RADIUS);
+    simhash_index_free(index);
+
+    /* Narrower chunks */
+    index = simhash_index_new((const void *) values, NB_VALUES, ids,
+                              NB_VALUES, 12);
+    same = true;
+    for (uint64_t i = 0; i < NB_VALUES; i++)
+        same = same && check_neighbors(index, values, ids, NB_VALUES, i, 12);
+    EXPECT(same, "simhash_index_neighbors() == scan (radius 12)");
+    simhash_index_free(index);
+
+    /* Few ids : the index scans them */
+    index = simhash_index_new((const void *) values, NB_VALUES, ids, 30, 40);
+    same = true;
+    for (uint64_t i = 0; i < NB_VALUES; i++)
+        same = same && check_neighbors(index, values, ids, 30, i, 40);
+    EXPECT(same, "simhash_index_neighbors() == scan (30 ids, radius 40)");
+    simhash_index_free(index);
+
+    /* Exact matches only */
+    index = simhash_index_new((const void *) values, NB_VALUES, ids,
+                              NB_VALUES, 0);
+    same = true;
+    for (uint64_t i = 0; i < NB_VALUES; i++)
+        same = same && check_neighbors(index, values, ids, NB_VALUES, i, 0);
+    EXPECT(same, "simhash_index_neighbors() == scan (radius 0)");
+    simhash_index_free(index);
+
+    return EXIT_SUCCESS;
+}
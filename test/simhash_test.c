@@ -1,6 +1,8 @@
 #include "simhash.h"
 
+#include <math.h>
 #include <stdlib.h>
+#include <string.h>
 
 void get_hash(char *file, char **hash)
 {
@@ -10,7 +12,7 @@ void get_hash(char *file, char **hash)
 
     fclose(fd_file);
 
-    *hash = simhash_compute(data);
+    *hash = simhash_compute(data, SHINGLE_HASH_MD5);
 
     elf_free(data);
 }
@@ -45,6 +47,19 @@ int main(void)
     printf("SimHash %s = %s\n", elf_file_4, hash_4);
     printf("SimHash %s = %s\n\n", elf_file_5, hash_5);
 
+    /* Values of the scalar votes, before they were counted 32 bytes at once */
+    char *expected[5] = {"md5:c574573ed52262d6d9260ad74ee7d5fd",
+                         "md5:c172463ed52262d4d9260a574e64d57d",
+                         "md5:c8b5f769d3e0e70325a6889f0a7a1c1f",
+                         "md5:cab1e26d03c2e3e8af2e08bc0c6e855f",
+                         "md5:c1b9f26b53c0c141a72e58151a47154f"};
+    char *computed[5] = {hash_1, hash_2, hash_3, hash_4, hash_5};
+    bool same = true;
+    for (uint8_t i = 0; i < 5; i++)
+        same = same && computed[i] && strcmp(computed[i], expected[i]) == 0;
+    printf("simhash_compute == scalar votes : %s\n\n",
+           same ? "(passed)" : "(failed!)");
+
     printf("--> %s - %s: %.2f %%\n", elf_file_1, elf_file_2,
            simhash_compare(hash_1, hash_2));
     printf("--> %s - %s: %.2f %%\n", elf_file_1, elf_file_3,
@@ -66,6 +81,86 @@ int main(void)
     printf("--> %s - %s: %.2f %%\n", elf_file_4, elf_file_5,
            simhash_compare(hash_4, hash_5));
 
+    /* Shingle hash functions */
+    printf("\n----( Check Shingle Hash Functions )----\n");
+    FILE *fd_file = fopen(elf_file_3, "r");
+    elf_data data = elf_get_data(fd_file);
+    fclose(fd_file);
+    char *hash_wy = simhash_compute(data, SHINGLE_HASH_WY);
+    elf_free(data);
+
+    printf("SimHash %s = %s\n", elf_file_3, hash_wy);
+    printf("simhash_compute(wyhash) == scalar votes : %s\n",
+           strcmp(hash_wy, "wy:246a067818c92de7ce1e24f0d67d0ccb") == 0
+               ? "(passed)"
+               : "(failed!)");
+    printf("--> %s - %s: %.2f %% (same shingle hash)\n", elf_file_3,
+           elf_file_3, simhash_compare(hash_wy, hash_wy));
+    printf("--> %s - %s: %.2f %% (mixed shingle hashes)\n", elf_file_3,
+           elf_file_3, simhash_compare(hash_wy, hash_3));
+    printf("simhash_compare(same shingle hash) == 100 : %s\n",
+           simhash_compare(hash_wy, hash_wy) == 100.0 ? "(passed)"
+                                                      : "(failed!)");
+    printf("simhash_compare(mixed shingle hashes) == 0 : %s\n",
+           simhash_compare(hash_wy, hash_3) == 0.0 ? "(passed)"
+                                                   : "(failed!)");
+
+    /* Batch of distances */
+    printf("\n----( Check Batch of Distances )----\n");
+    char *hashes[5] = {hash_1, hash_2, hash_3, hash_4, hash_5};
+    uint8_t values[11][SIMHASH_SIZE];
+    shingle_hash_e shingle_hash;
+    for (uint8_t i = 0; i < 11; i++)
+        simhash_decode(hashes[i % 5], &shingle_hash, values[i]);
+    values[10][3] ^= 0xff;
+
+    uint32_t distances[11];
+    same = true;
+    simhash_distances(values[0], (const void *) values, 11, distances);
+    for (uint8_t i = 0; i < 11; i++)
+        same = same && distances[i] == simhash_distance(values[0], values[i],
+                                                        SIMHASH_SIZE * 8);
+    printf("simhash_distances == simhash_distance : %s\n",
+           same ? "(passed)" : "(failed!)");
+
+    /* Thresholds of the distances and of the scores */
+    printf("\n----( Check Thresholds )----\n");
+    same = true;
+    for (uint32_t k = 0; k <= SIMHASH_SIZE * 8; k++) {
+        /* k bits flipped */
+        uint8_t value[SIMHASH_SIZE];
+        memcpy(value, values[0], SIMHASH_SIZE);
+        for (uint32_t bit = 0; bit < k; bit++)
+            value[bit / 8] ^= 1 << (bit % 8);
+
+        for (uint32_t max = 0; max <= SIMHASH_SIZE * 8; max++) {
+            uint32_t dist = simhash_distance(values[0], value, max);
+            same = same && (k <= max ? dist == k : dist > max);
+        }
+    }
+    printf("simhash_distance(max) == distance, or > max : %s\n",
+           same ? "(passed)" : "(failed!)");
+
+    same = true;
+    for (uint32_t dist = 0; dist <= SIMHASH_SIZE * 8; dist++) {
+        float score = simhash_distance_score(dist);
+        uint32_t max = simhash_max_distance(score);
+
+        /* The largest distance scoring at least score */
+        same = same && max >= dist && simhash_distance_score(max) >= score &&
+               (max == SIMHASH_SIZE * 8 ||
+                simhash_distance_score(max + 1) < score);
+
+        /* Just under and over the score */
+        float under = nextafterf(score, 0.0), over = nextafterf(score, 200.0);
+        same = same && simhash_max_distance(under) >= dist;
+        if (dist > 0)
+            same = same && simhash_max_distance(over) < dist;
+    }
+    printf("simhash_max_distance(score) == largest distance scoring it : %s\n",
+           same ? "(passed)" : "(failed!)");
+
+    free(hash_wy);
     free(hash_1);
     free(hash_2);
     free(hash_3);
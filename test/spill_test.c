@@ -0,0 +1,88 @@
+#include "spill.h"
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NB_RECORDS (3 * SPILL_CHUNK_SIZE + 10)
+
+static void EXPECT(bool test, char *fmt, ...)
+{
+    fprintf(stdout, "Checking '");
+
+    va_list vargs;
+    va_start(vargs, fmt);
+    vprintf(fmt, vargs);
+    va_end(vargs);
+
+    if (test)
+        fprintf(stdout, "': (passed)\n");
+    else
+        fprintf(stdout, "': (failed!)\n");
+}
+
+int main(void)
+{
+    /* Test spill_new */
+    printf("----( Check spill_new )----\n");
+
+    spill_t *spill = spill_new(2);
+    EXPECT((spill != NULL), "spill_new(2) != NULL");
+
+    /* Test spill_add */
+    printf("----( Check spill_add )----\n");
+
+    bool added = true;
+    for (uint64_t r = 0; r < NB_RECORDS; r++) {
+        spill_record_t record = {.file = r, .index = r + 1, .score = r / 2.0};
+        added = added && spill_add(spill, r % 2, &record);
+    }
+    EXPECT(added, "%d records added to 2 partitions", NB_RECORDS);
+
+    spill_record_t record = {0, 0, 0.0};
+    EXPECT((!spill_add(spill, 2, &record)), "spill_add(partition 2) fails");
+    EXPECT((!spill_add(NULL, 0, &record)), "spill_add(NULL) fails");
+
+    /* Test spill_read */
+    printf("----( Check spill_read )----\n");
+
+    spill_record_t records[SPILL_CHUNK_SIZE];
+    for (uint64_t p = 0; p < 2; p++) {
+        uint64_t nb_read = 0, n;
+        bool in_order = true;
+        for (uint64_t chunk = 0;
+             (n = spill_read(spill, p, chunk, records)) > 0; chunk++) {
+            if (n == UINT64_MAX) {
+                in_order = false;
+                break;
+            }
+
+            for (uint64_t k = 0; k < n; k++, nb_read++) {
+                uint64_t r = 2 * nb_read + p;
+                in_order = in_order && records[k].file == r &&
+                           records[k].index == r + 1 &&
+                           records[k].score == r / 2.0f;
+            }
+        }
+        EXPECT((nb_read == NB_RECORDS / 2), "%d records read from partition %d",
+               NB_RECORDS / 2, (int) p);
+        EXPECT(in_order, "records of partition %d read back in order", (int) p);
+    }
+
+    EXPECT((spill_read(spill, 0, 100, records) == 0),
+           "spill_read(chunk 100) == 0");
+    EXPECT((spill_read(spill, 2, 0, records) == UINT64_MAX),
+           "spill_read(partition 2) == UINT64_MAX");
+
+    /* Test spill_memory */
+    printf("----( Check spill_memory )----\n");
+
+    EXPECT((spill_memory(2) > 2 * SPILL_CHUNK_SIZE * sizeof(spill_record_t)),
+           "spill_memory(2) counts a chunk per partition");
+
+    spill_free(spill);
+    spill_free(NULL);
+
+    return EXIT_SUCCESS;
+}
@@ -46,6 +46,49 @@ def test(command, check_returncode=0, check_stderr=False, file_exist=None):
     return check_test
 
 
+def same_files(file_1, file_2):
+    print("Files " + file_1 + " and " + file_2 + " identical :", end='')
+    same = False
+    if os.path.exists(file_1) and os.path.exists(file_2):
+        with open(file_1, 'rb') as f1, open(file_2, 'rb') as f2:
+            same = f1.read() == f2.read()
+
+    if same:
+        print(" yes (passed)")
+    else:
+        print(" no (failed)")
+    print()
+
+    return same
+
+
+def check_output(command, expected_stdout, expected_stderr=None,
+                 expected_stdout_part=None):
+    proc = subprocess.run(command.split(' '), capture_output=True)
+
+    print("[+] " + command)
+    print("Output as expected :", end='')
+    check_test = proc.returncode == 0
+    if expected_stdout is not None:
+        check_test &= proc.stdout == expected_stdout
+    if expected_stdout_part is not None:
+        check_test &= expected_stdout_part in proc.stdout
+    if expected_stderr is not None:
+        check_test &= expected_stderr in proc.stderr
+    if check_test:
+        print(" yes (passed)")
+    else:
+        print(" no (failed)")
+    print()
+
+    return check_test
+
+
+def write_file(file, content):
+    with open(file, 'wb') as f:
+        f.write(content)
+
+
 def main():
     check = True
 
@@ -66,6 +109,37 @@ def main():
     check &= test("../tbt -c ctph_H_test -o c_test", file_exist="c_test")
     check &= test("../tbt -c simhash_H_test -o s_test", file_exist="s_test")
 
+    # The hashes of a directory don't depend on the number of threads
+    check &= test("../tbt samples/ -j 1 -o j1_test", file_exist="j1_test")
+    check &= test("../tbt samples/ -j 8 -o j8_test", file_exist="j8_test")
+    check &= same_files("j1_test", "j8_test")
+
+    # The hash files are read line by line, whatever their length and ending
+    with open("all_test", 'rb') as f:
+        hashes = f.read()
+    expected = subprocess.run(["../tbt", "-c", "all_test"],
+                              capture_output=True).stdout
+    lines = hashes.split(b'\n')
+
+    write_file("crlf_test", hashes.replace(b'\n', b'\r\n'))
+    check &= check_output("../tbt -c crlf_test", expected)
+
+    long_name = b'x' * 100000
+    write_file("long_test", hashes + long_name + b':\n' + lines[1] + b'\n' +
+               lines[2] + b'\n')
+    check &= check_output("../tbt -c long_test", None,
+                          expected_stdout_part=long_name + b' :')
+
+    write_file("orphan_test", lines[1] + b'\n' + lines[2] + b'\n' + hashes)
+    check &= check_output("../tbt -c orphan_test", expected,
+                          b"orphan_test:1: signature without file name")
+
+    nb_lines = hashes.count(b'\n')
+    write_file("invalid_test", hashes + b'bad:\n\t1:roll:12\n')
+    check &= check_output("../tbt -c invalid_test", None,
+                          b"invalid_test:%d: invalid CTPH signature of 'bad'"
+                          % (nb_lines + 2))
+
     if check:
         print("[!] All tests passed")
     else:
@@ -81,6 +155,12 @@ def main():
     rm_file('a_test')
     rm_file('c_test')
     rm_file('s_test')
+    rm_file('j1_test')
+    rm_file('j8_test')
+    rm_file('crlf_test')
+    rm_file('long_test')
+    rm_file('orphan_test')
+    rm_file('invalid_test')
 
 
 if __name__ == "__main__":
@@ -0,0 +1,84 @@
+#include "test_files.h"
+
+#include <stdio.h>
+
+static uint64_t next_random(uint64_t *state)
+{
+    *state = *state * 6364136223846793005ull + 1442695040888963407ull;
+    return *state >> 33;
+}
+
+void test_file_make(const test_files_t *files, uint64_t i, test_file_t *file)
+{
+    static const char *b64 =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    static const char *hex = "0123456789abcdef";
+    uint64_t family = i % files->nb_families;
+    uint64_t state = family * 2654435761u + 1;
+    uint64_t mutation = i * 40503u + 7;
+
+    sprintf(file->name, "file_%llu", (unsigned long long) i);
+
+    /* Parts of the block sizes B, 2B and 4B */
+    char parts[3][41];
+    for (int p = 0; p < 3; p++) {
+        for (int k = 0; k < 40; k++)
+            parts[p][k] = b64[next_random(&state) % 64];
+        parts[p][40] = '\0';
+        for (uint64_t m = next_random(&mutation) % 6; m > 0; m--)
+            parts[p][next_random(&mutation) % 40] =
+                b64[next_random(&mutation) % 64];
+    }
+
+    /* The part of 2B is the second one of B, the first one of 2B */
+    uint64_t block_size = (uint64_t) 3 << (family % files->nb_block_sizes);
+    bool twice =
+        files->double_block_size && (i / files->nb_families) % 3 == 2;
+    sprintf(file->ctph_buffer, "roll:%llu:%.40s:%.40s",
+            (unsigned long long) block_size << twice, parts[twice],
+            parts[twice + 1]);
+
+    char bits[33];
+    for (int k = 0; k < 32; k++)
+        bits[k] = hex[next_random(&state) % 16];
+    bits[32] = '\0';
+    for (uint64_t m = next_random(&mutation) % 5; m > 0; m--)
+        bits[next_random(&mutation) % 32] = hex[next_random(&mutation) % 16];
+
+    bool wy = files->sparse && i % 23 == 0;
+    sprintf(file->simhash_buffer, "%s:%s", wy ? "wy" : "md5", bits);
+
+    file->ctph =
+        (files->sparse && i % 31 == 5) ? NULL : file->ctph_buffer;
+    file->simhash =
+        (files->sparse && i % 37 == 3) ? NULL : file->simhash_buffer;
+}
+
+bool test_file_add(const test_files_t *files, sig_db_t *db, uint64_t i)
+{
+    test_file_t file;
+    test_file_make(files, i, &file);
+    return sig_db_add(db, file.name, file.ctph, file.simhash);
+}
+
+bool test_same_result(const compare_result_t *result_1,
+                      const compare_result_t *result_2)
+{
+    if (result_1 == NULL || result_2 == NULL ||
+        result_1->nb_files != result_2->nb_files)
+        return false;
+
+    for (uint64_t i = 0; i < result_1->nb_files; i++) {
+        const compare_list_t *list_1 = &result_1->lists[i];
+        const compare_list_t *list_2 = &result_2->lists[i];
+        if (list_1->nb_matches != list_2->nb_matches)
+            return false;
+
+        for (uint64_t k = 0; k < list_1->nb_matches; k++)
+            if (list_1->matches[k].index != list_2->matches[k].index ||
+                list_1->matches[k].score != list_2->matches[k].score)
+                return false;
+    }
+
+    return true;
+}
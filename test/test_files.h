@@ -0,0 +1,41 @@
+#ifndef TEST_FILES_H
+#define TEST_FILES_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "compare.h"
+#include "sig_db.h"
+
+/*
+ * Signatures of generated files, alike within a family : the files of a
+ * family differ by a few characters of their CTPH and a few bits of their
+ * SimHash. The families are spread over the CTPH block sizes 3 << k.
+ */
+typedef struct {
+    uint64_t nb_families;
+    uint8_t nb_block_sizes;  /* k < nb_block_sizes */
+    bool double_block_size;  /* A third of a family has the double block size */
+    bool sparse; /* Some files lack a signature, some SimHash are of wyhash */
+} test_files_t;
+
+/* Signatures of a generated file, NULL if the file lacks it */
+typedef struct {
+    char name[32];
+    const char *ctph;
+    const char *simhash;
+    char ctph_buffer[128];
+    char simhash_buffer[48];
+} test_file_t;
+
+/* Generate the file i */
+void test_file_make(const test_files_t *files, uint64_t i, test_file_t *file);
+
+/* Add the file i to db, as sig_db_add() */
+bool test_file_add(const test_files_t *files, sig_db_t *db, uint64_t i);
+
+/* Check that both results have the same matches, in the same order */
+bool test_same_result(const compare_result_t *result_1,
+                      const compare_result_t *result_2);
+
+#endif